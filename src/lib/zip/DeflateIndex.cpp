@@ -0,0 +1,133 @@
+#include "DeflateIndex.h"
+
+#include "streams/serialization.h"
+
+#include <algorithm>
+
+namespace {
+    
+    constexpr u32 signature = 0x58444644; // "DFDX"
+    constexpr u16 version = 1;
+
+}
+
+DeflateIndex::DeflateIndex(u64 spacing) noexcept : _spacing(std::max<u64>(spacing, 1)) {}
+
+u64 DeflateIndex::spacing() const noexcept {
+    return _spacing;
+}
+
+bool DeflateIndex::isComplete() const noexcept {
+    return _isComplete;
+}
+
+const std::vector<DeflateIndex::AccessPoint>& DeflateIndex::points() const noexcept {
+    return accessPoints;
+}
+
+bool DeflateIndex::bind(u32 crc32, u64 compressedSize, u64 size) noexcept {
+    if (!isBound) {
+        isBound = true;
+        this->crc32 = crc32;
+        this->compressedSize = compressedSize;
+        this->size = size;
+        return true;
+    }
+    return crc32 == this->crc32 && compressedSize == this->compressedSize && size == this->size;
+}
+
+const DeflateIndex::AccessPoint* DeflateIndex::find(u64 uncompressedOffset) const noexcept {
+    const auto it = std::upper_bound(accessPoints.begin(), accessPoints.end(), uncompressedOffset,
+                                     [](u64 offset, const AccessPoint& point) {
+                                         return offset < point.uncompressedOffset;
+                                     });
+    return it == accessPoints.begin() ? nullptr : &*(it - 1);
+}
+
+bool DeflateIndex::add(u64 uncompressedOffset, u64 compressedOffset, u8 bits, const u8* window, size_t windowLength) {
+    const u64 last = accessPoints.empty() ? 0 : accessPoints.back().uncompressedOffset;
+    if (_isComplete || uncompressedOffset < last + _spacing) {
+        return false;
+    }
+    const auto kept = std::min(windowLength, windowSize);
+    auto& point = accessPoints.emplace_back();
+    point.uncompressedOffset = uncompressedOffset;
+    point.compressedOffset = compressedOffset;
+    point.bits = bits;
+    point.window.assign(window + windowLength - kept, window + windowLength);
+    return true;
+}
+
+void DeflateIndex::markComplete() noexcept {
+    _isComplete = true;
+}
+
+void DeflateIndex::serialize(std::ostream& stream) const {
+    ::serialize(stream, signature);
+    ::serialize(stream, version);
+    ::serialize(stream, _spacing);
+    ::serialize(stream, crc32);
+    ::serialize(stream, compressedSize);
+    ::serialize(stream, size);
+    ::serialize(stream, static_cast<u8>(_isComplete));
+    ::serialize(stream, static_cast<u64>(accessPoints.size()));
+    for (const auto& point : accessPoints) {
+        ::serialize(stream, point.uncompressedOffset);
+        ::serialize(stream, point.compressedOffset);
+        ::serialize(stream, point.bits);
+        ::serialize(stream, static_cast<u32>(point.window.size()));
+        stream.write(reinterpret_cast<const char*>(point.window.data()),
+                     static_cast<std::streamsize>(point.window.size()));
+    }
+}
+
+bool DeflateIndex::deserialize(std::istream& stream) {
+    *this = DeflateIndex();
+    
+    u32 actualSignature = 0;
+    u16 actualVersion = 0;
+    ::deserialize(stream, actualSignature);
+    ::deserialize(stream, actualVersion);
+    if (!stream || actualSignature != signature || actualVersion != version) {
+        return false;
+    }
+    
+    DeflateIndex index;
+    u8 isComplete = 0;
+    u64 numPoints = 0;
+    ::deserialize(stream, index._spacing);
+    ::deserialize(stream, index.crc32);
+    ::deserialize(stream, index.compressedSize);
+    ::deserialize(stream, index.size);
+    ::deserialize(stream, isComplete);
+    ::deserialize(stream, numPoints);
+    index.isBound = true;
+    index._isComplete = isComplete != 0;
+    
+    for (u64 i = 0; stream && i < numPoints; i++) {
+        AccessPoint point;
+        u32 windowLength = 0;
+        ::deserialize(stream, point.uncompressedOffset);
+        ::deserialize(stream, point.compressedOffset);
+        ::deserialize(stream, point.bits);
+        ::deserialize(stream, windowLength);
+        if (windowLength > windowSize) {
+            break;
+        }
+        point.window.resize(windowLength);
+        stream.read(reinterpret_cast<char*>(point.window.data()), static_cast<std::streamsize>(point.window.size()));
+        
+        const bool isSorted = index.accessPoints.empty()
+                              || point.uncompressedOffset > index.accessPoints.back().uncompressedOffset;
+        if (!isSorted || point.bits > 7
+            || point.compressedOffset > index.compressedSize || point.uncompressedOffset > index.size) {
+            break;
+        }
+        index.accessPoints.push_back(std::move(point));
+    }
+    if (!stream || index.accessPoints.size() != numPoints || index._spacing == 0) {
+        return false;
+    }
+    *this = std::move(index);
+    return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include "src/main/util/numbers.h"
+
+/**
+ * \brief Access points into a raw deflate stream, so it can be decompressed starting from the middle.
+ *        Each one is at the start of a deflate block, and has the 32 KiB of uncompressed data before it,
+ *        which is the dictionary the rest of the stream can refer back to.
+ *        The access points are about spacing() uncompressed bytes apart,
+ *        so getting to any offset decompresses at most that much first.
+ *
+ *        It's built by reading a deflated ZipArchiveEntry's seekable decompression stream,
+ *        which adds access points the first time it decompresses past them,
+ *        and can be serialized to a sidecar file to skip that the next time.
+ *        Not thread safe, so it should only be used by one stream at a time.
+ */
+class DeflateIndex {
+
+public:
+    
+    static constexpr u64 defaultSpacing = 1 << 20;
+    static constexpr size_t windowSize = 1 << 15;
+    
+    struct AccessPoint {
+        
+        u64 uncompressedOffset = 0;
+        u64 compressedOffset = 0; //< of the first byte that's entirely after the access point
+        u8 bits = 0; //< the number of bits of the previous byte that are after the access point
+        std::vector<u8> window; //< the up to windowSize uncompressed bytes before the access point
+        
+    };
+
+private:
+    
+    u64 _spacing;
+    
+    // what the index is of, so an index isn't used for the wrong data
+    bool isBound = false;
+    u32 crc32 = 0;
+    u64 compressedSize = 0;
+    u64 size = 0;
+    
+    bool _isComplete = false;
+    std::vector<AccessPoint> accessPoints;
+
+public:
+    
+    explicit DeflateIndex(u64 spacing = defaultSpacing) noexcept;
+    
+    u64 spacing() const noexcept;
+    
+    /**
+     * \brief If the whole stream has been decompressed, so there won't be any new access points.
+     */
+    bool isComplete() const noexcept;
+    
+    const std::vector<AccessPoint>& points() const noexcept;
+    
+    /**
+     * \brief Makes this the index of data with the given CRC-32 and sizes, if it isn't the index of anything yet.
+     *
+     * \return  false if it's already the index of different data.
+     */
+    bool bind(u32 crc32, u64 compressedSize, u64 size) noexcept;
+    
+    /**
+     * \brief Gets the last access point at or before uncompressedOffset.
+     *
+     * \return  null if there isn't one, i.e. decompression has to start at the beginning.
+     */
+    const AccessPoint* find(u64 uncompressedOffset) const noexcept;
+    
+    /**
+     * \brief Adds an access point if it's at least spacing() after the last one,
+     *        or at least spacing() from the start if there isn't one yet.
+     *
+     * \param window  The uncompressed data right before the access point, only the end of which is kept.
+     * \return  If it was added.
+     */
+    bool add(u64 uncompressedOffset, u64 compressedOffset, u8 bits, const u8* window, size_t windowLength);
+    
+    void markComplete() noexcept;
+    
+    void serialize(std::ostream& stream) const;
+    
+    /**
+     * \brief Replaces this index with one serialized by serialize().
+     *
+     * \return  false if the stream doesn't hold a valid index, in which case this index is left empty and unbound.
+     */
+    bool deserialize(std::istream& stream);
+
+};
@@ -1,10 +1,55 @@
 #include "ZipArchive.h"
 
+#include "detail/Zip64EndOfCentralDirectory.h"
+#include "streams/countingstream.h"
+#include "streams/fdstream.h"
+#include "streams/memstream.h"
+#include "streams/preadstream.h"
+#include "streams/substream.h"
+#include "utils/stream_utils.h"
+#include "utils/thread_utils.h"
+
 #include <fstream>
+#include <map>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 using detail::EndOfCentralDirectoryBlock;
 using detail::ZipCentralDirectoryFileHeader;
 
+namespace {
+    
+    /**
+     * \brief Finds the last occurrence of a (little-endian, as on disk) signature in buffer.
+     *
+     * \return  The offset of the signature, or std::string_view::npos if it isn't found.
+     */
+    size_t findLastSignature(std::string_view buffer, u32 signature) noexcept {
+        char bytes[sizeof(signature)];
+        std::memcpy(bytes, &signature, sizeof(signature));
+        auto length = buffer.size();
+        while (length >= sizeof(signature)) {
+            // memrchr is vectorized, so find candidates by their first byte and then check the rest
+            const auto found = static_cast<const char*>(
+                    memrchr(buffer.data(), bytes[0], length - (sizeof(signature) - 1)));
+            if (!found) {
+                break;
+            }
+            const auto i = static_cast<size_t>(found - buffer.data());
+            if (std::memcmp(found, bytes, sizeof(signature)) == 0) {
+                return i;
+            }
+            length = i + (sizeof(signature) - 1);
+        }
+        return std::string_view::npos;
+    }
+    
+}
+
 std::string_view ZipArchive::comment() const noexcept {
     return endOfCentralDirectoryBlock.comment;
 }
@@ -13,6 +58,22 @@ void ZipArchive::setComment(std::string_view comment) noexcept {
     endOfCentralDirectoryBlock.comment = comment;
 }
 
+bool ZipArchive::isDeduplicating() const noexcept {
+    return deduplicating;
+}
+
+void ZipArchive::setDeduplicating(bool deduplicating) noexcept {
+    this->deduplicating = deduplicating;
+}
+
+
+void ZipArchive::EntryDeleter::operator()(ZipArchiveEntry* entry) const noexcept {
+    if (inArena) {
+        entry->~ZipArchiveEntry();
+    } else {
+        delete entry;
+    }
+}
 
 const ZipArchive::Entries& ZipArchive::entries() const noexcept {
     return _entries;
@@ -36,31 +97,74 @@ ZipArchiveEntry& ZipArchive::operator[](size_t i) noexcept {
 
 
 size_t ZipArchive::findEntry(std::string_view name) const noexcept {
-    size_t i = 0;
-    for (const auto& entry : *this) {
-        if (entry.fullName() == name) {
-            return i;
-        }
-        i++;
-    }
-    return invalidIndex;
-//    const auto it = std::find_if(begin(), end(), [&name](const ZipArchiveEntry& entry) {
-//        return entry.fullName() == name;
-//    });
-//    if (it == end()) {
-//        return invalidIndex;
-//    }
-//    return static_cast<size_t>(end() - it);
+    const auto it = nameIndex.find(name);
+    return it == nameIndex.end() ? invalidIndex : it->second;
 }
 
 void ZipArchive::removeEntry(size_t index) {
+    unIndexEntry(*entries()[index]);
     // TODO use SlicedIterable
-    for (auto it = begin() + index; it != end(); ++it) {
-        it->index--;
+    for (auto it = begin() + index + 1; it != end(); ++it) {
+        auto& entry = *it;
+        const auto indexed = nameIndex.find(entry.fullName());
+        if (indexed != nameIndex.end() && indexed->second == entry.index) {
+            indexed->second--;
+        }
+        entry.index--;
     }
     entries().erase(entries().begin() + index);
 }
 
+bool ZipArchive::containsEntry(const ZipArchiveEntry& entry) const noexcept {
+    return entry.index < entries().size() && entries()[entry.index].get() == &entry;
+}
+
+void ZipArchive::indexEntry(ZipArchiveEntry& entry) {
+    if (entry.isNameIndexed || !containsEntry(entry)) {
+        return;
+    }
+    entry.isNameIndexed = true;
+    const auto [it, inserted] = nameIndex.emplace(entry.fullName(), entry.index);
+    if (inserted || it->second == entry.index) {
+        return;
+    }
+    numDuplicateNames++;
+    if (entry.index < it->second) {
+        // first entry wins, like a linear search
+        nameIndex.erase(it);
+        nameIndex.emplace(entry.fullName(), entry.index);
+    }
+}
+
+void ZipArchive::unIndexEntry(ZipArchiveEntry& entry) {
+    if (!entry.isNameIndexed || !containsEntry(entry)) {
+        return;
+    }
+    entry.isNameIndexed = false;
+    const auto name = entry.fullName();
+    const auto it = nameIndex.find(name);
+    if (it == nameIndex.end()) {
+        return;
+    }
+    if (it->second != entry.index) {
+        // entry was a shadowed duplicate
+        numDuplicateNames--;
+        return;
+    }
+    nameIndex.erase(it);
+    if (numDuplicateNames == 0) {
+        return;
+    }
+    // promote the next entry with the same name, only scanning when there are any duplicates
+    for (const auto& other : entries()) {
+        if (other.get() != &entry && other->isNameIndexed && other->fullName() == name) {
+            nameIndex.emplace(other->fullName(), other->index);
+            numDuplicateNames--;
+            return;
+        }
+    }
+}
+
 
 ZipArchive::ConstMaybeEntry::ConstMaybeEntry(const ZipArchive& archive,
                                              const std::string& name) noexcept
@@ -110,7 +214,7 @@ ZipArchive::ConstMaybeEntry::operator bool() const noexcept {
 }
 
 std::string_view ZipArchive::ConstMaybeEntry::name() const noexcept {
-    return exists() ? directName() : entryName();
+    return exists() ? entryName() : directName();
 }
 
 const ZipArchiveEntry& ZipArchive::ConstMaybeEntry::get() const {
@@ -165,14 +269,16 @@ void ZipArchive::MaybeEntry::createForcefully() {
     auto& entries = this->entries();
     const auto exists = this->exists();
     const auto i = exists ? impl.index() : entries.size();
-    auto newEntry = std::make_unique<ZipArchiveEntry>(ZipArchiveEntry::ConstructorKey(),
-                                                      const_cast<ZipArchive&>(impl.archive), i, name());
+    auto& archive = const_cast<ZipArchive&>(impl.archive);
+    auto newEntry = EntryPtr(new ZipArchiveEntry(ZipArchiveEntry::ConstructorKey(), archive, i, name()));
     if (exists) {
+        archive.unIndexEntry(*entries[i]);
         entries[i].swap(newEntry);
     } else {
         impl.variant = i;
         entries.push_back(std::move(newEntry));
     }
+    archive.indexEntry(*entries[i]);
 }
 
 void ZipArchive::MaybeEntry::removeForcefully() {
@@ -228,46 +334,135 @@ ZipArchive::MaybeEntry ZipArchive::entry(const std::string& name) noexcept {
 }
 
 
-bool ZipArchive::seekToSignature(u32 signature, ZipArchive::SeekDirection direction) {
+std::string_view ZipArchive::read(u64 offset, size_t length, std::string& buffer) {
+    if (mapping) {
+        const auto bytes = mapping->chars();
+        if (offset > bytes.size()) {
+            return {};
+        }
+        return bytes.substr(offset, length);
+    }
+    if (file) {
+        buffer.resize(length);
+        buffer.resize(file->read(offset, buffer.data(), length));
+        return buffer;
+    }
+    std::lock_guard lock(streamMutex);
     auto& stream = *this->stream;
-    auto streamPosition = stream.tellg();
-    while (!stream.eof() && !stream.fail()) {
-        u32 buffer;
-        deserialize(stream, buffer);
-        if (buffer == signature) {
-            stream.seekg(streamPosition, std::ios::beg);
-            return true;
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    buffer.resize(length);
+    stream.read(buffer.data(), length);
+    buffer.resize(static_cast<size_t>(stream.gcount()));
+    return buffer;
+}
+
+std::string_view ZipArchive::readTail(std::string& buffer, u64& offset) {
+    constexpr size_t maxTailSize = EndOfCentralDirectoryBlock::size + std::numeric_limits<u16>::max();
+    u64 size;
+    if (mapping) {
+        size = mapping->size();
+    } else if (file) {
+        size = file->size();
+    } else {
+        std::lock_guard lock(streamMutex);
+        auto& stream = *this->stream;
+        stream.seekg(0, std::ios::end);
+        const auto end = stream.tellg();
+        if (end == std::ios::pos_type(-1)) {
+            return {};
         }
-        streamPosition += static_cast<i32>(direction);
-        stream.seekg(streamPosition, std::ios::beg);
+        size = static_cast<u64>(end);
     }
-    return false;
+    const auto tailSize = std::min<u64>(maxTailSize, size);
+    offset = size - tailSize;
+    return read(offset, tailSize, buffer);
 }
 
 bool ZipArchive::readEndOfCentralDirectory() {
     constexpr auto signature = EndOfCentralDirectoryBlock::constants::signature;
-    constexpr auto minShift = (EndOfCentralDirectoryBlock::size - sizeof(signature));
-    auto& stream = *this->stream;
-    stream.seekg(-minShift, std::ios::end);
-    if (seekToSignature(EndOfCentralDirectoryBlock::constants::signature, SeekDirection::Backward)) {
-        endOfCentralDirectoryBlock.deserialize(stream);
+    std::string buffer;
+    u64 tailOffset = 0;
+    const auto tail = readTail(buffer, tailOffset);
+    if (tail.size() < EndOfCentralDirectoryBlock::size) {
+        return false;
+    }
+    // the block can't start any later than this
+    const auto searchable = tail.substr(0, tail.size() - EndOfCentralDirectoryBlock::size + sizeof(signature));
+    const auto i = findLastSignature(searchable, signature);
+    if (i == std::string_view::npos || !endOfCentralDirectoryBlock.deserialize(tail.substr(i))) {
+        return false;
+    }
+    endOfCentralDirectoryOffset = tailOffset + i;
+    return readZip64EndOfCentralDirectory(tail, tailOffset, i);
+}
+
+bool ZipArchive::readZip64EndOfCentralDirectory(std::string_view tail, u64 tailOffset,
+                                                size_t endOfCentralDirectoryIndex) {
+    using Locator = detail::Zip64EndOfCentralDirectoryLocator;
+    using Record = detail::Zip64EndOfCentralDirectoryRecord;
+    
+    // the locator immediately precedes the end of central directory block,
+    // so it's almost always already in the tail
+    if (endOfCentralDirectoryOffset < Locator::size) {
         return true;
     }
-    return false;
+    std::string locatorBuffer;
+    const auto locatorBytes = endOfCentralDirectoryIndex >= Locator::size
+                              ? tail.substr(endOfCentralDirectoryIndex - Locator::size)
+                              : read(tailOffset + endOfCentralDirectoryIndex - Locator::size, Locator::size,
+                                     locatorBuffer);
+    Locator locator;
+    if (!locator.deserialize(locatorBytes)) {
+        // not Zip64
+        return true;
+    }
+    
+    std::string recordBuffer;
+    Record record;
+    if (!record.deserialize(read(locator.offsetOfZip64EndOfCentralDirectory, Record::size, recordBuffer))) {
+        return false;
+    }
+    endOfCentralDirectoryBlock.readZip64(record);
+    return true;
 }
 
 bool ZipArchive::ensureCentralDirectoryRead() {
-    auto& stream = *this->stream;
-    stream.seekg(endOfCentralDirectoryBlock.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber,
-                 std::ios::beg);
+    const auto& block = endOfCentralDirectoryBlock;
+    const auto offset = block.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber;
+    if (offset > endOfCentralDirectoryOffset) {
+        return false;
+    }
+    // the central directory can't overlap the end of central directory block
+    const auto size = static_cast<size_t>(std::min(block.centralDirectorySize, endOfCentralDirectoryOffset - offset));
+    
+    // read the whole central directory at once,
+    // entries' names, comments and extra fields then borrow from it
+    auto buffer = read(offset, size, centralDirectoryBuffer);
+    
+    // don't trust the entry count enough to allocate for it unchecked
+    const auto numEntries = std::min<u64>(block.numberEntriesInCentralDirectory,
+                                          buffer.size() / ZipCentralDirectoryFileHeader::size);
+    endOfEntries = offset;
+    
     auto& entries = this->entries();
+    entries.reserve(numEntries);
+    nameIndex.reserve(numEntries);
+    static_assert(alignof(ZipArchiveEntry) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    entryArena = std::make_unique_for_overwrite<std::byte[]>(numEntries * sizeof(ZipArchiveEntry));
+    auto* const arena = reinterpret_cast<ZipArchiveEntry*>(entryArena.get());
     for (;;) {
         ZipCentralDirectoryFileHeader central;
-        if (!central.deserialize(stream)) {
+        if (!central.deserialize(buffer)) {
             break;
         }
-        entries.push_back(std::make_unique<ZipArchiveEntry>(ZipArchiveEntry::ConstructorKey(),
-                                                            *this, entries.size(), central));
+        const auto i = entries.size();
+        const auto key = ZipArchiveEntry::ConstructorKey();
+        // the entry count is only a hint, so any extra entries get their own allocation
+        entries.push_back(i < numEntries
+                          ? EntryPtr(new(arena + i) ZipArchiveEntry(key, *this, i, central), EntryDeleter {true})
+                          : EntryPtr(new ZipArchiveEntry(key, *this, i, central)));
+        indexEntry(*entries.back());
     }
     return true;
 }
@@ -277,21 +472,217 @@ bool ZipArchive::init() {
 }
 
 
-ZipArchive::ZipArchive(std::unique_ptr<std::istream>&& stream) : stream(std::move(stream)) {
+ZipArchive::ZipArchive(std::unique_ptr<std::istream>&& stream, OpenMode openMode)
+        : stream(std::move(stream)), openMode(openMode) {
+    init();
+}
+
+ZipArchive::ZipArchive(const fs::path& path, Backend backend, OpenMode openMode) : path(path), openMode(openMode) {
+    switch (backend) {
+        case Backend::Stream:
+            stream = std::make_unique<std::ifstream>(path, std::ios::binary);
+            break;
+        case Backend::MemoryMapped:
+            mapping = std::make_unique<MappedFile>(path);
+            break;
+        case Backend::PositionalRead:
+            file = std::make_unique<RandomAccessFile>(path);
+            break;
+    }
     init();
 }
 
-ZipArchive::ZipArchive(const fs::path& path) : ZipArchive(std::make_unique<std::ifstream>(path)) {}
 
+bool ZipArchive::isMetadataOnly() const noexcept {
+    return openMode == OpenMode::MetadataOnly;
+}
+
+void ZipArchive::resolveDataOffsets() {
+    std::vector<ZipArchiveEntry*> unresolved;
+    for (auto& entry : *this) {
+        if (entry.originallyInArchive && !entry.hasLocalFileHeader) {
+            unresolved.push_back(&entry);
+        }
+    }
+    std::sort(unresolved.begin(), unresolved.end(), [](const auto* a, const auto* b) {
+        return a->offsetOfLocalHeader() < b->offsetOfLocalHeader();
+    });
+    
+    // how far ahead to read through the data of small entries to get to the next headers in the same read
+    constexpr u64 maxReadAhead = 1 << 20;
+    const auto guessedEnd = [](const ZipArchiveEntry& entry) {
+        return entry.offsetOfLocalHeader() + entry.guessLocalFileHeaderSize();
+    };
+    
+    std::string buffer;
+    std::string_view window;
+    u64 windowOffset = 0;
+    for (size_t i = 0; i < unresolved.size(); i++) {
+        auto& entry = *unresolved[i];
+        const auto offset = entry.offsetOfLocalHeader();
+        std::string_view header;
+        if (offset >= windowOffset && offset - windowOffset < window.size()) {
+            header = window.substr(static_cast<size_t>(offset - windowOffset));
+        }
+        
+        if (header.size() < detail::ZipLocalFileHeader::sizeWithVariableFields(header)) {
+            auto end = guessedEnd(entry);
+            for (size_t j = i + 1; j < unresolved.size() && guessedEnd(*unresolved[j]) - offset <= maxReadAhead; j++) {
+                end = std::max(end, guessedEnd(*unresolved[j]));
+            }
+            window = read(offset, static_cast<size_t>(end - offset), buffer);
+            windowOffset = offset;
+            header = window;
+            
+            // the local name or extra fields are longer than the central ones
+            const auto size = detail::ZipLocalFileHeader::sizeWithVariableFields(header);
+            if (header.size() < size) {
+                window = read(offset, size, buffer);
+                header = window;
+            }
+        }
+        
+        entry.parseLocalFileHeader(header.substr(0, detail::ZipLocalFileHeader::sizeWithVariableFields(header)));
+    }
+}
+
+bool ZipArchive::isMemoryMapped() const noexcept {
+    return mapping != nullptr;
+}
+
+std::span<const std::byte> ZipArchive::mappedBytes() const noexcept {
+    return mapping ? mapping->bytes() : std::span<const std::byte>();
+}
+
+std::shared_ptr<std::istream> ZipArchive::substream(size_t offset, size_t length) {
+    if (mapping) {
+        const auto bytes = mapping->chars();
+        offset = std::min(offset, bytes.size());
+        length = std::min(length, bytes.size() - offset);
+        // imemstream never writes through its buffer, so the const_cast is safe
+        return std::make_shared<imemstream>(const_cast<char*>(bytes.data() + offset), length);
+    }
+    if (file) {
+        return std::make_shared<ipreadstream>(*file, offset, length);
+    }
+    return std::make_shared<isubstream>(*stream, offset, length, streamMutex);
+}
+
+
+void ZipArchive::copyRawTo(std::ostream& out, u64 offset, u64 length) {
+    const auto fd = mapping ? mapping->fd() : file ? file->fd() : -1;
+    if (auto* const fdOut = dynamic_cast<fd_streambuf*>(out.rdbuf()); fdOut && fd != -1) {
+        const auto copied = fdOut->copy_from(fd, offset, length);
+        offset += copied;
+        length -= copied;
+    }
+    if (length == 0) {
+        return;
+    }
+    if (mapping) {
+        std::string unused;
+        const auto bytes = read(offset, static_cast<size_t>(length), unused);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return;
+    }
+    utils::stream::copy(*substream(static_cast<size_t>(offset), static_cast<size_t>(length)), out);
+}
 
-void ZipArchive::writeTo(std::ostream& stream) {
+void ZipArchive::deduplicateEntries(size_t numThreads) {
+    for (auto& entry : *this) {
+        if (entry._streams) {
+            entry._streams->original = nullptr;
+        }
+    }
+    if (!deduplicating) {
+        return;
+    }
+    
+    std::vector<ZipArchiveEntry*> entriesToHash;
+    for (auto& entry : *this) {
+        if (entry.needsCompression() && !entry._streams->contentHash) {
+            entriesToHash.push_back(&entry);
+        }
+    }
+    utils::thread::parallelFor(entriesToHash.size(), numThreads, [&](size_t i) {
+        entriesToHash[i]->figureContentHash();
+    });
+    
+    // only among the data written now, either compressed now or in immediate mode
+    std::map<ZipArchiveEntry::ContentHash, const ZipArchiveEntry*> originals;
+    for (auto& entry : *this) {
+        const auto& streams = entry._streams;
+        if (!streams || !streams->contentHash || entry.isDirectory() || entry.isPasswordProtected()
+            || !(entry.needsCompression() || streams->immediateBuffer)) {
+            continue;
+        }
+        const auto [it, inserted] = originals.emplace(*streams->contentHash, &entry);
+        if (!inserted) {
+            streams->original = it->second;
+        }
+    }
+}
+
+void ZipArchive::precompressEntries(size_t numThreads, size_t alignment) {
+    // entries sharing a compression method instance share its encoder,
+    // so each group of them is compressed one after another on one thread
+    std::vector<std::vector<ZipArchiveEntry*>> groups;
+    std::unordered_map<const ICompressionMethod*, size_t> groupIndices;
+    for (auto& entry : *this) {
+        // where an entry's data goes depends on where it's written if it's aligned
+        if (!entry.needsCompression() || entry.needsAlignment(alignment) || entry.isDuplicate()) {
+            continue;
+        }
+        const auto [it, inserted] = groupIndices.emplace(entry._streams->compressionMethod.get(), groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(&entry);
+    }
+    if (groups.size() < 2 || numThreads == 1) {
+        // nothing to do in parallel, so compress while writing as usual
+        return;
+    }
+    
+    try {
+        utils::thread::parallelFor(groups.size(), numThreads, [&](size_t i) {
+            for (auto* entry : groups[i]) {
+                entry->precompress();
+            }
+        });
+    } catch (...) {
+        for (auto& entry : *this) {
+            if (entry._streams) {
+                entry._streams->precompressed = nullptr;
+            }
+        }
+        throw;
+    }
+}
+
+void ZipArchive::writeTo(std::ostream& stream, size_t numThreads, size_t alignment) {
+    // the alignment and its padding have to fit in an extra field
+    constexpr size_t maxAlignment = 32 * 1024;
+    if (alignment > maxAlignment || (alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("cannot write ZipArchive aligned to " + std::to_string(alignment)
+                                 + " bytes: alignment must be a power of 2 up to 32 KiB");
+    }
+    
+    resolveDataOffsets();
+    deduplicateEntries(numThreads);
+    precompressEntries(numThreads, alignment);
+    
     const auto startPosition = stream.tellp();
     
     // TODO make serialization const
     for (auto& entry : *this) {
-        entry.serializeLocalFileHeader(stream);
+        entry.serializeLocalFileHeader(stream, alignment);
     }
     
+    writeCentralDirectory(stream, startPosition);
+}
+
+void ZipArchive::writeCentralDirectory(std::ostream& stream, std::ios::pos_type startPosition) {
     const auto offsetOfStartOfCDFH = stream.tellp() - startPosition;
     for (auto& entry : *this) {
         entry.serializeCentralDirectoryFileHeader(stream);
@@ -302,17 +693,157 @@ void ZipArchive::writeTo(std::ostream& stream) {
     block.diskNumber = 0;
     block.startOfCentralDirectoryDiskNum = 0;
     
-    const auto numEntries = static_cast<u16>(entries().size());;
+    const auto numEntries = entries().size();
     block.numberEntriesInCentralDirectory = numEntries;
     block.numberEntriesInDiskCentralDirectory = numEntries;
     
-    block.centralDirectorySize = static_cast<u32>(stream.tellp() - offsetOfStartOfCDFH);
-    block.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber = static_cast<u32>(offsetOfStartOfCDFH);
+    block.centralDirectorySize = static_cast<u64>(stream.tellp() - startPosition - offsetOfStartOfCDFH);
+    block.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber = static_cast<u64>(offsetOfStartOfCDFH);
+    
+    if (block.needsZip64()) {
+        detail::Zip64EndOfCentralDirectoryLocator locator;
+        locator.offsetOfZip64EndOfCentralDirectory = static_cast<u64>(stream.tellp() - startPosition);
+        
+        detail::Zip64EndOfCentralDirectoryRecord record(block);
+        record.versionMadeBy = ZipArchiveEntry::VERSION_MADE_BY_DEFAULT;
+        record.versionNeededToExtract = ZipArchiveEntry::VERSION_NEEDED_ZIP64;
+        record.serialize(stream);
+        locator.serialize(stream);
+    }
     
     block.serialize(stream);
 }
 
 
+void ZipArchive::writeTo(const fs::path& path, size_t numThreads, size_t alignment) {
+    ofdstream out(path.c_str());
+    if (!out.is_open()) {
+        throw std::runtime_error("cannot open output file " + path.string());
+    }
+    writeTo(out, numThreads, alignment);
+    out.close();
+    if (!out) {
+        throw std::runtime_error("cannot write output file " + path.string());
+    }
+}
+
+std::runtime_error ZipArchive::pathRequiredError(std::string_view action) const {
+    std::string message;
+    message += "cannot ";
+    message += action;
+    message += " ZipArchive that wasn't opened from a path";
+    return std::runtime_error(message);
+}
+
+void ZipArchive::ownBorrowedData() {
+    for (auto& entry : *this) {
+        entry.fileHeader.central.ownBorrowedData();
+    }
+    centralDirectoryBuffer = std::string();
+    
+    // the keys viewed the borrowed names
+    nameIndex.clear();
+    numDuplicateNames = 0;
+    for (auto& entry : *this) {
+        entry.isNameIndexed = false;
+    }
+    for (auto& entry : *this) {
+        indexEntry(entry);
+    }
+}
+
+void ZipArchive::reopen() {
+    for (auto& entry : *this) {
+        entry.setWrittenInArchive();
+    }
+    endOfEntries = endOfCentralDirectoryBlock.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber;
+    
+    // the file has changed size, if not been replaced
+    if (mapping) {
+        mapping = std::make_unique<MappedFile>(path);
+    } else if (file) {
+        file = std::make_unique<RandomAccessFile>(path);
+    } else {
+        stream = std::make_unique<std::ifstream>(path, std::ios::binary);
+    }
+}
+
+void ZipArchive::update(size_t numThreads) {
+    if (path.empty()) {
+        throw pathRequiredError("update");
+    }
+    
+    // the old central directory is about to be overwritten
+    ownBorrowedData();
+    resolveDataOffsets();
+    
+    const auto end = endOfEntries;
+    std::vector<bool> staysInPlace;
+    staysInPlace.reserve(size());
+    for (auto& entry : *this) {
+        staysInPlace.push_back(entry.canStayInPlace(end));
+    }
+    
+    deduplicateEntries(numThreads);
+    precompressEntries(numThreads);
+    
+    const auto fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::runtime_error("cannot open " + path.string() + ": " + strerror(errno));
+    }
+    ofdstream out(fd, true);
+    out.seekp(static_cast<std::streamoff>(end));
+    
+    for (auto& entry : *this) {
+        if (staysInPlace[entry.index]) {
+            entry.keepInPlace();
+        } else {
+            entry.serializeLocalFileHeader(out);
+        }
+    }
+    writeCentralDirectory(out, 0);
+    
+    // the new central directory can be shorter than the old one
+    out.flush();
+    const auto newSize = out.tellp();
+    if (!out || ftruncate(fd, static_cast<off_t>(newSize)) == -1) {
+        throw std::runtime_error("cannot write " + path.string() + ": " + strerror(errno));
+    }
+    out.close();
+    if (!out) {
+        throw std::runtime_error("cannot write " + path.string());
+    }
+    
+    reopen();
+}
+
+void ZipArchive::compact(size_t numThreads) {
+    if (path.empty()) {
+        throw pathRequiredError("compact");
+    }
+    
+    // the old file is replaced
+    ownBorrowedData();
+    
+    const auto tempPath = fs::path(path.string() + ".tmp");
+    writeTo(tempPath, numThreads);
+    fs::rename(tempPath, path);
+    
+    reopen();
+}
+
+void ZipArchive::streamTo(std::ostream& out, size_t numThreads) {
+    for (auto& entry : *this) {
+        if (entry.needsCompression()) {
+            entry.useDataDescriptor();
+        }
+    }
+    ocountingstream countingStream(out);
+    writeTo(countingStream, numThreads);
+    countingStream.flush();
+}
+
+
 std::ostream& operator<<(ZipArchive& archive, std::ostream& out) {
     archive.writeTo(out);
     return out;
@@ -9,16 +9,27 @@
 #include <algorithm>
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <variant>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 #include <cassert>
 
 #include "src/main/util/MappedIterator.h"
 #include "src/main/util/numbers.h"
 #include "src/lib/fs/fs.h"
+#include "src/lib/zip/utils/MappedFile.h"
+#include "src/lib/zip/utils/RandomAccessFile.h"
 
 /**
  * \brief Represents a package of compressed files in the zip archive format.
+ *
+ *        Different entries can be decompressed from different threads at once,
+ *        as long as the archive itself isn't modified meanwhile.
+ *        Only archives opened from a path read in parallel though;
+ *        reads of an archive's std::istream are serialized.
  */
 class ZipArchive {
     
@@ -26,23 +37,82 @@ class ZipArchive {
 
 public:
     
-    using Entries = std::vector<std::unique_ptr<ZipArchiveEntry>>;
+    /**
+     * \brief Deletes an entry, or only destroys it if it lives in the archive's entry arena.
+     */
+    struct EntryDeleter {
+        
+        bool inArena = false;
+        
+        void operator()(ZipArchiveEntry* entry) const noexcept;
+        
+    };
+    
+    using EntryPtr = std::unique_ptr<ZipArchiveEntry, EntryDeleter>;
+    
+    using Entries = std::vector<EntryPtr>;
+    
+    /**
+     * \brief How the bytes of an archive opened from a path are read.
+     */
+    enum class Backend {
+        Stream,         //< read through a std::ifstream
+        MemoryMapped,   //< mmap the whole file and read headers and entries straight out of the mapping
+        PositionalRead, //< pread() the file, so there's no shared file position
+    };
+    
+    /**
+     * \brief When the entries' local file headers are read, which is where their data starts.
+     */
+    enum class OpenMode {
+        Default,      //< each one when its entry's data is first used, so using the entries out of order seeks around
+        MetadataOnly, //< never one by one, only all at once in order by resolveDataOffsets(),
+                      //< and using an entry's data before then throws a std::runtime_error
+    };
 
 private:
     
+    // one contiguous allocation for all the entries read from the central directory,
+    // instead of one per entry; entries added later are allocated on their own.
+    // declared before _entries so it outlives the entries in it
+    std::unique_ptr<std::byte[]> entryArena;
     Entries _entries;
     detail::EndOfCentralDirectoryBlock endOfCentralDirectoryBlock;
-    std::unique_ptr<std::istream> stream;
+    u64 endOfCentralDirectoryOffset = 0;
+    std::unique_ptr<MappedFile> mapping; // only for Backend::MemoryMapped
+    std::unique_ptr<RandomAccessFile> file; // only for Backend::PositionalRead
+    std::unique_ptr<std::istream> stream; // only when neither mapped nor positionally read
+    
+    fs::path path; // empty if not opened from a path
+    
+    OpenMode openMode = OpenMode::Default;
+    
+    // where the entries' local file headers and data end in the file, i.e. where the central directory starts,
+    // which is where an in-place update writes from
+    u64 endOfEntries = 0;
+    
+    // guards the position of stream
+    mutable std::mutex streamMutex;
+    
+    // the raw central directory when not memory mapped, which entries' headers borrow from
+    std::string centralDirectoryBuffer;
+    
+    // fullName() -> index of the first entry with that name,
+    // keys view the indexed entry's own name
+    std::unordered_map<std::string_view, size_t> nameIndex;
+    size_t numDuplicateNames = 0;
+    
+    bool deduplicating = false; // see setDeduplicating()
 
 private:
     
     struct Iterators {
         
-        static const ZipArchiveEntry& mapConst(const std::unique_ptr<ZipArchiveEntry>& entry) noexcept {
+        static const ZipArchiveEntry& mapConst(const EntryPtr& entry) noexcept {
             return *entry;
         }
     
-        static ZipArchiveEntry& map(std::unique_ptr<ZipArchiveEntry>& entry) noexcept {
+        static ZipArchiveEntry& map(EntryPtr& entry) noexcept {
             return *entry;
         }
         
@@ -61,6 +131,22 @@ public:
     std::string_view comment() const noexcept;
     
     void setComment(std::string_view comment) noexcept;
+    
+    bool isDeduplicating() const noexcept;
+    
+    /**
+     * \brief Sets if entries with the same data are only written once,
+     *        i.e. assets named by their content that are added under several names.
+     *        The data of new entries is hashed when the archive is written (or when they're compressed in immediate mode,
+     *        if this was set before), and the central directory record of each entry with the same data and size
+     *        as an earlier one points at the earlier one's local file header, so it isn't compressed nor written again.
+     *        Encrypted entries, entries with unseekable input streams and entries already in the archive aren't.
+     *
+     *        ZipFile::Test() and update() accept such entries, and update() keeps them sharing the original's data,
+     *        but some readers reject them, like zip bomb checks do (i.e. Info-ZIP's unzip reports overlapped components),
+     *        or because their local file header names differ.
+     */
+    void setDeduplicating(bool deduplicating) noexcept;
 
 private:
     
@@ -99,6 +185,24 @@ private:
     size_t findEntry(std::string_view name) const noexcept;
     
     void removeEntry(size_t index);
+    
+    /**
+     * \brief Query if entry is currently one of this archive's entries.
+     *        Entries being constructed or replaced aren't yet (or anymore).
+     */
+    bool containsEntry(const ZipArchiveEntry& entry) const noexcept;
+    
+    /**
+     * \brief Adds entry to the name index.
+     *        Must be called after an entry is added or renamed.
+     */
+    void indexEntry(ZipArchiveEntry& entry);
+    
+    /**
+     * \brief Removes entry from the name index.
+     *        Must be called before an entry is removed or renamed.
+     */
+    void unIndexEntry(ZipArchiveEntry& entry);
 
 public:
     
@@ -196,18 +300,93 @@ public:
 
 private:
     
-    enum class SeekDirection : i32 {
-        Forward = 1,
-        Backward = -1,
-    };
-    
-    bool seekToSignature(u32 signature, SeekDirection direction);
+    /**
+     * \brief Reads [offset, offset + length) of the archive in one read, or views it if the archive is memory mapped.
+     *        The result is shorter if the archive ends first.
+     *        Safe to call from several threads at once.
+     *
+     * \param buffer  Storage for the bytes if the archive isn't memory mapped.
+     */
+    std::string_view read(u64 offset, size_t length, std::string& buffer);
+    
+    /**
+     * \brief Reads the tail of the archive that could contain the end of central directory block,
+     *        i.e. the block itself followed by a comment of at most 64 KiB, in one read.
+     *
+     * \param buffer      Storage for the tail if the archive isn't memory mapped.
+     * \param [out] offset The offset of the tail in the archive.
+     * \return  The tail of the archive.
+     */
+    std::string_view readTail(std::string& buffer, u64& offset);
+    
+    bool readZip64EndOfCentralDirectory(std::string_view tail, u64 tailOffset, size_t endOfCentralDirectoryIndex);
     
     bool readEndOfCentralDirectory();
     
     bool ensureCentralDirectoryRead();
     
     bool init();
+    
+    /**
+     * \brief Gets the archive's bytes in [offset, offset + length) as a stream.
+     *        If the archive is memory mapped, this reads straight from the mapping,
+     *        if it's positionally read, this preads the file,
+     *        otherwise it's a substream of the archive's stream that locks it for each read.
+     *        Either way, substreams can be read from different threads at once.
+     */
+    std::shared_ptr<std::istream> substream(size_t offset, size_t length);
+    
+    /**
+     * \brief Copies [offset, offset + length) of the archive to out unchanged.
+     *        If out writes to a file descriptor (ofdstream) and the archive is a file,
+     *        the bytes are copied inside the kernel, otherwise through a reused buffer
+     *        (or straight from the mapping if the archive is memory mapped).
+     */
+    void copyRawTo(std::ostream& out, u64 offset, u64 length);
+    
+    /**
+     * \brief Writes the central directory and end of central directory block(s) after the local file headers.
+     *
+     * \param startPosition  Where the archive starts in stream.
+     */
+    void writeCentralDirectory(std::ostream& stream, std::ios::pos_type startPosition);
+    
+    /**
+     * \brief Makes every entry's header own what it borrows from the read central directory
+     *        (or the mapping), so that it can be overwritten or unmapped.
+     */
+    void ownBorrowedData();
+    
+    /**
+     * \brief After the archive's own file has been rewritten, reads the entries from where they were written.
+     */
+    void reopen();
+    
+    std::runtime_error pathRequiredError(std::string_view action) const;
+    
+    /**
+     * \brief Compresses the entries that still have to be on numThreads threads,
+     *        ahead of writing them out in order.
+     *        Entries to be aligned to alignment are left to be compressed when they're written.
+     */
+    void precompressEntries(size_t numThreads, size_t alignment = 0);
+    
+    /**
+     * \brief If deduplicating, hashes the entries that will be written on numThreads threads
+     *        and finds the ones with the same data as an earlier one.
+     */
+    void deduplicateEntries(size_t numThreads);
+
+public:
+    
+    bool isMemoryMapped() const noexcept;
+    
+    /**
+     * \brief Gets the bytes of the whole archive if it is memory mapped.
+     *
+     * \return  The mapped bytes, or an empty span if the archive isn't memory mapped.
+     */
+    std::span<const std::byte> mappedBytes() const noexcept;
 
 public:
     
@@ -219,11 +398,85 @@ public:
     
     ZipArchive& operator=(const ZipArchive& other) = delete;
     
-    explicit ZipArchive(std::unique_ptr<std::istream>&& stream);
-    
-    explicit ZipArchive(const fs::path& path);
-    
-    void writeTo(std::ostream& out);
+    explicit ZipArchive(std::unique_ptr<std::istream>&& stream, OpenMode openMode = OpenMode::Default);
+    
+    explicit ZipArchive(const fs::path& path, Backend backend = Backend::PositionalRead,
+                        OpenMode openMode = OpenMode::Default);
+    
+    bool isMetadataOnly() const noexcept;
+    
+    /**
+     * \brief Reads the local file headers of all the entries in the archive that haven't been read yet,
+     *        in one pass through the archive in the order they're in it,
+     *        reading the headers of nearby entries together, so there are no seeks back and forth.
+     *        Then the entries' data can be used, even if the archive was opened with OpenMode::MetadataOnly.
+     *        Writing the archive does this first.
+     */
+    void resolveDataOffsets();
+    
+    /**
+     * \brief Writes the archive to out.
+     *        Entries that still have to be compressed are compressed in parallel first,
+     *        but the output is byte for byte the same as writing them one after another.
+     *
+     * \param numThreads  (Optional) The number of threads to compress with, or 0 for the hardware concurrency.
+     *                    Entries sharing a compression method instance are compressed on the same thread.
+     *                    Their input streams must be distinct.
+     * \param alignment   (Optional) If not 0, the data of stored and unencrypted entries is aligned to it
+     *                    from the start of out, like zipalign does, by padding their local file headers,
+     *                    so it can be used straight from memory (see ZipArchiveEntry::alignedData()).
+     *                    It must be a power of 2 up to 32 KiB, like ZipArchiveEntry::DEFAULT_ALIGNMENT.
+     *                    Aligned entries aren't compressed in parallel ahead of time, since that's where they go.
+     * \throws std::runtime_error if alignment isn't a power of 2 up to 32 KiB.
+     */
+    void writeTo(std::ostream& out, size_t numThreads = 0, size_t alignment = 0);
+    
+    /**
+     * \brief Writes the archive to a file, which is created or truncated.
+     *        Entries that are unchanged are copied from this archive's file inside the kernel.
+     *        The file must not be this archive's own file.
+     *
+     * \param numThreads  (Optional) Like in writeTo(std::ostream&).
+     * \param alignment   (Optional) Like in writeTo(std::ostream&).
+     * \throws std::runtime_error if the file can't be opened or written.
+     */
+    void writeTo(const fs::path& path, size_t numThreads = 0, size_t alignment = 0);
+    
+    /**
+     * \brief Saves the changes to the archive's own file without rewriting all of it.
+     *        Entries whose local file header and data are unchanged stay where they are.
+     *        The rest are appended after the last local data, over the old central directory,
+     *        followed by a new central directory and end of central directory block.
+     *        Removed and replaced entries are left behind as dead space until compact().
+     *
+     *        Any open entry streams and spans into the archive are invalidated.
+     *        If writing fails partway, the archive's file is left corrupt.
+     *
+     * \param numThreads  (Optional) Like in writeTo(std::ostream&).
+     * \throws std::runtime_error if the archive wasn't opened from a path or the file can't be written.
+     */
+    void update(size_t numThreads = 0);
+    
+    /**
+     * \brief Rewrites the archive's own file without dead space,
+     *        by writing it to a temporary file next to it and renaming that over it.
+     *        Any open entry streams and spans into the archive are invalidated.
+     *
+     * \param numThreads  (Optional) Like in writeTo(std::ostream&).
+     * \throws std::runtime_error if the archive wasn't opened from a path or the file can't be written.
+     */
+    void compact(size_t numThreads = 0);
+    
+    /**
+     * \brief Writes the archive to an output that can't seek, like a pipe or a socket.
+     *        Entries that still have to be compressed are written with data descriptors
+     *        instead of patching their local file headers afterwards,
+     *        and offsets are counted instead of asked of out, so out is never seeked.
+     *
+     * \param numThreads  (Optional) Like in writeTo(). With 1, entries are compressed straight into out,
+     *                    so memory use doesn't depend on the size of the entries.
+     */
+    void streamTo(std::ostream& out, size_t numThreads = 0);
     
 };
 
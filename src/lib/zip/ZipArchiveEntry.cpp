@@ -9,18 +9,74 @@
 #include "streams/compression_encoder_stream.h"
 #include "streams/compression_decoder_stream.h"
 #include "streams/nullstream.h"
+#include "streams/seekable_inflate_stream.h"
+#include "streams/serialization.h"
 
+#include "utils/crc32_utils.h"
 #include "utils/stream_utils.h"
 #include "utils/time_utils.h"
 
 #include "src/main/util/strings.h"
 
 #include <sstream>
+#include <fstream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
 
 namespace {
     
     using namespace std::string_literals;
     
+    /**
+     * \brief Gets the number of bytes left in a seekable stream, without moving it.
+     *
+     * \return  The remaining size, or std::nullopt if the stream isn't seekable.
+     */
+    std::optional<u64> remainingSize(std::istream& stream) {
+        const auto position = stream.tellg();
+        if (position == std::ios::pos_type(-1)) {
+            return std::nullopt;
+        }
+        stream.seekg(0, std::ios::end);
+        const auto end = stream.tellg();
+        stream.clear();
+        stream.seekg(position);
+        if (end == std::ios::pos_type(-1)) {
+            return std::nullopt;
+        }
+        return static_cast<u64>(end - position);
+    }
+    
+    /**
+     * \brief Makes a buffer to serialize an entry into ahead of time.
+     *        It's in memory if the input is small enough,
+     *        otherwise it's a temporary file, which is already unlinked.
+     */
+    std::unique_ptr<std::iostream> makeSpillBuffer(std::optional<u64> inputSize) {
+        constexpr u64 maxInMemorySize = 64 << 20;
+        constexpr auto mode = std::ios::in | std::ios::out | std::ios::binary;
+        if (inputSize && *inputSize <= maxInMemorySize) {
+            return std::make_unique<std::stringstream>(mode);
+        }
+        
+        auto path = (fs::temp_directory_path() / "ZipArchiveEntry-XXXXXX").string();
+        const auto fd = mkstemp(path.data());
+        if (fd == -1) {
+            throw std::runtime_error("cannot create temporary file "s + path + ": " + strerror(errno));
+        }
+        auto file = std::make_unique<std::fstream>(path, mode | std::ios::trunc);
+        close(fd);
+        // the open stream keeps it alive until it's closed
+        unlink(path.c_str());
+        if (!file->is_open()) {
+            throw std::runtime_error("cannot open temporary file "s + path);
+        }
+        return file;
+    }
+    
     bool isValidFileName(std::string_view fullPath) {
         // this function ensures, that the filename will have non-zero
         // length, when the filename will be normalized
@@ -53,6 +109,42 @@ namespace {
         return fullPath.length() > 0 && fullPath.back() == '/';
     }
     
+    /**
+     * \brief Unifies slashes to '/', and removes leading and repeated ones.
+     */
+    std::string normalizeFileName(std::string_view fullName) {
+        std::string fileName(fullName);
+        
+        // unify slashes
+        std::replace(fileName.begin(), fileName.end(), '\\', '/');
+        
+        // if slash is first char, remove it
+        if (!fileName.empty() && fileName[0] == '/') {
+            fileName.erase(0, fileName.find_first_not_of('/'));
+        }
+        
+        // find multiply slashes
+        std::string correctFileName;
+        correctFileName.reserve(fileName.size());
+        bool prevWasSlash = false;
+        for (auto c : fileName) {
+            if (c == '/' && prevWasSlash) {
+                continue;
+            }
+            prevWasSlash = (c == '/');
+            correctFileName += c;
+        }
+        return correctFileName;
+    }
+    
+    void checkDecompressedCrc32(const ZipArchiveEntry& entry, u32 crc32) {
+        if (crc32 != entry.crc32()) {
+            char message[64];
+            std::snprintf(message, sizeof(message), "crc32 mismatch: expected %08x, got %08x", entry.crc32(), crc32);
+            throw std::runtime_error("cannot decompress "s + entry.fullName() + ": " + message);
+        }
+    }
+    
 }
 
 ZipArchiveEntry::~ZipArchiveEntry() {
@@ -68,38 +160,22 @@ std::string_view ZipArchiveEntry::fullName() const noexcept {
 }
 
 void ZipArchiveEntry::setFullName(std::string_view fullName) {
-    std::string fileName(fullName);
-    
-    // unify slashes
-    std::replace(fileName.begin(), fileName.end(), '\\', '/');
-    
-    bool isDirectory = isDirectoryPath(fileName);
+    auto correctFileName = normalizeFileName(fullName);
+    const bool isDirectory = isDirectoryPath(correctFileName);
     
-    // if slash is first char, remove it
-    if (fileName[0] == '/') {
-        fileName.erase(0, fileName.find_first_not_of('/'));
+    archive.unIndexEntry(*this);
+    // don't copy names borrowed from the central directory if they're already correct
+    if (correctFileName != this->fullName()) {
+        correctFileName.shrink_to_fit();
+        fileHeader.central.fileName = std::move(correctFileName);
     }
     
-    // find multiply slashes
-    std::string correctFileName;
-    correctFileName.reserve(fileName.size());
-    bool prevWasSlash = false;
-    for (auto c : fileName) {
-        if (c == '/' && prevWasSlash) {
-            continue;
-        }
-        prevWasSlash = (c == '/');
-        correctFileName += c;
-    }
-    correctFileName.shrink_to_fit();
-    fileHeader.central.fileName = correctFileName;
-    _name = getFileNameFromPath(correctFileName);
-    
     setAttributes(isDirectory ? Attributes::Directory : Attributes::Archive);
+    archive.indexEntry(*this);
 }
 
 std::string_view ZipArchiveEntry::name() const noexcept {
-    return _name;
+    return getFileNameFromPath(fullName());
 }
 
 void ZipArchiveEntry::setName(std::string_view name) {
@@ -154,19 +230,22 @@ void ZipArchiveEntry::setAttributes(Attributes value) {
     auto& central = fileHeader.central;
     auto& fileName = central.fileName;
     
+    // the name might change
+    archive.unIndexEntry(*this);
+    
     if (!!(prevVal & Attributes::Directory) && !!(newVal & Attributes::Archive)) {
         // if we're changing from directory to file
         newVal &= ~Attributes::Directory;
         
         if (isDirectoryPath(fileName)) {
-            fileName.pop_back();
+            fileName.mut().pop_back();
         }
     } else if (!!(prevVal & Attributes::Archive) && !!(newVal & Attributes::Directory)) {
         // if we're changing from file to directory
         newVal &= ~Attributes::Archive;
         
         if (!isDirectoryPath(fileName)) {
-            fileName += '/';
+            fileName.mut() += '/';
         }
     }
     
@@ -179,6 +258,7 @@ void ZipArchiveEntry::setAttributes(Attributes value) {
     }
     
     central.externalFileAttributes = static_cast<u32>(newVal);
+    archive.indexEntry(*this);
 }
 
 const u16& ZipArchiveEntry::compressionMethod() const noexcept {
@@ -194,15 +274,18 @@ bool ZipArchiveEntry::isPasswordProtected() const noexcept {
 }
 
 std::string_view ZipArchiveEntry::password() const noexcept {
-    return _password;
+    return _streams ? std::string_view(_streams->password) : std::string_view();
 }
 
 void ZipArchiveEntry::setPassword(std::string_view password) {
-    _password = password;
+    if (_streams || !password.empty()) {
+        streams().password = password;
+        releaseIdleStreams();
+    }
     
     // allow unset password only for empty files
     if (!originallyInArchive || (hasLocalFileHeader && size() == 0)) {
-        setGeneralPurposeBitFlag(BitFlag::Encrypted, !_password.empty());
+        setGeneralPurposeBitFlag(BitFlag::Encrypted, !password.empty());
     }
 }
 
@@ -236,46 +319,47 @@ void ZipArchiveEntry::useDataDescriptor(bool use) noexcept {
 }
 
 std::istream* ZipArchiveEntry::rawStream() {
-    if (_rawStream == nullptr) {
-        if (originallyInArchive) {
-            const auto offsetOfCompressedData = seekToCompressedData();
-            _rawStream = std::make_shared<isubstream>(
-                    *archive.stream, offsetOfCompressedData, compressedSize());
+    auto& streams = this->streams();
+    if (streams.rawStream == nullptr) {
+        if (originallyInArchive && !streams.immediateBuffer) {
+            streams.rawStream = archive.substream(offsetOfCompressedData(), compressedSize());
         } else {
-            _rawStream = std::make_shared<isubstream>(*immediateBuffer);
+            streams.rawStream = std::make_shared<isubstream>(*streams.immediateBuffer);
         }
     }
-    return _rawStream.get();
+    return streams.rawStream.get();
 }
 
-std::istream* ZipArchiveEntry::decompressionStream() {
+std::istream* ZipArchiveEntry::decompressionStream(bool verifyCrc32) {
     std::shared_ptr<std::istream> intermediateStream;
+    auto& streams = this->streams();
     
     // there shouldn't be opened another stream
-    if (canExtract() && archiveStream == nullptr && encryptionStream == nullptr) {
-        const auto offsetOfCompressedData = seekToCompressedData();
+    if (canExtract() && streams.archiveStream == nullptr && streams.encryptionStream == nullptr) {
+        const auto offsetOfCompressedData = this->offsetOfCompressedData();
         const bool needsPassword = !!(generalPurposeBitFlag() & BitFlag::Encrypted);
-        const bool needsDecompress = compressionMethod() != StoreMethod::CompressionMethod;
+        // stored data is only verified by going through the store decoder
+        const bool needsDecompress = compressionMethod() != StoreMethod::CompressionMethod || verifyCrc32;
         
-        if (needsPassword && _password.empty()) {
+        if (needsPassword && streams.password.empty()) {
             // we need password, but we does not have it
+            releaseIdleStreams();
             return nullptr;
         }
         
         // make correctly-ended substream of the input stream
-        intermediateStream = archiveStream = std::make_shared<isubstream>(
-                *archive.stream, offsetOfCompressedData, compressedSize());
+        intermediateStream = streams.archiveStream = archive.substream(offsetOfCompressedData, compressedSize());
         
         if (needsPassword) {
             const std::shared_ptr<zip_cryptostream> cryptoStream = std::make_shared<zip_cryptostream>(
                     *intermediateStream,
-                    _password.c_str());
+                    streams.password.c_str());
             cryptoStream->set_final_byte(lastByteOfEncryptionHeader());
             const bool hasCorrectPassword = cryptoStream->prepare_for_decryption();
             
             // set it here, because in case the hasCorrectPassword is false
             // the method CloseDecompressionStream() will properly delete the stream
-            intermediateStream = encryptionStream = cryptoStream;
+            intermediateStream = streams.encryptionStream = cryptoStream;
             
             if (!hasCorrectPassword) {
                 closeDecompressionStream();
@@ -283,12 +367,42 @@ std::istream* ZipArchiveEntry::decompressionStream() {
             }
         }
         
-        if (needsDecompress) {
-            ICompressionMethod::Ptr zipMethod = ZipMethodResolver::GetZipMethodInstance(compressionMethod());
+        if (needsDecompress && streams.deflateIndex && !needsPassword && !verifyCrc32
+            && compressionMethod() == DeflateMethod::CompressionMethod) {
+            // each seek opens a new substream at the access point it starts decompressing from
+            auto& archive = this->archive;
+            const auto compressedSize = this->compressedSize();
+            intermediateStream = streams.compressionStream = std::make_shared<seekable_inflate_stream>(
+                    [&archive, offsetOfCompressedData, compressedSize](u64 offset) {
+                        offset = std::min(offset, compressedSize);
+                        return archive.substream(static_cast<size_t>(offsetOfCompressedData) + offset,
+                                                 compressedSize - offset);
+                    },
+                    streams.deflateIndex, size());
+        } else if (needsDecompress) {
+            ICompressionMethod::Ptr zipMethod = ZipMethodResolver::GetPooledZipMethodInstance(compressionMethod());
             
             if (zipMethod != nullptr) {
-                intermediateStream = compressionStream = std::make_shared<compression_decoder_stream>(
-                        zipMethod->GetDecoder(), zipMethod->GetDecoderProperties(), *intermediateStream);
+                // the decoder keeps the pooled method alive, so it isn't reused until the stream is closed
+                const ICompressionMethod::decoder_t decoder(zipMethod, zipMethod->GetDecoder().get());
+                std::shared_ptr<compression_decoder_stream> decoderStream;
+                const auto rawData = needsPassword ? std::nullopt : this->rawData();
+                if (rawData) {
+                    // decode straight from the mapping if the decoder can
+                    decoderStream = std::make_shared<compression_decoder_stream>();
+                    if (!decoderStream->init(decoder, zipMethod->GetDecoderProperties(),
+                                             reinterpret_cast<const char*>(rawData->data()), rawData->size())) {
+                        decoderStream = nullptr;
+                    }
+                }
+                if (!decoderStream) {
+                    decoderStream = std::make_shared<compression_decoder_stream>(
+                            decoder, zipMethod->GetDecoderProperties(), *intermediateStream);
+                }
+                if (verifyCrc32) {
+                    decoderStream->verify(crc32(), size());
+                }
+                intermediateStream = streams.compressionStream = std::move(decoderStream);
             }
         }
     }
@@ -296,48 +410,283 @@ std::istream* ZipArchiveEntry::decompressionStream() {
     return intermediateStream.get();
 }
 
+std::optional<std::span<const std::byte>> ZipArchiveEntry::rawData() {
+    if (!archive.isMemoryMapped() || !originallyInArchive || isNewOrChanged || (_streams && _streams->immediateBuffer)) {
+        return std::nullopt;
+    }
+    const auto bytes = archive.mappedBytes();
+    const auto offset = static_cast<size_t>(offsetOfCompressedData());
+    if (offset > bytes.size() || compressedSize() > bytes.size() - offset) {
+        return std::nullopt;
+    }
+    return bytes.subspan(offset, compressedSize());
+}
+
+std::optional<std::span<const std::byte>> ZipArchiveEntry::data() {
+    if (compressionMethod() != StoreMethod::CompressionMethod || isPasswordProtected()) {
+        return std::nullopt;
+    }
+    return rawData();
+}
+
+std::optional<std::span<const std::byte>> ZipArchiveEntry::alignedData(size_t alignment) {
+    const auto bytes = data();
+    if (!bytes || alignment == 0 || reinterpret_cast<uintptr_t>(bytes->data()) % alignment != 0) {
+        return std::nullopt;
+    }
+    return bytes;
+}
+
+bool ZipArchiveEntry::decompressInto(std::span<std::byte> output, bool verifyCrc32) {
+    if (output.size() != size() || !canExtract()
+        || !originallyInArchive || isNewOrChanged || (_streams && _streams->immediateBuffer)) {
+        return false;
+    }
+    if (output.empty()) {
+        if (verifyCrc32) {
+            checkDecompressedCrc32(*this, 0);
+        }
+        return true;
+    }
+    
+    // when verifying, each chunk is checked right after it's decompressed, while it's still in cache
+    constexpr size_t verifyChunkSize = 1 << 18;
+    const size_t chunkSize = verifyCrc32 ? verifyChunkSize : output.size();
+    u32 decompressedCrc32 = 0;
+    
+    // stored data is just copied out of the mapping
+    if (const auto data = this->data()) {
+        if (data->size() != output.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < output.size(); i += chunkSize) {
+            const auto n = std::min(chunkSize, output.size() - i);
+            std::memcpy(output.data() + i, data->data() + i, n);
+            if (verifyCrc32) {
+                decompressedCrc32 = utils::crc32::update(decompressedCrc32, output.data() + i, n);
+            }
+        }
+        if (verifyCrc32) {
+            checkDecompressedCrc32(*this, decompressedCrc32);
+        }
+        return true;
+    }
+    
+    const bool needsPassword = isPasswordProtected();
+    if (needsPassword && password().empty()) {
+        return false;
+    }
+    
+    // a pooled instance isn't shared with any other entry or stream until it's released at the end of this
+    const auto zipMethod = ZipMethodResolver::GetPooledZipMethodInstance(compressionMethod());
+    if (zipMethod == nullptr) {
+        return false;
+    }
+    const auto decoder = zipMethod->GetDecoder();
+    auto& properties = zipMethod->GetDecoderProperties();
+    
+    std::shared_ptr<std::istream> archiveStream;
+    std::unique_ptr<zip_cryptostream> cryptoStream;
+    const auto rawData = needsPassword ? std::nullopt : this->rawData();
+    if (!rawData || !decoder->init(reinterpret_cast<const char*>(rawData->data()), rawData->size(), properties)) {
+        archiveStream = archive.substream(offsetOfCompressedData(), compressedSize());
+        std::istream* compressedStream = archiveStream.get();
+        if (needsPassword) {
+            cryptoStream = std::make_unique<zip_cryptostream>(*archiveStream, _streams->password.c_str());
+            cryptoStream->set_final_byte(lastByteOfEncryptionHeader());
+            if (!cryptoStream->prepare_for_decryption()) {
+                return false;
+            }
+            compressedStream = cryptoStream.get();
+        }
+        decoder->init(*compressedStream, properties);
+    }
+    
+    auto* const chars = reinterpret_cast<char*>(output.data());
+    size_t decompressedSize = 0;
+    while (decompressedSize < output.size()) {
+        const auto n = decoder->decode_into(chars + decompressedSize,
+                                            std::min(chunkSize, output.size() - decompressedSize));
+        if (n == 0) {
+            break;
+        }
+        if (verifyCrc32) {
+            decompressedCrc32 = utils::crc32::update(decompressedCrc32, chars + decompressedSize, n);
+        }
+        decompressedSize += n;
+    }
+    if (decompressedSize != output.size()) {
+        return false;
+    }
+    if (verifyCrc32) {
+        checkDecompressedCrc32(*this, decompressedCrc32);
+    }
+    return true;
+}
+
+std::optional<std::vector<std::byte>> ZipArchiveEntry::readAll(bool verifyCrc32) {
+    std::vector<std::byte> buffer(size());
+    if (!decompressInto(buffer, verifyCrc32)) {
+        return std::nullopt;
+    }
+    return buffer;
+}
+
+std::optional<std::string> ZipArchiveEntry::checkLocalFileHeader() {
+    if (!originallyInArchive || isNewOrChanged) {
+        return std::nullopt;
+    }
+    
+    std::string buffer;
+    auto header = readLocalFileHeader(buffer);
+    Local local;
+    if (!local.deserialize(header)) {
+        return "bad local file header";
+    }
+    
+    const auto& central = fileHeader.central;
+    if (normalizeFileName(local.fileName) != fullName() && !sharesLocalFileHeader()) {
+        return "local file name " + local.fileName + " doesn't match";
+    }
+    if (local.compressionMethod != central.compressionMethod) {
+        return "local compression method doesn't match";
+    }
+    const auto checkedFlags = BitFlag::Encrypted | BitFlag::DataDescriptor;
+    if ((static_cast<BitFlag>(local.generalPurposeBitFlag) & checkedFlags) != (generalPurposeBitFlag() & checkedFlags)) {
+        return "local general purpose bit flag doesn't match";
+    }
+    
+    u32 crc32 = local.crc32;
+    u64 compressedSize = local.compressedSize;
+    u64 size = local.unCompressedSize;
+    if (isUsingDataDescriptor()) {
+        // the crc and sizes are after the data instead, optionally after a signature
+        constexpr size_t maxDataDescriptorSize = 4 + 4 + 8 + 8;
+        const auto dataEnd = static_cast<u64>(offsetOfCompressedData()) + this->compressedSize();
+        auto descriptor = archive.read(dataEnd, maxDataDescriptorSize, buffer);
+        auto afterSignature = descriptor;
+        u32 signature = 0;
+        if (::deserialize(afterSignature, signature) && signature == Local::constants::dataDescriptorSignature) {
+            descriptor = afterSignature;
+        }
+        if (local.isZip64) {
+            if (!::deserialize(descriptor, crc32) || !::deserialize(descriptor, compressedSize)
+                || !::deserialize(descriptor, size)) {
+                return "bad data descriptor";
+            }
+        } else {
+            u32 compressedSize32 = 0;
+            u32 size32 = 0;
+            if (!::deserialize(descriptor, crc32) || !::deserialize(descriptor, compressedSize32)
+                || !::deserialize(descriptor, size32)) {
+                return "bad data descriptor";
+            }
+            compressedSize = compressedSize32;
+            size = size32;
+        }
+    }
+    if (crc32 != this->crc32()) {
+        return "local crc32 doesn't match";
+    }
+    if (compressedSize != this->compressedSize() || size != this->size()) {
+        return "local sizes don't match";
+    }
+    return std::nullopt;
+}
+
+bool ZipArchiveEntry::setDeflateIndex(std::shared_ptr<DeflateIndex> index) {
+    if (!index) {
+        if (_streams) {
+            _streams->deflateIndex = nullptr;
+            releaseIdleStreams();
+        }
+        return true;
+    }
+    if (compressionMethod() != DeflateMethod::CompressionMethod || isPasswordProtected()
+        || !originallyInArchive || isNewOrChanged || !index->bind(crc32(), compressedSize(), size())) {
+        return false;
+    }
+    streams().deflateIndex = std::move(index);
+    return true;
+}
+
+std::shared_ptr<DeflateIndex> ZipArchiveEntry::deflateIndex() const noexcept {
+    return _streams ? _streams->deflateIndex : nullptr;
+}
+
+std::shared_ptr<DeflateIndex> ZipArchiveEntry::buildDeflateIndex(u64 spacing) {
+    auto index = deflateIndex();
+    if (index && index->isComplete()) {
+        return index;
+    }
+    if (!index && !setDeflateIndex(index = std::make_shared<DeflateIndex>(spacing))) {
+        return nullptr;
+    }
+    
+    std::istream* dataStream = decompressionStream();
+    if (dataStream == nullptr) {
+        return nullptr;
+    }
+    nullstream devNull;
+    utils::stream::copy(*dataStream, devNull);
+    closeDecompressionStream();
+    return index->isComplete() ? index : nullptr;
+}
+
 bool ZipArchiveEntry::isRawStreamOpened() const noexcept {
-    return _rawStream != nullptr;
+    return _streams && _streams->rawStream != nullptr;
 }
 
 bool ZipArchiveEntry::isDecompressionStreamOpened() const noexcept {
-    return compressionStream != nullptr;
+    return _streams && _streams->compressionStream != nullptr;
 }
 
 void ZipArchiveEntry::closeRawStream() {
-    _rawStream.reset();
+    if (_streams) {
+        _streams->rawStream.reset();
+        releaseIdleStreams();
+    }
 }
 
 void ZipArchiveEntry::closeDecompressionStream() {
-    compressionStream.reset();
-    encryptionStream.reset();
-    archiveStream.reset();
-    immediateBuffer.reset();
+    if (_streams) {
+        _streams->compressionStream.reset();
+        _streams->encryptionStream.reset();
+        _streams->archiveStream.reset();
+        _streams->immediateBuffer.reset();
+        releaseIdleStreams();
+    }
 }
 
 bool ZipArchiveEntry::setCompressionStream(std::istream& stream,
-                                           ICompressionMethod::Ptr method /* = DeflateMethod::Create() */,
+                                           ICompressionMethod::Ptr method /* = AutoMethod::Create() */,
                                            CompressionMode mode /* = CompressionMode::Deferred */) {
-    // if _inputStream is set, we already have some stream to compress
+    // if inputStream is set, we already have some stream to compress
     // so we discard it
-    if (inputStream != nullptr) {
+    if (hasCompressionStream()) {
         unloadCompressionData();
     }
     
     isNewOrChanged = true;
     
-    inputStream = &stream;
+    if (const auto autoMethod = std::dynamic_pointer_cast<AutoMethod>(method)) {
+        method = autoMethod->Select(fullName(), stream);
+    }
+    
+    auto& streams = this->streams();
+    streams.inputStream = &stream;
+    streams.contentHash = std::nullopt;
     compressionMethod() = method->GetZipMethodDescriptor().GetCompressionMethod();
-    _compressionMethod = std::move(method);
-    _compressionMode = mode;
+    streams.compressionMethod = std::move(method);
+    streams.compressionMode = mode;
     
-    if (inputStream != nullptr && _compressionMode == CompressionMode::Immediate) {
-        immediateBuffer = std::make_shared<std::stringstream>();
-        internalCompressStream(*inputStream, *immediateBuffer);
+    if (streams.compressionMode == CompressionMode::Immediate) {
+        streams.immediateBuffer = std::make_shared<std::stringstream>();
+        internalCompressStream(*streams.inputStream, *streams.immediateBuffer);
         
         // we have everything we need, let's act like we were loaded from archive :)
         isNewOrChanged = false;
-        inputStream = nullptr;
+        streams.inputStream = nullptr;
     }
     
     return true;
@@ -352,15 +701,8 @@ void ZipArchiveEntry::unSetCompressionStream() {
 }
 
 void ZipArchiveEntry::remove() {
-    size_t i = 0;
-    for (const auto& entry : archive) {
-        if (&entry == this) {
-            archive.removeEntry(i);
-            return;
-        }
-        i++;
-    }
-    assert(false);
+    assert(archive.containsEntry(*this));
+    archive.removeEntry(index);
 }
 
 // private getters & setters
@@ -398,27 +740,73 @@ u16& ZipArchiveEntry::versionMadeBy() noexcept {
     return fileHeader.central.versionMadeBy;
 }
 
-const i32& ZipArchiveEntry::offsetOfLocalHeader() const noexcept {
+const u64& ZipArchiveEntry::offsetOfLocalHeader() const noexcept {
     return fileHeader.central.relativeOffsetOfLocalHeader;
 }
 
-i32& ZipArchiveEntry::offsetOfLocalHeader() noexcept {
+u64& ZipArchiveEntry::offsetOfLocalHeader() noexcept {
     return fileHeader.central.relativeOffsetOfLocalHeader;
 }
 
 bool ZipArchiveEntry::hasCompressionStream() const noexcept {
-    return inputStream != nullptr;
+    return _streams && _streams->inputStream != nullptr;
+}
+
+bool ZipArchiveEntry::StreamState::isIdle() const noexcept {
+    return !rawStream && !compressionStream && !encryptionStream && !archiveStream
+           && !immediateBuffer && !inputStream && !precompressed && password.empty() && !deflateIndex;
+}
+
+ZipArchiveEntry::StreamState& ZipArchiveEntry::streams() {
+    if (!_streams) {
+        _streams = std::make_unique<StreamState>();
+    }
+    return *_streams;
+}
+
+void ZipArchiveEntry::releaseIdleStreams() noexcept {
+    // the compression method is kept while the data is pending, and isn't needed after
+    if (_streams && _streams->isIdle()) {
+        _streams.reset();
+    }
+}
+
+ZipArchiveEntry::Local& ZipArchiveEntry::localFileHeader() {
+    if (!fileHeader.local) {
+        fileHeader.local = std::make_unique<Local>();
+    }
+    return *fileHeader.local;
 }
 
 //////////////////////////////////////////////////////////////////////////
 // private working methods
 
+std::string_view ZipArchiveEntry::readLocalFileHeader(std::string& buffer) {
+    using detail::ZipLocalFileHeader;
+    // only positional reads, so different entries can read their headers from different threads
+    const auto offsetOfLocalHeader = this->offsetOfLocalHeader();
+    auto header = archive.read(offsetOfLocalHeader, guessLocalFileHeaderSize(), buffer);
+    const auto size = ZipLocalFileHeader::sizeWithVariableFields(header);
+    if (header.size() < size) {
+        header = archive.read(offsetOfLocalHeader, size, buffer);
+    }
+    return header.substr(0, size);
+}
+
+size_t ZipArchiveEntry::guessLocalFileHeaderSize() const noexcept {
+    const auto& central = fileHeader.central;
+    return Local::size + central.fileName.size() + central.extraFieldLength;
+}
+
 void ZipArchiveEntry::fetchLocalFileHeader() {
-    auto& stream = *archive.stream;
     if (!hasLocalFileHeader && originallyInArchive) {
-        stream.seekg(offsetOfLocalHeader(), std::ios::beg);
-        fileHeader.local.deserialize(stream);
-        offset.compressedData = stream.tellg();
+        if (archive.isMetadataOnly()) {
+            throw std::runtime_error("cannot read local file header of "s + std::string(fullName())
+                                     + ": ZipArchive was opened metadata only, so resolveDataOffsets() first");
+        }
+        std::string buffer;
+        parseLocalFileHeader(readLocalFileHeader(buffer));
+        return;
     }
     
     // sync data
@@ -426,6 +814,16 @@ void ZipArchiveEntry::fetchLocalFileHeader() {
     hasLocalFileHeader = true;
 }
 
+void ZipArchiveEntry::parseLocalFileHeader(std::string_view header) {
+    const auto totalSize = header.size();
+    localFileHeader().deserialize(header);
+    offset.compressedData = static_cast<std::streamoff>(offsetOfLocalHeader() + (totalSize - header.size()));
+    
+    // sync data
+    syncLocalWithCentralDirectoryFileHeader();
+    hasLocalFileHeader = true;
+}
+
 void ZipArchiveEntry::checkFileNameCorrection() {
     // this forces recheck of the filename.
     // this is useful when the check is needed after
@@ -440,14 +838,14 @@ void ZipArchiveEntry::fixVersionToExtractAtLeast(u16 value) {
 }
 
 void ZipArchiveEntry::syncLocalWithCentralDirectoryFileHeader() {
-    fileHeader.local.syncWithCentralDirectoryFileHeader(fileHeader.central);
+    localFileHeader().syncWithCentralDirectoryFileHeader(fileHeader.central);
 }
 
 void ZipArchiveEntry::syncCentralDirectoryWithLocalFileHeader() {
-    fileHeader.central.syncWithLocalFileHeader(fileHeader.local);
+    fileHeader.central.syncWithLocalFileHeader(localFileHeader());
     fixVersionToExtractAtLeast(isDirectory()
                                ? VERSION_NEEDED_EXPLICIT_DIRECTORY
-                               : _compressionMethod->GetZipMethodDescriptor().GetVersionNeededToExtract());
+                               : streams().compressionMethod->GetZipMethodDescriptor().GetVersionNeededToExtract());
 }
 
 std::ios::pos_type ZipArchiveEntry::offsetOfCompressedData() {
@@ -457,29 +855,189 @@ std::ios::pos_type ZipArchiveEntry::offsetOfCompressedData() {
     return offset.compressedData;
 }
 
-std::ios::pos_type ZipArchiveEntry::seekToCompressedData() {
-    // check for fail bit?
-    archive.stream->seekg(offsetOfCompressedData(), std::ios::beg);
-    return offsetOfCompressedData();
+bool ZipArchiveEntry::mayNeedZip64(std::istream& inputStream) const {
+    constexpr u64 maxU32 = 0xFFFFFFFF;
+    const auto size = remainingSize(inputStream);
+    if (!size) {
+        // unknown size, so be safe
+        return true;
+    }
+    // incompressible data can grow a little when compressed
+    return *size + *size / 256 + 1024 >= maxU32;
+}
+
+bool ZipArchiveEntry::needsCompression() const noexcept {
+    return !isDirectory() && isNewOrChanged && hasCompressionStream();
+}
+
+void ZipArchiveEntry::precompress() {
+    if (!needsCompression()) {
+        return;
+    }
+    auto buffer = makeSpillBuffer(remainingSize(*_streams->inputStream));
+    serializeLocalFileHeader(*buffer);
+    buffer->flush();
+    _streams->precompressed = std::move(buffer);
+}
+
+void ZipArchiveEntry::prepareLocalFileHeader(std::istream* compressedDataStream) {
+    auto& local = localFileHeader();
+    
+    // the local file header can't grow once the data is written after it,
+    // so decide whether it needs Zip64 up front
+    if (isNewOrChanged && compressedDataStream) {
+        local.isZip64 = mayNeedZip64(*compressedDataStream);
+    } else {
+        local.isZip64 = local.isZip64 || local.needsZip64();
+    }
+    if (local.isZip64) {
+        fixVersionToExtractAtLeast(VERSION_NEEDED_ZIP64);
+        local.versionNeededToExtract = versionToExtract();
+    }
+}
+
+bool ZipArchiveEntry::needsAlignment(size_t alignment) const noexcept {
+    return alignment != 0 && !isDirectory()
+           && compressionMethod() == StoreMethod::CompressionMethod && !isPasswordProtected();
+}
+
+void ZipArchiveEntry::alignLocalFileHeader(u64 position, size_t alignment) {
+    using detail::ZipGenericExtraField;
+    if (alignment == 0) {
+        return;
+    }
+    auto& local = localFileHeader();
+    ZipGenericExtraField::remove(local.extraFields, ZipGenericExtraField::tags::alignment);
+    if (!needsAlignment(alignment)) {
+        return;
+    }
+    
+    // the padding goes after the extra field's header and the alignment itself
+    const auto dataOffset = position + local.serializedSize() + ZipGenericExtraField::minAlignmentSize;
+    const auto padding = (alignment - dataOffset % alignment) % alignment;
+    local.extraFields.push_back(ZipGenericExtraField::makeAlignment(static_cast<u16>(alignment), padding));
+}
+
+void ZipArchiveEntry::writeLocalFileHeader(std::ostream& stream) const {
+    const auto& local = *fileHeader.local;
+    if (isUsingDataDescriptor()) {
+        // the crc and sizes go in the data descriptor after the data instead
+        auto header = local;
+        header.compressedSize = 0;
+        header.unCompressedSize = 0;
+        header.crc32 = 0;
+        header.serialize(stream);
+    } else {
+        local.serialize(stream);
+    }
+}
+
+bool ZipArchiveEntry::canStayInPlace(u64 end) {
+    if (!originallyInArchive || isNewOrChanged
+        || (_streams && (_streams->immediateBuffer || _streams->inputStream || _streams->precompressed))) {
+        return false;
+    }
+    if (!hasLocalFileHeader) {
+        fetchLocalFileHeader();
+    }
+    
+    // the data (and data descriptor) mustn't reach where the update is written
+    constexpr u64 maxDataDescriptorSize = 24;
+    const auto dataEnd = static_cast<u64>(offsetOfCompressedData()) + compressedSize()
+                         + (isUsingDataDescriptor() ? maxDataDescriptorSize : 0);
+    if (dataEnd > end) {
+        return false;
+    }
+    
+    // and the local file header has to be what would be written now,
+    // i.e. none of the metadata in it has changed
+    prepareLocalFileHeader(nullptr);
+    std::ostringstream header;
+    writeLocalFileHeader(header);
+    std::string buffer;
+    if (header.view() == readLocalFileHeader(buffer)) {
+        return true;
+    }
+    // a deduplicated entry's local file header is the original's, with its name and extra fields,
+    // so it can only be checked for what's about the data
+    return sharesLocalFileHeader() && !checkLocalFileHeader();
+}
+
+void ZipArchiveEntry::keepInPlace() noexcept {
+    offset.serializedLocalFileHeader = static_cast<std::streamoff>(offsetOfLocalHeader());
 }
 
-void ZipArchiveEntry::serializeLocalFileHeader(std::ostream& stream) {
+void ZipArchiveEntry::setWrittenInArchive() {
+    closeRawStream();
+    closeDecompressionStream();
+    
+    if (_streams && isNewOrChanged) {
+        // the index is of the old data
+        _streams->deflateIndex = nullptr;
+    }
+    originallyInArchive = true;
+    isNewOrChanged = false;
+    if (_streams) {
+        _streams->inputStream = nullptr;
+        _streams->immediateBuffer = nullptr;
+        _streams->precompressed = nullptr;
+        _streams->contentHash = std::nullopt;
+        _streams->original = nullptr;
+        releaseIdleStreams();
+    }
+    
+    // where serializeCentralDirectoryFileHeader() pointed it
+    offsetOfLocalHeader() = static_cast<u64>(offset.serializedLocalFileHeader);
+    hasLocalFileHeader = false;
+    fileHeader.local = nullptr;
+}
+
+void ZipArchiveEntry::serializeLocalFileHeader(std::ostream& stream, size_t alignment) {
+    if (isDuplicate()) {
+        // the original was already written, so point the central directory at it, with its data's metadata
+        const auto& original = *_streams->original;
+        offset.serializedLocalFileHeader = original.offset.serializedLocalFileHeader;
+        auto& central = fileHeader.central;
+        const auto& originalCentral = original.fileHeader.central;
+        central.versionNeededToExtract = originalCentral.versionNeededToExtract;
+        central.generalPurposeBitFlag = originalCentral.generalPurposeBitFlag;
+        central.compressionMethod = originalCentral.compressionMethod;
+        central.crc32 = originalCentral.crc32;
+        central.compressedSize = originalCentral.compressedSize;
+        central.unCompressedSize = originalCentral.unCompressedSize;
+        return;
+    }
+    
+    if (_streams && _streams->precompressed) {
+        auto& precompressed = _streams->precompressed;
+        offset.serializedLocalFileHeader = stream.tellp();
+        precompressed->seekg(0, std::ios::beg);
+        utils::stream::copy(*precompressed, stream);
+        precompressed = nullptr;
+        return;
+    }
+    
     // ensure opening the stream
     std::istream* compressedDataStream = nullptr;
+    // if the compressed data is copied unchanged straight out of the archive
+    bool copiesFromArchive = false;
     
     if (!isDirectory()) {
-        if (inputStream == nullptr) {
+        if (!hasCompressionStream()) {
             if (!isNewOrChanged) {
                 // the file was either compressed in immediate mode,
                 // or was in previous archive
-                compressedDataStream = rawStream();
+                copiesFromArchive = originallyInArchive && !(_streams && _streams->immediateBuffer);
+                if (!copiesFromArchive) {
+                    compressedDataStream = rawStream();
+                }
             }
             
             // if file is new and empty or stream has been set to nullptr,
             // just do not set any compressed data stream
         } else {
             assert(isNewOrChanged);
-            compressedDataStream = inputStream;
+            compressedDataStream = _streams->inputStream;
         }
     }
     
@@ -490,25 +1048,24 @@ void ZipArchiveEntry::serializeLocalFileHeader(std::ostream& stream) {
     // save offset of stream here
     offset.serializedLocalFileHeader = stream.tellp();
     
-    auto& local = fileHeader.local;
-    
-    if (isUsingDataDescriptor()) {
-        local.compressedSize = 0;
-        local.unCompressedSize = 0;
-        local.crc32 = 0;
-    }
-    
-    local.serialize(stream);
+    prepareLocalFileHeader(compressedDataStream);
+    alignLocalFileHeader(static_cast<u64>(offset.serializedLocalFileHeader), alignment);
+    auto& local = *fileHeader.local;
+    writeLocalFileHeader(stream);
     
     // if this entry is a directory, it should not contain any data
     // nor crc.
     if (isDirectory()) {
-        assert(!crc32() && !size() && !compressedSize() && !inputStream);
+        assert(!crc32() && !size() && !compressedSize() && !hasCompressionStream());
     }
     
-    if (!isDirectory() && compressedDataStream != nullptr) {
+    if (!isDirectory() && (compressedDataStream != nullptr || copiesFromArchive)) {
         if (isNewOrChanged) {
             internalCompressStream(*compressedDataStream, stream);
+            if (local.needsZip64() && !local.isZip64) {
+                throw std::runtime_error("ZipArchiveEntry "s + std::string(fullName())
+                                         + " grew past 4 GiB after its local file header was written without Zip64");
+            }
             
             if (isUsingDataDescriptor()) {
                 local.serializeAsDataDescriptor(stream);
@@ -520,21 +1077,39 @@ void ZipArchiveEntry::serializeLocalFileHeader(std::ostream& stream) {
                 stream.seekp(compressedSize(), std::ios::cur);
             }
         } else {
-            utils::stream::copy(*compressedDataStream, stream);
+            if (copiesFromArchive) {
+                archive.copyRawTo(stream, static_cast<u64>(offsetOfCompressedData()), compressedSize());
+            } else {
+                utils::stream::copy(*compressedDataStream, stream);
+            }
+            if (isUsingDataDescriptor()) {
+                // the raw data doesn't include the original data descriptor
+                local.serializeAsDataDescriptor(stream);
+            }
         }
     }
 }
 
 void ZipArchiveEntry::serializeCentralDirectoryFileHeader(std::ostream& stream) {
     auto& central = fileHeader.central;
-    central.relativeOffsetOfLocalHeader = static_cast<i32>(offset.serializedLocalFileHeader);
+    central.relativeOffsetOfLocalHeader = static_cast<u64>(offset.serializedLocalFileHeader);
+    if (central.needsZip64()) {
+        fixVersionToExtractAtLeast(VERSION_NEEDED_ZIP64);
+    }
     central.serialize(stream);
 }
 
 void ZipArchiveEntry::unloadCompressionData() {
     // unload stream
-    immediateBuffer->clear();
-    inputStream = nullptr;
+    if (_streams) {
+        if (_streams->immediateBuffer) {
+            _streams->immediateBuffer->clear();
+        }
+        _streams->inputStream = nullptr;
+        _streams->precompressed = nullptr;
+        _streams->contentHash = std::nullopt;
+        _streams->original = nullptr;
+    }
     
     auto& central = fileHeader.central;
     central.compressedSize = 0;
@@ -545,42 +1120,53 @@ void ZipArchiveEntry::unloadCompressionData() {
 void ZipArchiveEntry::internalCompressStream(std::istream& inputStream, std::ostream& outputStream) {
     std::ostream* intermediateStream = &outputStream;
     
+    auto& streams = this->streams();
+    
     std::unique_ptr<zip_cryptostream> cryptoStream;
-    if (!_password.empty()) {
+    if (!streams.password.empty()) {
         generalPurposeBitFlagRef() |= BitFlag::Encrypted;
         
         cryptoStream = std::make_unique<zip_cryptostream>();
         
-        cryptoStream->init(outputStream, _password.c_str());
+        cryptoStream->init(outputStream, streams.password.c_str());
         cryptoStream->set_final_byte(lastByteOfEncryptionHeader());
         intermediateStream = cryptoStream.get();
     }
     
-    crc32stream crc32Stream;
-    crc32Stream.init(inputStream);
-    
+    const auto encoder = streams.compressionMethod->GetEncoder();
     compression_encoder_stream compressionStream(
-            _compressionMethod->GetEncoder(),
-            _compressionMethod->GetEncoderProperties(),
-            *intermediateStream);
+            encoder, streams.compressionMethod->GetEncoderProperties(), *intermediateStream);
     intermediateStream = &compressionStream;
-    utils::stream::copy(crc32Stream, *intermediateStream);
+    
+    // a parallel encoder computes the crc32 of each chunk on the thread compressing it,
+    // but the input is still read through crc32Stream if it has to be hashed
+    crc32stream crc32Stream;
+    const bool encoderHasCrc32 = encoder->has_crc32();
+    const bool hashes = archive.isDeduplicating() && !streams.contentHash && streams.password.empty();
+    const bool readsCrc32Stream = !encoderHasCrc32 || hashes;
+    if (readsCrc32Stream) {
+        crc32Stream.init(inputStream, hashes);
+    }
+    utils::stream::copy(readsCrc32Stream ? crc32Stream : inputStream, *intermediateStream);
     
     intermediateStream->flush();
     
-    auto& local = fileHeader.local;
-    local.unCompressedSize = static_cast<u32>(compressionStream.get_bytes_read());
-    local.compressedSize = static_cast<u32>(compressionStream.get_bytes_written() +
-                                            (!_password.empty() ? 12 : 0));
-    local.crc32 = crc32Stream.get_crc32();
+    auto& local = localFileHeader();
+    local.unCompressedSize = compressionStream.get_bytes_read();
+    local.compressedSize = compressionStream.get_bytes_written() + (!streams.password.empty() ? 12 : 0);
+    local.crc32 = encoderHasCrc32 ? encoder->get_crc32() : crc32Stream.get_crc32();
+    if (hashes) {
+        streams.contentHash = ContentHash {*crc32Stream.get_sha256(), local.unCompressedSize};
+    }
     
     syncCentralDirectoryWithLocalFileHeader();
 }
 
 void ZipArchiveEntry::figureCrc32() {
-    if (isDirectory() || inputStream == nullptr || !isNewOrChanged) {
+    if (isDirectory() || !hasCompressionStream() || !isNewOrChanged) {
         return;
     }
+    auto* const inputStream = _streams->inputStream;
     
     // stream must be seekable
     auto position = inputStream->tellg();
@@ -600,6 +1186,46 @@ void ZipArchiveEntry::figureCrc32() {
     fileHeader.central.crc32 = crc32Stream.get_crc32();
 }
 
+void ZipArchiveEntry::figureContentHash() {
+    if (!needsCompression() || isPasswordProtected() || _streams->contentHash) {
+        return;
+    }
+    auto* const inputStream = _streams->inputStream;
+    
+    // stream must be seekable
+    const auto position = inputStream->tellg();
+    if (position == std::ios::pos_type(-1)) {
+        return;
+    }
+    
+    crc32stream crc32Stream;
+    crc32Stream.init(*inputStream, true);
+    nullstream devNull;
+    utils::stream::copy(crc32Stream, devNull);
+    
+    inputStream->clear();
+    inputStream->seekg(position);
+    
+    _streams->contentHash = ContentHash {*crc32Stream.get_sha256(), crc32Stream.get_bytes_read()};
+}
+
+bool ZipArchiveEntry::isDuplicate() const noexcept {
+    return _streams && _streams->original;
+}
+
+bool ZipArchiveEntry::sharesLocalFileHeader() const noexcept {
+    // only checked when a local file header doesn't match, so a linear search is fine
+    for (size_t i = 0; i < index; i++) {
+        const auto& other = archive[i];
+        if (other.offsetOfLocalHeader() == offsetOfLocalHeader()
+            && other.compressionMethod() == compressionMethod() && other.crc32() == crc32()
+            && other.compressedSize() == compressedSize() && other.size() == size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 u32 ZipArchiveEntry::lastUintOfEncryptionHeader() {
     if (!!(generalPurposeBitFlag() & BitFlag::DataDescriptor)) {
         // In the case that bit 3 of the general purpose bit flag is set to
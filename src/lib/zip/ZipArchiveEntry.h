@@ -1,9 +1,11 @@
 #pragma once
 
+#include "DeflateIndex.h"
 #include "detail/ZipLocalFileHeader.h"
 #include "detail/ZipCentralDirectoryFileHeader.h"
 
 #include "methods/ICompressionMethod.h"
+#include "methods/AutoMethod.h"
 #include "methods/StoreMethod.h"
 #include "methods/DeflateMethod.h"
 #include "methods/LzmaMethod.h"
@@ -11,11 +13,14 @@
 #include "streams/substream.h"
 #include "utils/enum_utils.h"
 
+#include <array>
 #include <cstdint>
 #include <ctime>
 #include <string>
 #include <vector>
 #include <memory>
+#include <optional>
+#include <span>
 
 #include "src/lib/zip/utils/BitFlagSetter.h"
 
@@ -62,24 +67,56 @@ private:
     ZipArchive& archive;           //< pointer to the owning zip archive
     size_t index;
     
-    std::shared_ptr<std::istream> _rawStream = nullptr;         //< stream of raw compressed data
-    std::shared_ptr<std::istream> compressionStream = nullptr; //< stream of uncompressed data
-    std::shared_ptr<std::istream> encryptionStream = nullptr;  //< underlying encryption stream
-    std::shared_ptr<std::istream> archiveStream = nullptr;     //< substream of owning zip archive file
-    
-    // internal compression data
-    std::shared_ptr<std::iostream> immediateBuffer;   //< stream used in the immediate mode, stores compressed data in memory
-    std::istream* inputStream = nullptr;       //< input stream
+    /**
+     * \brief Identifies the uncompressed data of an entry when the archive deduplicates entries.
+     */
+    struct ContentHash {
+        
+        std::array<u8, 32> sha256;
+        u64 size;
+        
+        auto operator<=>(const ContentHash& other) const = default;
+        
+    };
     
-    ICompressionMethod::Ptr _compressionMethod; //< compression method
-    CompressionMode _compressionMode = CompressionMode::Immediate;   //< compression mode, either deferred or immediate
+    /**
+     * \brief The state of the entry's opened streams and of the data it's given to compress.
+     *        Most entries of an opened archive are never opened,
+     *        so this is only allocated once an entry is, by streams().
+     */
+    struct StreamState {
+        
+        std::shared_ptr<std::istream> rawStream = nullptr;         //< stream of raw compressed data
+        std::shared_ptr<std::istream> compressionStream = nullptr; //< stream of uncompressed data
+        std::shared_ptr<std::istream> encryptionStream = nullptr;  //< underlying encryption stream
+        std::shared_ptr<std::istream> archiveStream = nullptr;     //< substream of owning zip archive file
+        
+        // internal compression data
+        std::shared_ptr<std::iostream> immediateBuffer;   //< stream used in the immediate mode, stores compressed data in memory
+        std::istream* inputStream = nullptr;       //< input stream
+        std::unique_ptr<std::iostream> precompressed; //< the local file header and data serialized ahead by precompress()
+        
+        ICompressionMethod::Ptr compressionMethod; //< compression method
+        CompressionMode compressionMode = CompressionMode::Immediate;   //< compression mode, either deferred or immediate
+        
+        std::string password;
+        
+        std::shared_ptr<DeflateIndex> deflateIndex; //< makes decompressionStream() seekable, see setDeflateIndex()
+        
+        std::optional<ContentHash> contentHash;    //< of the data to compress, see ZipArchive::setDeduplicating()
+        const ZipArchiveEntry* original = nullptr; //< an earlier entry with the same data, which is written instead
+        
+        bool isIdle() const noexcept;
+        
+    };
     
-    std::string _name;
+    std::unique_ptr<StreamState> _streams; //< null until the entry is opened
     
     // TODO: make as flags
     bool originallyInArchive = false;
     bool isNewOrChanged = false;
     bool hasLocalFileHeader = false;
+    bool isNameIndexed = false; //< if counted in archive.nameIndex, so nested (un)indexing is a no-op
     
     using Local = detail::ZipLocalFileHeader;
     using Central = detail::ZipCentralDirectoryFileHeader;
@@ -87,21 +124,19 @@ private:
 public:
     
     struct {
-        Local local;
+        std::unique_ptr<Local> local; //< only read or made when the entry is written, see localFileHeader()
         Central central;
     } fileHeader;
 
 private:
     
     struct {
-        std::ios::pos_type compressedData;
-        std::ios::pos_type serializedLocalFileHeader;
+        std::streamoff compressedData;
+        std::streamoff serializedLocalFileHeader;
     } offset = {
             .compressedData = -1,
             .serializedLocalFileHeader = -1,
     };
-    
-    std::string _password;
 
 public:
     
@@ -282,6 +317,8 @@ public:
      *
      * \param stream  The input stream to compress.
      * \param method  (Optional) The method of compression.
+     *                An AutoMethod picks Store, Deflate or LZMA from the entry's name and the start of the stream,
+     *                which is read and seeked back, and the entry is compressed with the one it picks.
      * \param mode    (Optional) The mode of compression.
      *                If deferred mode is chosen, the data are compressed when the zip archive is about to be written.
      *                The stream instance must exist when the ZipArchive::WriteToStream method is called.
@@ -295,7 +332,7 @@ public:
      *
      * \return  true if it succeeds, false if it fails.
      */
-    bool setCompressionStream(std::istream& stream, ICompressionMethod::Ptr method = DeflateMethod::Create(),
+    bool setCompressionStream(std::istream& stream, ICompressionMethod::Ptr method = AutoMethod::Create(),
                               CompressionMode mode = CompressionMode::Deferred);
     
     /**
@@ -314,9 +351,112 @@ public:
      * \brief Gets decompression stream.
      *        If the file is encrypted and correct password is not provided, it returns nullptr.
      *
+     * \param verifyCrc32 (Optional) If the decompressed data should be checked against crc32() and size()
+     *                    as it's decompressed. When it doesn't match, the stream sets its badbit
+     *                    once the end of the data is decompressed, and throws a std::runtime_error
+     *                    describing the mismatch if its exceptions() include badbit.
+     *
      * \return  null if it fails, else the decompression stream.
      */
-    std::istream* decompressionStream();
+    std::istream* decompressionStream(bool verifyCrc32 = false);
+    
+    /**
+     * \brief Gets the raw (possibly compressed and encrypted) bytes of the entry
+     *        straight out of the memory mapped archive, without any copying.
+     *        The view is valid as long as the archive is.
+     *
+     * \return  std::nullopt if the archive isn't memory mapped or the entry's data didn't come from it,
+     *          else the raw bytes.
+     */
+    std::optional<std::span<const std::byte>> rawData();
+    
+    /**
+     * \brief Gets the uncompressed bytes of a stored and unencrypted entry
+     *        straight out of the memory mapped archive, without any copying.
+     *        The view is valid as long as the archive is.
+     *
+     * \return  std::nullopt if the entry can't be viewed directly, else the uncompressed bytes.
+     */
+    std::optional<std::span<const std::byte>> data();
+    
+    /**
+     * \brief The alignment of stored entries written with ZipArchive::writeTo() when it's asked to align them,
+     *        the page size, so their data can be mapped straight into memory.
+     */
+    static constexpr size_t DEFAULT_ALIGNMENT = 4096;
+    
+    /**
+     * \brief Gets the uncompressed bytes of a stored and unencrypted entry like data(),
+     *        but only if they start at a multiple of alignment in memory,
+     *        i.e. if the archive was written aligned to it.
+     *
+     * \return  std::nullopt if the entry can't be viewed directly or isn't aligned, else the uncompressed bytes.
+     */
+    std::optional<std::span<const std::byte>> alignedData(size_t alignment = DEFAULT_ALIGNMENT);
+    
+    /**
+     * \brief Decompresses the whole entry straight into output, which must be exactly size() bytes.
+     *        The codec writes directly into output, without any streams or intermediate buffers,
+     *        and reads directly from the archive if it's memory mapped.
+     *        Doesn't affect any opened streams of the entry,
+     *        and different entries can be decompressed in parallel.
+     *
+     * \param verifyCrc32 (Optional) If the decompressed data should be checked against crc32(),
+     *                    which is updated as each block is decompressed, while it's still in cache.
+     *
+     * \return false if the entry can't be decompressed, i.e. it's encrypted and the password is wrong or missing,
+     *         it uses an unsupported version or compression method, its data is corrupt or the wrong size,
+     *         or its data isn't in the archive yet.
+     * \throws std::runtime_error if verifyCrc32 and the decompressed data doesn't match crc32().
+     */
+    bool decompressInto(std::span<std::byte> output, bool verifyCrc32 = false);
+    
+    /**
+     * \brief Decompresses the whole entry into a buffer of size() bytes, see decompressInto().
+     *
+     * \return std::nullopt if the entry can't be decompressed, else the uncompressed bytes.
+     * \throws std::runtime_error if verifyCrc32 and the decompressed data doesn't match crc32().
+     */
+    std::optional<std::vector<std::byte>> readAll(bool verifyCrc32 = false);
+    
+    /**
+     * \brief Makes decompressionStream() seekable for a deflated entry, using index to seek quickly.
+     *        The stream starts decompressing from the last access point in index before where it seeks to,
+     *        and adds access points to index the first time it decompresses past them,
+     *        so an empty index is built lazily by reading the stream, and a complete one can be saved to a sidecar
+     *        with DeflateIndex::serialize() and loaded later with DeflateIndex::deserialize().
+     *        Doesn't affect a decompression stream that's already opened.
+     *
+     * \param index The index, or null to go back to a normal, front to back decompression stream.
+     *
+     * \return false if the entry isn't deflated or is encrypted, or index is of different data.
+     */
+    bool setDeflateIndex(std::shared_ptr<DeflateIndex> index);
+    
+    /**
+     * \brief Gets the index set by setDeflateIndex() or buildDeflateIndex(), or null if there isn't one.
+     */
+    std::shared_ptr<DeflateIndex> deflateIndex() const noexcept;
+    
+    /**
+     * \brief Decompresses the whole entry once to build a complete index, and sets it, see setDeflateIndex().
+     *        If the entry already has an index, that one is completed instead.
+     *
+     * \param spacing (Optional) About how many uncompressed bytes apart the index's access points are.
+     *
+     * \return null if the entry isn't deflated, is encrypted, is corrupt, or its decompression stream is already opened,
+     *         else the complete index.
+     */
+    std::shared_ptr<DeflateIndex> buildDeflateIndex(u64 spacing = DeflateIndex::defaultSpacing);
+    
+    /**
+     * \brief Checks that the entry's local file header, and data descriptor if it has one,
+     *        agree with its central directory file header, as they're stored in the archive.
+     *        Safe to call for different entries from different threads.
+     *
+     * \return std::nullopt if they agree or the entry isn't in the archive yet, else what doesn't agree.
+     */
+    std::optional<std::string> checkLocalFileHeader();
     
     /**
      * \brief Query if the GetRawStream method has been already called.
@@ -373,8 +513,8 @@ public:
     
     enum class BitFlag : u16 {
         
-        None = 1 << 0,
-        Encrypted = 1 << 1,
+        None = 0,
+        Encrypted = 1 << 0,
         DataDescriptor = 1 << 3,
         UnicodeFileName = 1 << 11,
         
@@ -398,14 +538,52 @@ private:
     
     u16& versionMadeBy() noexcept;
     
-    const i32& offsetOfLocalHeader() const noexcept;
+    const u64& offsetOfLocalHeader() const noexcept;
     
-    i32& offsetOfLocalHeader() noexcept;
+    u64& offsetOfLocalHeader() noexcept;
     
     bool hasCompressionStream() const noexcept;
     
+    /**
+     * \brief Gets the stream state, allocating it if the entry hasn't been opened yet.
+     */
+    StreamState& streams();
+    
+    /**
+     * \brief Frees the stream state if nothing is open or pending in it anymore.
+     */
+    void releaseIdleStreams() noexcept;
+    
+    /**
+     * \brief Gets the local file header, making an empty one if it hasn't been fetched or made yet.
+     */
+    Local& localFileHeader();
+    
+    /**
+     * \brief Reads the local file header's bytes as they are in the archive.
+     *
+     * \param buffer  Storage for the bytes if the archive isn't memory mapped.
+     */
+    std::string_view readLocalFileHeader(std::string& buffer);
+    
+    /**
+     * \brief Guesses the size of the local file header from the central one,
+     *        since the local name and extra fields are usually the same as the central ones.
+     */
+    size_t guessLocalFileHeaderSize() const noexcept;
+    
+    /**
+     * \brief Reads the local file header if the entry is in the archive and it hasn't been yet.
+     *
+     * \throws std::runtime_error if it has to be read but the archive was opened metadata only.
+     */
     void fetchLocalFileHeader();
     
+    /**
+     * \brief Deserializes the local file header from its bytes as they are in the archive.
+     */
+    void parseLocalFileHeader(std::string_view header);
+    
     void checkFileNameCorrection();
     
     void fixVersionToExtractAtLeast(u16 value);
@@ -416,9 +594,71 @@ private:
     
     std::ios::pos_type offsetOfCompressedData();
     
-    std::ios::pos_type seekToCompressedData();
+    bool mayNeedZip64(std::istream& inputStream) const;
+    
+    /**
+     * \brief If the entry's data still has to be compressed when the archive is written.
+     */
+    bool needsCompression() const noexcept;
+    
+    /**
+     * \brief Serializes the local file header and compressed data ahead of time,
+     *        into memory, or into a temporary file if the input is large.
+     *        serializeLocalFileHeader() then just copies them out, byte for byte what it would have written.
+     *        Only touches this entry and its compression method,
+     *        so entries with different compression methods can be precompressed on different threads.
+     */
+    void precompress();
+    
+    /**
+     * \brief Decides the parts of the local file header that depend on how it's written, i.e. if it needs Zip64.
+     */
+    void prepareLocalFileHeader(std::istream* compressedDataStream);
+    
+    /**
+     * \brief If the entry's data is aligned when written with alignment, i.e. it's stored and unencrypted.
+     *
+     * \param alignment  0 for no alignment.
+     */
+    bool needsAlignment(size_t alignment) const noexcept;
+    
+    /**
+     * \brief Pads the local file header with an alignment extra field, like zipalign,
+     *        so that the data after it starts at a multiple of alignment when it's written at position,
+     *        replacing any such padding it had before.
+     *
+     * \param alignment  0 to leave the local file header as it is.
+     */
+    void alignLocalFileHeader(u64 position, size_t alignment);
+    
+    /**
+     * \brief Writes just the local file header, with the crc and sizes zeroed if they're in a data descriptor.
+     */
+    void writeLocalFileHeader(std::ostream& stream) const;
+    
+    /**
+     * \brief If the local file header and data in the archive's file can be kept as they are
+     *        when the archive is updated in place, writing from end on.
+     *        They must be unchanged, end before end,
+     *        and the local file header must be exactly what would be written now,
+     *        or if it's shared with an earlier entry, agree with this one's central directory file header.
+     */
+    bool canStayInPlace(u64 end);
     
-    void serializeLocalFileHeader(std::ostream& stream);
+    /**
+     * \brief Makes the central directory point to where the local file header already is in the archive's file.
+     */
+    void keepInPlace() noexcept;
+    
+    /**
+     * \brief After the archive's own file was written, makes the entry unchanged and read from where it was written.
+     */
+    void setWrittenInArchive();
+    
+    /**
+     * \param alignment  (Optional) Like in alignLocalFileHeader().
+     */
+    void serializeLocalFileHeader(std::ostream& stream, size_t alignment = 0);
     
     void serializeCentralDirectoryFileHeader(std::ostream& stream);
     
@@ -429,6 +669,26 @@ private:
     // for encryption
     void figureCrc32();
     
+    /**
+     * \brief Hashes the data to compress if it isn't yet, so the archive can find entries with the same data.
+     *        Only unencrypted entries with a seekable input stream are hashed,
+     *        the rest are only hashed when they're compressed, if at all.
+     */
+    void figureContentHash();
+    
+    /**
+     * \brief If the entry's data to compress is the same as an earlier entry's, and so only the original is written.
+     *        Then serializeLocalFileHeader() doesn't write anything, but points the central directory at the original.
+     */
+    bool isDuplicate() const noexcept;
+    
+    /**
+     * \brief If an earlier entry in the archive has the same local file header and data as this one,
+     *        i.e. the same offset, compression method, crc and sizes, like a duplicate is written,
+     *        and so the local file header has the earlier entry's name.
+     */
+    bool sharesLocalFileHeader() const noexcept;
+    
     u32 lastUintOfEncryptionHeader();
     
     u8 lastByteOfEncryptionHeader();
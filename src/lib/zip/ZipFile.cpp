@@ -4,9 +4,17 @@
 
 #include "ZipFile.h"
 
+#include "streams/nullstream.h"
+#include "utils/crc32_utils.h"
 #include "utils/stream_utils.h"
+#include "utils/thread_utils.h"
 
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <numeric>
+#include <unordered_set>
 
 namespace {
     
@@ -20,8 +28,109 @@ namespace {
         }
     }
     
-    std::string makeTempFilename(const std::string& fileName) {
-        return fileName + ".tmp";
+    /**
+     * \brief Gets where entry is extracted to in destinationPath,
+     *        without any . parts or trailing /, so that entries extracting to the same place have the same path.
+     *
+     * \throws std::runtime_error if the entry's name is absolute or has .. in it,
+     *         so that an archive can't write outside of destinationPath.
+     */
+    fs::path extractionPath(const ZipArchiveEntry& entry, const fs::path& destinationPath) {
+        const fs::path name(std::string(entry.fullName()));
+        bool isSafe = !name.has_root_path();
+        auto path = destinationPath;
+        for (const auto& part : name) {
+            isSafe &= part != "..";
+            if (!part.empty() && part != ".") {
+                path /= part;
+            }
+        }
+        if (!isSafe) {
+            throw std::runtime_error("cannot extract " + name.string() + ": outside of destination directory");
+        }
+        return path;
+    }
+    
+    void checkCrc32(const ZipArchiveEntry& entry, u32 crc32) {
+        if (crc32 != entry.crc32()) {
+            char message[64];
+            std::snprintf(message, sizeof(message), "crc32 mismatch: expected %08x, got %08x", entry.crc32(), crc32);
+            throw std::runtime_error("cannot extract " + std::string(entry.fullName()) + ": " + message);
+        }
+    }
+    
+    void extractFile(ZipArchiveEntry& entry, const fs::path& path, bool verifyCrc32) {
+        std::ofstream destFile;
+        // the writes below are already large, so skip copying them through the stream's small buffer
+        destFile.rdbuf()->pubsetbuf(nullptr, 0);
+        destFile.open(path, std::ios::binary | std::ios::trunc);
+        if (!destFile.is_open()) {
+            throw std::runtime_error("cannot create destination file " + path.string());
+        }
+        
+        if (const auto data = entry.data()) {
+            // stored in a memory mapped archive, so write it all at once without decompressing
+            if (verifyCrc32) {
+                checkCrc32(entry, utils::crc32::update(0, data->data(), data->size()));
+            }
+            destFile.write(reinterpret_cast<const char*>(data->data()), static_cast<std::streamsize>(data->size()));
+        } else {
+            std::istream* dataStream = entry.decompressionStream(verifyCrc32);
+            if (dataStream == nullptr) {
+                const auto reason = entry.canExtract() ? "wrong password" : "unsupported version or compression method";
+                throw std::runtime_error("cannot extract " + std::string(entry.fullName()) + ": " + reason);
+            }
+            constexpr u64 maxBufferSize = 1 << 20;
+            // a mismatch is thrown by the decompression stream once it reaches the end
+            dataStream->exceptions(std::ios::badbit);
+            try {
+                utils::stream::copy(*dataStream, destFile,
+                                    static_cast<size_t>(std::clamp<u64>(entry.size(), 1, maxBufferSize)));
+            } catch (const std::exception& e) {
+                entry.closeDecompressionStream();
+                throw std::runtime_error("cannot extract " + std::string(entry.fullName()) + ": " + e.what());
+            }
+            entry.closeDecompressionStream();
+        }
+        
+        destFile.close();
+        if (!destFile) {
+            throw std::runtime_error("cannot write destination file " + path.string());
+        }
+    }
+    
+    /**
+     * \brief Decompresses entry into nothing, checking it along the way.
+     *
+     * \return  Why the entry is bad, or an empty string if it's good.
+     */
+    std::string testEntry(ZipArchiveEntry& entry) {
+        if (auto mismatch = entry.checkLocalFileHeader()) {
+            return std::move(*mismatch);
+        }
+        if (entry.isDirectory()) {
+            return {};
+        }
+        
+        std::istream* dataStream = entry.decompressionStream(true);
+        if (dataStream == nullptr) {
+            if (!entry.canExtract()) {
+                return "unsupported version or compression method";
+            }
+            return entry.password().empty() ? "password required" : "wrong password";
+        }
+        std::string error;
+        dataStream->exceptions(std::ios::badbit);
+        try {
+            nullstream devNull;
+            constexpr u64 maxBufferSize = 1 << 20;
+            utils::stream::copy(*dataStream, devNull,
+                                static_cast<size_t>(std::clamp<u64>(entry.size(), 1, maxBufferSize)));
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        entry.closeDecompressionStream();
+        return error;
     }
     
 }
@@ -68,47 +177,36 @@ void ZipFile::AddEncryptedFile(
 void ZipFile::AddEncryptedFile(
         const std::string& zipPath, const std::string& fileName, const std::string& inArchiveName,
         const std::string& password, ICompressionMethod::Ptr method) {
-    std::string tmpName = makeTempFilename(zipPath);
+    if (!fs::exists(zipPath)) {
+        // start from an empty file, which is an empty archive
+        std::ofstream(zipPath, std::ios::binary);
+    }
     
-    {
-        auto zipArchive = ZipArchive(zipPath);
-        
-        std::ifstream fileToAdd;
-        fileToAdd.open(fileName, std::ios::binary);
-        
-        if (!fileToAdd.is_open()) {
-            throw std::runtime_error("cannot open input file");
-        }
-        
-        auto& fileEntry = zipArchive
-                .entry(inArchiveName)
-                .create(ZipArchive::MaybeEntry::CreateMode::OVERWRITE)
-                .get();
-        
-        if (!password.empty()) {
-            fileEntry.setPassword(password);
-            fileEntry.useDataDescriptor();
-        }
-        fileEntry.setCompressionStream(fileToAdd, std::move(method));
-        
-        //////////////////////////////////////////////////////////////////////////
-        
-        std::ofstream outFile;
-        outFile.open(tmpName, std::ios::binary);
-        
-        if (!outFile.is_open()) {
-            throw std::runtime_error("cannot open output file");
-        }
-        
-//        outFile << zipArchive;
-        zipArchive.writeTo(outFile);
-        outFile.close();
-        
-        // force closing the input zip stream
+    auto zipArchive = ZipArchive(zipPath);
+    
+    std::ifstream fileToAdd;
+    fileToAdd.open(fileName, std::ios::binary);
+    
+    if (!fileToAdd.is_open()) {
+        throw std::runtime_error("cannot open input file");
+    }
+    
+    auto& fileEntry = zipArchive
+            .entry(inArchiveName)
+            .create(ZipArchive::MaybeEntry::CreateMode::OVERWRITE)
+            .get();
+    
+    if (!password.empty()) {
+        fileEntry.setPassword(password);
+        fileEntry.useDataDescriptor();
     }
+    fileEntry.setCompressionStream(fileToAdd, std::move(method));
     
-    remove(zipPath.c_str());
-    rename(tmpName.c_str(), zipPath.c_str());
+    //////////////////////////////////////////////////////////////////////////
+    
+    // only the new entry and the central directory are written,
+    // an overwritten entry is left as dead space until ZipArchive::compact()
+    zipArchive.update();
 }
 
 void ZipFile::ExtractFile(const std::string& zipPath, const std::string& fileName) {
@@ -151,4 +249,103 @@ void ZipFile::ExtractEncryptedFile(const std::string& zipPath, const std::string
     
     destFile.flush();
     destFile.close();
-}
\ No newline at end of file
+}
+
+ZipFile::ExtractionSummary ZipFile::ExtractToDirectory(
+        const std::string& zipPath, const std::string& destinationPath, size_t numThreads, bool verifyCrc32) {
+    auto zipArchive = ZipArchive(zipPath);
+    return ExtractToDirectory(zipArchive, destinationPath, numThreads, verifyCrc32);
+}
+
+ZipFile::ExtractionSummary ZipFile::ExtractToDirectory(
+        ZipArchive& zipArchive, const fs::path& destinationPath, size_t numThreads, bool verifyCrc32) {
+    const auto start = std::chrono::steady_clock::now();
+    ExtractionSummary summary;
+    
+    // create every directory once up front, so the workers only write files
+    std::vector<std::pair<ZipArchiveEntry*, fs::path>> files;
+    std::unordered_set<std::string> directories;
+    directories.insert(destinationPath.string());
+    // entries extracting to the same path would be written over each other at once,
+    // so only the first one is extracted, the same one entry(name) finds, whether it's a file or a directory
+    std::unordered_set<std::string> paths;
+    for (auto& entry : zipArchive) {
+        auto path = extractionPath(entry, destinationPath);
+        if (!paths.insert(path.string()).second) {
+            continue;
+        }
+        if (entry.isDirectory()) {
+            directories.insert(path.string());
+        } else {
+            directories.insert(path.parent_path().string());
+            files.emplace_back(&entry, std::move(path));
+        }
+    }
+    for (const auto& directory : directories) {
+        fs::create_directories(directory);
+    }
+    
+    // largest first, so that a big entry isn't started last and left running alone
+    std::stable_sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.first->size() > b.first->size();
+    });
+    
+    std::atomic<u64> numBytes = 0;
+    utils::thread::parallelFor(files.size(), numThreads, [&](size_t i) {
+        auto& [entry, path] = files[i];
+        extractFile(*entry, path, verifyCrc32);
+        numBytes += entry->size();
+    });
+    
+    summary.numFiles = files.size();
+    summary.numBytes = numBytes;
+    summary.duration = std::chrono::steady_clock::now() - start;
+    return summary;
+}
+
+ZipFile::TestReport ZipFile::Test(const std::string& zipPath, size_t numThreads) {
+    auto zipArchive = ZipArchive(zipPath);
+    return Test(zipArchive, numThreads);
+}
+
+ZipFile::TestReport ZipFile::Test(ZipArchive& zipArchive, size_t numThreads) {
+    const auto start = std::chrono::steady_clock::now();
+    TestReport report;
+    report.entries.resize(zipArchive.size());
+    
+    // largest first, like in ExtractToDirectory()
+    std::vector<size_t> order(zipArchive.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return zipArchive[a].size() > zipArchive[b].size();
+    });
+    
+    utils::thread::parallelFor(order.size(), numThreads, [&](size_t i) {
+        auto& entry = zipArchive[order[i]];
+        auto& result = report.entries[order[i]];
+        const auto entryStart = std::chrono::steady_clock::now();
+        result.name = entry.fullName();
+        result.size = entry.size();
+        try {
+            result.error = testEntry(entry);
+        } catch (const std::exception& e) {
+            // i.e. the archive couldn't be read
+            result.error = e.what();
+        }
+        result.duration = std::chrono::steady_clock::now() - entryStart;
+    });
+    
+    for (const auto& result : report.entries) {
+        report.numFailed += !result.ok();
+        report.numBytes += result.size;
+    }
+    report.duration = std::chrono::steady_clock::now() - start;
+    return report;
+}
+
+void ZipFile::RemoveEntry(const std::string& zipPath, const std::string& fileName) {
+    auto zipArchive = ZipArchive(zipPath);
+    zipArchive.entry(fileName).remove(ZipArchive::MaybeEntry::RemoveMode::FAIL_IF_NOT_EXISTS);
+    // the entry is left as dead space until ZipArchive::compact()
+    zipArchive.update();
+}
@@ -2,8 +2,10 @@
 
 #include "ZipArchive.h"
 
+#include <chrono>
 #include <string>
 #include <memory>
+#include <vector>
 
 /**
  * \brief Provides static methods for creating, extracting, and opening zip archives.
@@ -12,10 +14,49 @@ class ZipFile {
     
     // TODO:
     // CreateFromDirectory + compression level + opening to/from stream support
-    // ExtractToDirectory
 
 public:
     
+    /**
+     * \brief What ExtractToDirectory() did.
+     */
+    struct ExtractionSummary {
+        
+        size_t numFiles = 0;
+        u64 numBytes = 0; //< the total uncompressed size of the extracted files
+        std::chrono::steady_clock::duration duration{};
+        
+    };
+    
+    /**
+     * \brief What Test() found.
+     */
+    struct TestReport {
+        
+        struct Entry {
+            
+            std::string name;
+            u64 size = 0;
+            std::string error; //< why the entry failed, or empty if it passed
+            std::chrono::steady_clock::duration duration{};
+            
+            bool ok() const noexcept {
+                return error.empty();
+            }
+            
+        };
+        
+        std::vector<Entry> entries; //< in the same order as in the archive
+        size_t numFailed = 0;
+        u64 numBytes = 0; //< the total uncompressed size of the tested entries
+        std::chrono::steady_clock::duration duration{};
+        
+        bool ok() const noexcept {
+            return numFailed == 0;
+        }
+        
+    };
+    
     /**
      * \brief Opens the zip archive file with the given filename.
      *
@@ -62,7 +103,7 @@ public:
      * \param level     (Optional) The level of compression. Use CompressionLevel::Stored for no compression.
      */
     static void AddFile(const std::string& zipPath, const std::string& fileName,
-                        ICompressionMethod::Ptr method = DeflateMethod::Create());
+                        ICompressionMethod::Ptr method = AutoMethod::Create());
     
     /**
      * \brief Adds a file to the zip archive.
@@ -73,7 +114,7 @@ public:
      * \param level         (Optional) The level of compression. Use CompressionLevel::Stored for no compression.
      */
     static void AddFile(const std::string& zipPath, const std::string& fileName, const std::string& inArchiveName,
-                        ICompressionMethod::Ptr method = DeflateMethod::Create());
+                        ICompressionMethod::Ptr method = AutoMethod::Create());
     
     /**
      * \brief Adds an encrypted file to the zip archive.
@@ -85,7 +126,7 @@ public:
      * \param level     (Optional) The level of compression. Use CompressionLevel::Stored for no compression.
      */
     static void AddEncryptedFile(const std::string& zipPath, const std::string& fileName, const std::string& password,
-                                 ICompressionMethod::Ptr method = DeflateMethod::Create());
+                                 ICompressionMethod::Ptr method = AutoMethod::Create());
     
     /**
      * \brief Adds an encrypted file to the zip archive.
@@ -98,7 +139,7 @@ public:
      */
     static void
     AddEncryptedFile(const std::string& zipPath, const std::string& fileName, const std::string& inArchiveName,
-                     const std::string& password, ICompressionMethod::Ptr method = DeflateMethod::Create());
+                     const std::string& password, ICompressionMethod::Ptr method = AutoMethod::Create());
     
     /**
      * \brief Extracts the file from the zip archive.
@@ -142,6 +183,62 @@ public:
     ExtractEncryptedFile(const std::string& zipPath, const std::string& fileName, const std::string& destinationPath,
                          const std::string& password);
     
+    /**
+     * \brief Extracts every entry of the zip archive into a directory, decompressing entries in parallel.
+     *        The largest entries are started first, so one big entry doesn't hold up the end.
+     *
+     * \param zipPath         Full pathname of the zip file.
+     * \param destinationPath The directory to extract into, which is created if it doesn't exist.
+     * \param numThreads      (Optional) The number of threads to use, or 0 for the hardware concurrency.
+     * \param verifyCrc32     (Optional) If each extracted file's CRC-32 and size should be checked against the archive's.
+     *
+     * \return  The number of files and bytes extracted and how long it took.
+     * \throws std::runtime_error if an entry can't be extracted, fails verification, or its name escapes destinationPath.
+     */
+    static ExtractionSummary
+    ExtractToDirectory(const std::string& zipPath, const std::string& destinationPath, size_t numThreads = 0,
+                       bool verifyCrc32 = false);
+    
+    /**
+     * \brief Extracts every entry of an open zip archive into a directory, decompressing entries in parallel.
+     *        If several entries have the same path, only the first one is extracted, like entry(name) finds.
+     *
+     * \param zipArchive      The zip archive to extract, which must not be modified meanwhile.
+     * \param destinationPath The directory to extract into, which is created if it doesn't exist.
+     * \param numThreads      (Optional) The number of threads to use, or 0 for the hardware concurrency.
+     * \param verifyCrc32     (Optional) If each extracted file's CRC-32 and size should be checked against the archive's.
+     *
+     * \return  The number of files and bytes extracted and how long it took.
+     * \throws std::runtime_error if an entry can't be extracted, fails verification, or its name escapes destinationPath.
+     */
+    static ExtractionSummary
+    ExtractToDirectory(ZipArchive& zipArchive, const fs::path& destinationPath, size_t numThreads = 0,
+                       bool verifyCrc32 = false);
+    
+    /**
+     * \brief Tests the integrity of every entry of the zip archive, decompressing entries in parallel.
+     *        Each entry is decompressed without being written anywhere, and its CRC-32 and size are checked,
+     *        as are its local file header and data descriptor against its central directory file header.
+     *
+     * \param zipPath    Full pathname of the zip file.
+     * \param numThreads (Optional) The number of threads to use, or 0 for the hardware concurrency.
+     *
+     * \return  What was wrong with each entry, if anything, and how long it took.
+     * \throws std::runtime_error if the archive itself can't be opened.
+     */
+    static TestReport Test(const std::string& zipPath, size_t numThreads = 0);
+    
+    /**
+     * \brief Tests the integrity of every entry of an open zip archive, see Test().
+     *        Encrypted entries are tested with the passwords already set on them.
+     *
+     * \param zipArchive The zip archive to test, which must not be modified meanwhile.
+     * \param numThreads (Optional) The number of threads to use, or 0 for the hardware concurrency.
+     *
+     * \return  What was wrong with each entry, if anything, and how long it took.
+     */
+    static TestReport Test(ZipArchive& zipArchive, size_t numThreads = 0);
+    
     /**
      * \brief Removes the file from the zip archive.
      *
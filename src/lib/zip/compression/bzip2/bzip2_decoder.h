@@ -2,10 +2,14 @@
 #include "../compression_interface.h"
 
 #include "bzip2_decoder_properties.h"
+#include "detail/parallel_bunzip2.h"
 
 #include "../../extlibs/bzip2/bzlib.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
+#include <memory>
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class basic_bzip2_decoder
@@ -32,11 +36,11 @@ class basic_bzip2_decoder
 
     ~basic_bzip2_decoder()
     {
-      if (is_init())
+      if (_bzstreamInit)
       {
         BZ2_bzDecompressEnd(&_bzstream);
-        uninit_buffers();
       }
+      uninit_buffers();
     }
 
     void init(istream_type& stream) override
@@ -50,18 +54,27 @@ class basic_bzip2_decoder
       // init stream
       _stream = &stream;
       _endOfStream = false;
+      _isParallel = false;
 
       // init values
       _inputBufferSize = _outputBufferSize = 0;
       _bytesRead = _bytesWritten = 0;
 
-      // init buffers
+      // init buffers, keeping the ones from the last init if they're the same size
       bzip2_decoder_properties& bzip2Props = static_cast<bzip2_decoder_properties&>(props);
-      _bufferCapacity = bzip2Props.BufferCapacity;
+      if (bzip2Props.BufferCapacity != _bufferCapacity || _inputBuffer == nullptr)
+      {
+        // the output buffer is only allocated by decode_next(), decode_into() doesn't need it
+        uninit_buffers();
+        _bufferCapacity = bzip2Props.BufferCapacity;
+        _inputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
 
-      uninit_buffers();
-      _inputBuffer = new ELEM_TYPE[_bufferCapacity];
-      _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      // bzip2 can't be reset, so the last one has to be ended first
+      if (_bzstreamInit)
+      {
+        BZ2_bzDecompressEnd(&_bzstream);
+      }
 
       // init bzip2
       _bzstream.bzalloc = nullptr;
@@ -75,16 +88,49 @@ class basic_bzip2_decoder
 
       // no verbosity & do not use small memory model
       _lastError = BZ2_bzDecompressInit(&_bzstream, 0, 0);
+      _bzstreamInit = _lastError == BZ_OK;
+    }
+
+    // only supported when decompressing on multiple threads, which needs the whole input to find the blocks
+    bool init(const ELEM_TYPE* input, size_t length, compression_decoder_properties_interface& props) override
+    {
+      bzip2_decoder_properties& bzip2Props = static_cast<bzip2_decoder_properties&>(props);
+      const size_t numThreads = bzip2Props.NumThreads == 0 ? utils::thread::defaultNumThreads() : bzip2Props.NumThreads;
+      if (numThreads == 1)
+      {
+        return false;
+      }
+
+      if (_parallel == nullptr)
+      {
+        _parallel = std::make_unique<detail::parallel_bunzip2>();
+      }
+      if (!_parallel->init(reinterpret_cast<const uint8_t*>(input), length * sizeof(ELEM_TYPE), numThreads))
+      {
+        return false;
+      }
+      _isParallel = true;
+
+      // the output buffer is only allocated by decode_next()
+      if (bzip2Props.BufferCapacity != _bufferCapacity)
+      {
+        uninit_buffers();
+        _bufferCapacity = bzip2Props.BufferCapacity;
+      }
+      _stream = nullptr;
+      _outputBufferSize = 0;
+      _bytesWritten = 0;
+      return true;
     }
 
     bool is_init() const override
     {
-      return (_inputBuffer != nullptr && _outputBuffer != nullptr);
+      return _inputBuffer != nullptr || _isParallel;
     }
 
     size_t get_bytes_read() const override
     {
-      return _bytesRead;
+      return _isParallel ? _parallel->get_bytes_read() : _bytesRead;
     }
 
     size_t get_bytes_written() const override
@@ -104,71 +150,101 @@ class basic_bzip2_decoder
 
     size_t decode_next() override
     {
-      // do not load any data until there
-      // are something left
-      if (_bzstream.avail_out != 0)
+      if (_outputBuffer == nullptr)
       {
-        // if all data has not been fetched and the stream is at the end,
-        // it is an error
-        if (_endOfStream)
-        {
-          return 0;
-        }
+        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
 
-        // read data into buffer
-        read_next();
+      _outputBufferSize = decompress_next(_outputBuffer, _bufferCapacity);
+      return _outputBufferSize;
+    }
 
-        // set input buffer and its size
-        _bzstream.next_in = reinterpret_cast<char*>(_inputBuffer);
-        _bzstream.avail_in = static_cast<unsigned int>(_inputBufferSize);
-      }
+    size_t decode_into(ELEM_TYPE* output, size_t length) override
+    {
+      return decompress_next(output, length);
+    }
 
-      // zstream output
-      _bzstream.next_out = reinterpret_cast<char*>(_outputBuffer);
-      _bzstream.avail_out = static_cast<unsigned int>(_bufferCapacity);
+  private:
+    size_t decompress_next(ELEM_TYPE* output, size_t length)
+    {
+      if (_isParallel)
+      {
+        const size_t n = _parallel->decode(reinterpret_cast<uint8_t*>(output), length * sizeof(ELEM_TYPE)) / sizeof(ELEM_TYPE);
+        _bytesWritten += n;
+        return n;
+      }
 
-      // inflate stream
-      if (!bzip2_suceeded(BZ2_bzDecompress(&_bzstream)))
+      // bzip2 can't take more than an unsigned int of output at once
+      const auto capacity = static_cast<unsigned int>(
+          std::min<size_t>(length, std::numeric_limits<unsigned int>::max()));
+      if (capacity == 0)
       {
         return 0;
       }
 
-      // associate output buffer
-      size_t bytesProcessed = _bufferCapacity - static_cast<size_t>(_bzstream.avail_out);
+      size_t bytesProcessed = 0;
+      do
+      {
+        // do not load any data until there
+        // are something left
+        if (_bzstream.avail_out != 0)
+        {
+          // if all data has not been fetched and the stream is at the end,
+          // it is an error
+          if (_endOfStream)
+          {
+            return 0;
+          }
+
+          // read data into buffer
+          read_next();
+
+          // set input buffer and its size
+          _bzstream.next_in = reinterpret_cast<char*>(_inputBuffer);
+          _bzstream.avail_in = static_cast<unsigned int>(_inputBufferSize);
+        }
 
-      // increase amount of total written bytes
-      _bytesWritten += bytesProcessed;
+        // zstream output
+        _bzstream.next_out = reinterpret_cast<char*>(output);
+        _bzstream.avail_out = capacity;
 
-      if (_lastError == BZ_STREAM_END)
-      {
-        _endOfStream = true;
+        // inflate stream
+        if (!bzip2_suceeded(BZ2_bzDecompress(&_bzstream)))
+        {
+          return 0;
+        }
+
+        // associate output buffer
+        bytesProcessed = capacity - _bzstream.avail_out;
 
-        // if we read more than we should last time, move pointer to the correct position
-        if (_bzstream.avail_in > 0)
+        // increase amount of total written bytes
+        _bytesWritten += bytesProcessed;
+
+        if (_lastError == BZ_STREAM_END)
         {
-          _stream->clear();
-          _stream->seekg(-static_cast<typename istream_type::off_type>(_bzstream.avail_in), std::ios::cur);
+          _endOfStream = true;
+
+          // if we read more than we should last time, move pointer to the correct position
+          if (_bzstream.avail_in > 0)
+          {
+            _stream->clear();
+            _stream->seekg(-static_cast<typename istream_type::off_type>(_bzstream.avail_in), std::ios::cur);
+          }
         }
       }
-
-      _outputBufferSize = bytesProcessed;
+      // a whole block has to be read before any of it is output,
+      // so keep consuming input until we are able to produce some output
+      while (bytesProcessed == 0 && _lastError != BZ_STREAM_END);
 
       // return count of processed bytes from input stream
       return bytesProcessed;
     }
 
-  private:
     void uninit_buffers()
     {
-      if (_inputBuffer != nullptr)
-      {
-        delete[] _inputBuffer;
-      }
-
-      if (_outputBuffer != nullptr)
-      {
-        delete[] _outputBuffer;
-      }
+      delete[] _inputBuffer;
+      delete[] _outputBuffer;
+      _inputBuffer = _outputBuffer = nullptr;
     }
 
     void read_next()
@@ -192,11 +268,15 @@ class basic_bzip2_decoder
     }
 
     bz_stream   _bzstream;        // internal bzip2 structure
+    bool        _bzstreamInit = false;
     int         _lastError;       // last error of bzip2 operation
 
     istream_type* _stream;
     bool       _endOfStream;
 
+    bool _isParallel = false;
+    std::unique_ptr<detail::parallel_bunzip2> _parallel; // kept once it's made, so it can be reused
+
     size_t     _bufferCapacity;
     size_t     _inputBufferSize;  // how many bytes are read in the input buffer
     size_t     _outputBufferSize; // how many bytes are written in the output buffer
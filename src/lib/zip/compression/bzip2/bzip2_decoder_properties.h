@@ -6,6 +6,7 @@ struct bzip2_decoder_properties
 {
   bzip2_decoder_properties()
     : BufferCapacity(1 << 15)
+    , NumThreads(1)
   {
 
   }
@@ -16,4 +17,5 @@ struct bzip2_decoder_properties
   }
 
   size_t BufferCapacity;
+  size_t NumThreads;     // more than 1 (or 0 for the hardware concurrency) decompresses blocks in parallel from memory
 };
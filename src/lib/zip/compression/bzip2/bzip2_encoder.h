@@ -2,10 +2,12 @@
 #include "../compression_interface.h"
 
 #include "bzip2_encoder_properties.h"
+#include "detail/parallel_bzip2.h"
 
 #include "../../extlibs/bzip2/bzlib.h"
 
 #include <cstdint>
+#include <memory>
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class basic_bzip2_encoder
@@ -29,11 +31,11 @@ class basic_bzip2_encoder
 
     ~basic_bzip2_encoder()
     {
-      if (is_init())
+      if (_bzstreamInit)
       {
         BZ2_bzCompressEnd(&_bzstream);
-        uninit_buffers();
       }
+      uninit_buffers();
     }
 
     void init(ostream_type& stream) override
@@ -50,13 +52,33 @@ class basic_bzip2_encoder
       // init values
       _bytesRead = _bytesWritten = 0;
 
-      // init buffers
       bzip2_encoder_properties& bz2Props = static_cast<bzip2_encoder_properties&>(props);
-      _bufferCapacity = bz2Props.BufferCapacity;
+      _isParallel = bz2Props.NumThreads != 1;
+      if (_isParallel)
+      {
+        if (_parallel == nullptr)
+        {
+          _parallel = std::make_unique<detail::parallel_bzip2>();
+        }
+        _parallel->init(bz2Props.BlockSize, bz2Props.WorkFactor, bz2Props.NumThreads);
+        _parallelFinished = false;
+        return;
+      }
 
-      uninit_buffers();
-      _inputBuffer = new ELEM_TYPE[_bufferCapacity];
-      _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      // init buffers, keeping the ones from the last init if they're the same size
+      if (bz2Props.BufferCapacity != _bufferCapacity || _inputBuffer == nullptr)
+      {
+        uninit_buffers();
+        _bufferCapacity = bz2Props.BufferCapacity;
+        _inputBuffer = new ELEM_TYPE[_bufferCapacity];
+        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
+
+      // bzip2 can't be reset, so the last one has to be ended first
+      if (_bzstreamInit)
+      {
+        BZ2_bzCompressEnd(&_bzstream);
+      }
 
       // init bzip2
       _bzstream.bzalloc = nullptr;
@@ -69,6 +91,7 @@ class basic_bzip2_encoder
       _bzstream.avail_out = 0;
 
       _lastError = BZ2_bzCompressInit(&_bzstream, bz2Props.BlockSize, 0, bz2Props.WorkFactor);
+      _bzstreamInit = _lastError == BZ_OK;
     }
 
     bool is_init() const override
@@ -88,16 +111,40 @@ class basic_bzip2_encoder
 
     ELEM_TYPE* get_buffer_begin() override
     {
+      if (_isParallel)
+      {
+        return reinterpret_cast<ELEM_TYPE*>(_parallel->get_input());
+      }
       return _inputBuffer;
     }
 
     ELEM_TYPE* get_buffer_end() override
     {
+      if (_isParallel)
+      {
+        return get_buffer_begin() + _parallel->get_capacity() / sizeof(ELEM_TYPE);
+      }
       return _inputBuffer + _bufferCapacity;
     }
 
+    bool has_crc32() const override
+    {
+      return _isParallel;
+    }
+
+    uint32_t get_crc32() const override
+    {
+      return _isParallel ? _parallel->get_crc32() : 0;
+    }
+
     void encode_next(size_t length) override
     {
+      if (_isParallel)
+      {
+        encode_next_parallel(length);
+        return;
+      }
+
       // set the input buffer
       _bzstream.next_in = reinterpret_cast<char*>(_inputBuffer);
       _bzstream.avail_in = static_cast<unsigned int>(length);
@@ -131,6 +178,25 @@ class basic_bzip2_encoder
     }
 
   private:
+    void encode_next_parallel(size_t length)
+    {
+      // the stream is flushed again when it's destroyed, after it's already finished
+      if (_parallelFinished)
+      {
+        return;
+      }
+
+      const size_t byteLength = length * sizeof(ELEM_TYPE);
+      _bytesRead += length;
+      _parallelFinished = byteLength < _parallel->get_capacity();
+
+      _parallel->compress(byteLength, _parallelFinished, [this](const uint8_t* data, size_t size)
+      {
+        _stream->write(reinterpret_cast<const ELEM_TYPE*>(data), size / sizeof(ELEM_TYPE));
+        _bytesWritten += size / sizeof(ELEM_TYPE);
+      });
+    }
+
     void uninit_buffers()
     {
       if (_inputBuffer != nullptr)
@@ -142,6 +208,8 @@ class basic_bzip2_encoder
       {
         delete[] _outputBuffer;
       }
+
+      _inputBuffer = _outputBuffer = nullptr;
     }
 
     bool bzip2_suceeded(int errorCode)
@@ -150,10 +218,15 @@ class basic_bzip2_encoder
     }
 
     bz_stream _bzstream;        // internal bzip2 structure
+    bool      _bzstreamInit = false;
     int       _lastError;       // last error of bzip2 operation
 
     ostream_type* _stream;
 
+    bool _isParallel = false;
+    bool _parallelFinished = false;
+    std::unique_ptr<detail::parallel_bzip2> _parallel; // kept once it's made, so it can be reused
+
     size_t     _bufferCapacity;
     ELEM_TYPE* _inputBuffer;      // pointer to the start of the input buffer
     ELEM_TYPE* _outputBuffer;     // pointer to the start of the output buffer
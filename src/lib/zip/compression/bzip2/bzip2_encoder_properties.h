@@ -10,6 +10,7 @@ struct bzip2_encoder_properties
     : BufferCapacity(1 << 15)
     , BlockSize(6)
     , WorkFactor(30)
+    , NumThreads(1)
   {
 
   }
@@ -23,4 +24,5 @@ struct bzip2_encoder_properties
   size_t  BufferCapacity;
   int     BlockSize;
   int     WorkFactor;
+  size_t  NumThreads;     // more than 1 (or 0 for the hardware concurrency) compresses blocks in parallel
 };
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace detail
+{
+  /**
+   * \brief Reading and writing the bit-packed parts of a bzip2 stream.
+   *        A stream is "BZh" and the block size digit, then blocks that each start with BlockMagic and their CRC,
+   *        then EndMagic, the combined CRC of all the blocks, and padding to a whole byte.
+   *        The blocks are packed together bit by bit, so they don't start on byte boundaries.
+   */
+  namespace bzip2_bits
+  {
+    constexpr uint64_t BlockMagic = 0x314159265359;
+    constexpr uint64_t EndMagic   = 0x177245385090;
+    constexpr unsigned MagicBits  = 48;
+    constexpr unsigned HeaderBits = 32;
+
+    // reads count (at most 64) bits at a bit position, most significant bit first, like bzip2 packs them
+    inline uint64_t read(const uint8_t* data, uint64_t position, unsigned count)
+    {
+      uint64_t value = 0;
+      for (unsigned i = 0; i < count; i++, position++)
+      {
+        value = value << 1 | ((data[position >> 3] >> (7 - (position & 7))) & 1);
+      }
+      return value;
+    }
+
+    // the CRC of the whole stream from the CRC of the blocks before and the CRC of the next block
+    inline uint32_t combine_crc(uint32_t streamCrc, uint32_t blockCrc)
+    {
+      return ((streamCrc << 1) | (streamCrc >> 31)) ^ blockCrc;
+    }
+
+    class writer
+    {
+      public:
+        writer()
+          : _bits(0)
+          , _bitCount(0)
+        {
+
+        }
+
+        // the whole bytes written so far
+        const std::vector<uint8_t>& get_bytes() const
+        {
+          return _bytes;
+        }
+
+        // forgets the whole bytes, but keeps the bits of the last partial byte
+        void clear_bytes()
+        {
+          _bytes.clear();
+        }
+
+        void reset()
+        {
+          _bytes.clear();
+          _bits = 0;
+          _bitCount = 0;
+        }
+
+        // writes the low count (at most 32) bits of value
+        void put(uint64_t value, unsigned count)
+        {
+          _bits = (_bits << count) | (value & ((uint64_t(1) << count) - 1));
+          _bitCount += count;
+          while (_bitCount >= 8)
+          {
+            _bitCount -= 8;
+            _bytes.push_back(static_cast<uint8_t>(_bits >> _bitCount));
+          }
+        }
+
+        void put_magic(uint64_t magic)
+        {
+          put(magic >> 24, 24);
+          put(magic, 24);
+        }
+
+        // copies count bits of data starting at a bit position
+        void put_bits(const uint8_t* data, uint64_t position, uint64_t count)
+        {
+          const uint8_t* const bytes = data + (position >> 3);
+          const unsigned shift = position & 7;
+          const uint64_t byteCount = count >> 3;
+          _bytes.reserve(_bytes.size() + byteCount + 1);
+          for (uint64_t i = 0; i < byteCount; i++)
+          {
+            put(shift == 0 ? bytes[i] : (bytes[i] << shift | bytes[i + 1] >> (8 - shift)), 8);
+          }
+          const unsigned rest = count & 7;
+          if (rest != 0)
+          {
+            put(read(data, position + (byteCount << 3), rest), rest);
+          }
+        }
+
+        // pads the last partial byte with zeros
+        void flush()
+        {
+          if (_bitCount != 0)
+          {
+            put(0, 8 - _bitCount);
+          }
+        }
+
+      private:
+        std::vector<uint8_t> _bytes;
+        uint64_t _bits;     // the last _bitCount bits are still to be written
+        unsigned _bitCount;
+    };
+  }
+}
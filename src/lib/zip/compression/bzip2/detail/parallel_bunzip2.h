@@ -0,0 +1,339 @@
+#pragma once
+#include "bzip2_bits.h"
+
+#include "../../../extlibs/bzip2/bzlib.h"
+#include "../../../utils/thread_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace detail
+{
+  /**
+   * \brief Decompresses a bzip2 stream in memory on multiple threads.
+   *        The blocks are found by scanning for their magic number bit by bit,
+   *        and each one is decompressed on its own as a stream of just that block.
+   *        That checks each block's CRC, and the CRCs of all the blocks are checked against the stream's CRC at the end.
+   *        The magic number could also be in the middle of a block by chance,
+   *        but then that piece of it fails to decompress and is tried again with the piece after it.
+   */
+  class parallel_bunzip2
+  {
+    public:
+      // how many pieces a block is split into by fake magic numbers at most, which is only ever 1 in practice
+      static constexpr size_t MaxPiecesPerBlock = 8;
+
+      parallel_bunzip2()
+        : _input(nullptr)
+        , _inputBits(0)
+        , _blockSizeDigit(0)
+        , _numThreads(0)
+        , _position(0)
+        , _endPosition(NoPosition)
+        , _streamCrc(0)
+        , _isFinished(false)
+        , _hasFailed(false)
+        , _current(0)
+        , _currentOffset(0)
+      {
+
+      }
+
+      parallel_bunzip2(const parallel_bunzip2& other) = delete;
+
+      parallel_bunzip2& operator=(const parallel_bunzip2& other) = delete;
+
+      /**
+       * \brief Starts decompressing a stream, reusing the buffers of the last one.
+       *
+       * \param numThreads  The number of threads to decompress on, or 0 for the hardware concurrency.
+       * \return  false if it's not a bzip2 stream.
+       */
+      bool init(const uint8_t* input, size_t length, size_t numThreads)
+      {
+        if (length < 4 || std::memcmp(input, "BZh", 3) != 0 || input[3] < '1' || input[3] > '9')
+        {
+          return false;
+        }
+
+        if (numThreads == 0)
+        {
+          numThreads = utils::thread::defaultNumThreads();
+        }
+        _numThreads = numThreads;
+        _workers.resize(_numThreads);
+
+        _input = input;
+        _inputBits = static_cast<uint64_t>(length) * 8;
+        _blockSizeDigit = input[3];
+        _position = bzip2_bits::HeaderBits;
+        _endPosition = NoPosition;
+        _streamCrc = 0;
+        _isFinished = false;
+        _hasFailed = false;
+        _pieces.clear();
+        _blocks.clear();
+        _current = 0;
+        _currentOffset = 0;
+        return true;
+      }
+
+      // how much of the input has been decompressed
+      size_t get_bytes_read() const
+      {
+        return static_cast<size_t>((_position + 7) / 8);
+      }
+
+      /**
+       * \brief Decompresses as much as fits in output, stopping early only at the end of the stream or on an error.
+       */
+      size_t decode(uint8_t* output, size_t length)
+      {
+        size_t produced = 0;
+        while (produced < length)
+        {
+          if (_current < _blocks.size())
+          {
+            const auto& worker = _workers[_blocks[_current].worker];
+            const size_t n = std::min(length - produced, worker.outputLength - _currentOffset);
+            std::memcpy(output + produced, worker.output.data() + _currentOffset, n);
+            produced += n;
+            _currentOffset += n;
+            if (_currentOffset == worker.outputLength)
+            {
+              _current++;
+              _currentOffset = 0;
+            }
+            continue;
+          }
+
+          if (_isFinished || _hasFailed || !decode_next_blocks())
+          {
+            break;
+          }
+        }
+        return produced;
+      }
+
+    private:
+      static constexpr uint64_t NoPosition = std::numeric_limits<uint64_t>::max();
+
+      // bit positions of a block, from its magic number to the next magic number
+      struct block
+      {
+        uint64_t begin;
+        uint64_t end;
+        size_t worker;
+      };
+
+      struct worker
+      {
+        bzip2_bits::writer stream; // a whole stream with just the block
+        std::vector<uint8_t> output;
+        size_t outputLength = 0;
+        uint32_t crc = 0;
+        bool succeeded = false;
+      };
+
+      /**
+       * \brief Finds the next block magic number or end of stream magic number at or after a bit position.
+       *
+       * \return  NoPosition if there isn't one.
+       */
+      uint64_t find_magic(uint64_t position)
+      {
+        constexpr uint64_t mask = (uint64_t(1) << bzip2_bits::MagicBits) - 1;
+        if (position + bzip2_bits::MagicBits > _inputBits)
+        {
+          return NoPosition;
+        }
+        uint64_t window = bzip2_bits::read(_input, position, bzip2_bits::MagicBits - 1);
+        for (uint64_t i = position + bzip2_bits::MagicBits - 1; i < _inputBits; i++)
+        {
+          window = ((window << 1) | ((_input[i >> 3] >> (7 - (i & 7))) & 1)) & mask;
+          if (window == bzip2_bits::BlockMagic || window == bzip2_bits::EndMagic)
+          {
+            const uint64_t magic = i + 1 - bzip2_bits::MagicBits;
+            if (window == bzip2_bits::EndMagic)
+            {
+              _endPosition = magic;
+            }
+            return magic;
+          }
+        }
+        return NoPosition;
+      }
+
+      void decode_block(worker& worker, uint64_t begin, uint64_t end)
+      {
+        worker.outputLength = 0;
+        worker.succeeded = false;
+        if (end - begin < bzip2_bits::MagicBits + 32)
+        {
+          return;
+        }
+        worker.crc = static_cast<uint32_t>(bzip2_bits::read(_input, begin + bzip2_bits::MagicBits, 32));
+
+        // the block's stream has the same header, and the block's CRC is the CRC of the whole stream
+        auto& stream = worker.stream;
+        stream.reset();
+        stream.put('B', 8);
+        stream.put('Z', 8);
+        stream.put('h', 8);
+        stream.put(_blockSizeDigit, 8);
+        stream.put_bits(_input, begin, end - begin);
+        stream.put_magic(bzip2_bits::EndMagic);
+        stream.put(worker.crc, 32);
+        stream.flush();
+
+        bz_stream bzstream = {};
+        if (BZ2_bzDecompressInit(&bzstream, 0, 0) != BZ_OK)
+        {
+          return;
+        }
+        const auto& bytes = stream.get_bytes();
+        bzstream.next_in = const_cast<char*>(reinterpret_cast<const char*>(bytes.data()));
+        bzstream.avail_in = static_cast<unsigned int>(bytes.size());
+
+        // a block decompresses to at least about its block size, but runs can make it much bigger
+        worker.output.resize(std::max<size_t>(worker.output.size(), (_blockSizeDigit - '0') * 100000));
+        int result;
+        do
+        {
+          if (worker.outputLength == worker.output.size())
+          {
+            worker.output.resize(worker.output.size() * 2);
+          }
+          bzstream.next_out = reinterpret_cast<char*>(worker.output.data() + worker.outputLength);
+          bzstream.avail_out = static_cast<unsigned int>(std::min<size_t>(
+              worker.output.size() - worker.outputLength, std::numeric_limits<unsigned int>::max()));
+          const unsigned int availableOutput = bzstream.avail_out;
+          result = BZ2_bzDecompress(&bzstream);
+          worker.outputLength += availableOutput - bzstream.avail_out;
+
+          // truncated if it's stuck without filling the output
+          if (result == BZ_OK && bzstream.avail_in == 0 && bzstream.avail_out != 0)
+          {
+            result = BZ_DATA_ERROR;
+          }
+        }
+        while (result == BZ_OK);
+        BZ2_bzDecompressEnd(&bzstream);
+
+        worker.succeeded = result == BZ_STREAM_END;
+      }
+
+      // finds and decompresses a block for each thread
+      bool decode_next_blocks()
+      {
+        _pieces.clear();
+        _blocks.clear();
+        _current = 0;
+        _currentOffset = 0;
+
+        uint64_t begin = _position;
+        if (begin != _endPosition)
+        {
+          // an empty stream ends right after the header
+          const uint64_t magic = begin + bzip2_bits::MagicBits <= _inputBits
+                                 ? bzip2_bits::read(_input, begin, bzip2_bits::MagicBits) : 0;
+          if (magic == bzip2_bits::EndMagic)
+          {
+            _endPosition = begin;
+          }
+          else if (magic != bzip2_bits::BlockMagic)
+          {
+            return fail();
+          }
+          while (_pieces.size() < _numThreads && begin != _endPosition)
+          {
+            const uint64_t end = find_magic(begin + bzip2_bits::MagicBits);
+            if (end == NoPosition)
+            {
+              return fail();
+            }
+            _pieces.push_back({begin, end, _pieces.size()});
+            begin = end;
+          }
+        }
+
+        utils::thread::parallelFor(_pieces.size(), _numThreads, [&](size_t i)
+        {
+          decode_block(_workers[i], _pieces[i].begin, _pieces[i].end);
+        });
+
+        for (size_t i = 0; i < _pieces.size();)
+        {
+          auto block = _pieces[i];
+          auto& worker = _workers[block.worker];
+          size_t next = i + 1;
+
+          // a fake magic number in the middle of the block split it, so try it with the piece after it
+          for (size_t pieces = 1; !worker.succeeded; pieces++)
+          {
+            if (block.end == _endPosition || pieces == MaxPiecesPerBlock)
+            {
+              return fail();
+            }
+            block.end = find_magic(block.end + bzip2_bits::MagicBits);
+            if (block.end == NoPosition)
+            {
+              return fail();
+            }
+            decode_block(worker, block.begin, block.end);
+            while (next < _pieces.size() && _pieces[next].begin < block.end)
+            {
+              next++;
+            }
+          }
+
+          _streamCrc = bzip2_bits::combine_crc(_streamCrc, worker.crc);
+          _blocks.push_back(block);
+          i = next;
+        }
+        if (!_blocks.empty())
+        {
+          _position = _blocks.back().end;
+        }
+
+        if (_position == _endPosition)
+        {
+          if (_position + bzip2_bits::MagicBits + 32 > _inputBits
+              || bzip2_bits::read(_input, _position + bzip2_bits::MagicBits, 32) != _streamCrc)
+          {
+            return fail();
+          }
+          _position += bzip2_bits::MagicBits + 32;
+          _isFinished = true;
+        }
+        return true;
+      }
+
+      bool fail()
+      {
+        _blocks.clear();
+        _hasFailed = true;
+        return false;
+      }
+
+      const uint8_t* _input;
+      uint64_t _inputBits;
+      uint8_t  _blockSizeDigit;
+      size_t   _numThreads;
+
+      uint64_t _position;    // of the next block, or the end of stream magic number
+      uint64_t _endPosition; // of the end of stream magic number once it's been found
+      uint32_t _streamCrc;
+      bool     _isFinished;
+      bool     _hasFailed;
+
+      std::vector<block>  _pieces;  // where the magic numbers are, which are almost always whole blocks
+      std::vector<block>  _blocks;  // the blocks that were decompressed, in order
+      std::vector<worker> _workers; // one for each piece
+      size_t _current;              // the block being copied to the output
+      size_t _currentOffset;
+  };
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include "bzip2_bits.h"
+
+#include "../../../extlibs/bzip2/bzlib.h"
+#include "../../../utils/crc32_utils.h"
+#include "../../../utils/thread_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace detail
+{
+  /**
+   * \brief Compresses a bzip2 stream on multiple threads, like lbzip2.
+   *        The input is split into chunks that each fit in one bzip2 block,
+   *        which are compressed independently as streams of their own,
+   *        and then their blocks are spliced together bit by bit into one stream with the combined CRC of them all,
+   *        so it's a single ordinary bzip2 stream.
+   *        Where the chunks end only depends on the block size, so the output is the same however many threads it has,
+   *        though bzip2_encoder on 1 thread doesn't use this, and fills whole blocks instead.
+   */
+  class parallel_bzip2
+  {
+    public:
+      parallel_bzip2()
+        : _blockSize(0)
+        , _workFactor(0)
+        , _numThreads(0)
+        , _chunkSize(0)
+        , _streamCrc(0)
+        , _crc32(0)
+      {
+
+      }
+
+      parallel_bzip2(const parallel_bzip2& other) = delete;
+
+      parallel_bzip2& operator=(const parallel_bzip2& other) = delete;
+
+      /**
+       * \brief Starts a new stream, reusing the buffers of the last one if the properties are the same.
+       *
+       * \param blockSize   From 1 to 9, in 100 kB.
+       * \param numThreads  The number of threads to compress on, or 0 for the hardware concurrency.
+       */
+      void init(int blockSize, int workFactor, size_t numThreads)
+      {
+        if (numThreads == 0)
+        {
+          numThreads = utils::thread::defaultNumThreads();
+        }
+
+        // bzip2 fills a block with the input after run-length encoding runs of 4 or more bytes,
+        // which makes it at most 5/4 as big, so a chunk this big never spills over into a second block
+        const size_t chunkSize = (static_cast<size_t>(blockSize) * 100000 - 19) / 5 * 4;
+
+        if (numThreads != _numThreads || chunkSize != _chunkSize)
+        {
+          _numThreads = numThreads;
+          _chunkSize = chunkSize;
+          _buffer = std::make_unique<uint8_t[]>(get_capacity());
+          _workers.resize(_numThreads);
+        }
+        _blockSize = blockSize;
+        _workFactor = workFactor;
+
+        _writer.reset();
+        _writer.put('B', 8);
+        _writer.put('Z', 8);
+        _writer.put('h', 8);
+        _writer.put('0' + _blockSize, 8);
+        _streamCrc = 0;
+        _crc32 = 0;
+      }
+
+      // where to put the next input
+      uint8_t* get_input()
+      {
+        return _buffer.get();
+      }
+
+      // how much input to put there before compressing it
+      size_t get_capacity() const
+      {
+        return _chunkSize * _numThreads;
+      }
+
+      // of all the input so far
+      uint32_t get_crc32() const
+      {
+        return _crc32;
+      }
+
+      /**
+       * \brief Compresses the next length bytes of input, and writes what they compress to.
+       *
+       * \param finish  If this is the end of the input, so the end of the stream is written too.
+       * \param write   Called with the compressed data, as write(data, length).
+       * \return  false if bzip2 failed.
+       */
+      template <typename WRITE>
+      bool compress(size_t length, bool finish, WRITE&& write)
+      {
+        const size_t numChunks = (length + _chunkSize - 1) / _chunkSize;
+
+        const auto* const input = get_input();
+        utils::thread::parallelFor(numChunks, _numThreads, [&](size_t i)
+        {
+          const size_t offset = i * _chunkSize;
+          compress_chunk(_workers[i], input + offset, std::min(_chunkSize, length - offset));
+        });
+
+        bool succeeded = true;
+        for (size_t i = 0; i < numChunks; i++)
+        {
+          auto& worker = _workers[i];
+          succeeded = succeeded && worker.succeeded;
+          _writer.put_bits(worker.output.data(), bzip2_bits::HeaderBits, worker.blockBits);
+          _streamCrc = bzip2_bits::combine_crc(_streamCrc, worker.blockCrc);
+          _crc32 = utils::crc32::combine(_crc32, worker.crc32, worker.inputLength);
+        }
+
+        if (finish)
+        {
+          _writer.put_magic(bzip2_bits::EndMagic);
+          _writer.put(_streamCrc, 32);
+          _writer.flush();
+        }
+
+        const auto& bytes = _writer.get_bytes();
+        write(bytes.data(), bytes.size());
+        _writer.clear_bytes();
+        return succeeded;
+      }
+
+    private:
+      struct worker
+      {
+        size_t inputLength = 0;
+        uint32_t crc32 = 0;
+        std::vector<uint8_t> output; // a whole stream with just one block
+        uint64_t blockBits = 0;      // the length of the block in it, which starts right after the header
+        uint32_t blockCrc = 0;
+        bool succeeded = false;
+      };
+
+      void compress_chunk(worker& worker, const uint8_t* chunk, size_t length)
+      {
+        worker.inputLength = length;
+        worker.crc32 = utils::crc32::update(0, chunk, length);
+        worker.blockBits = 0;
+        worker.blockCrc = 0;
+        worker.succeeded = false;
+
+        // bzip2 can't be reset, so each chunk gets a new one
+        bz_stream bzstream = {};
+        if (BZ2_bzCompressInit(&bzstream, _blockSize, 0, _workFactor) != BZ_OK)
+        {
+          return;
+        }
+
+        // enough for the chunk, almost always
+        worker.output.resize(std::max(worker.output.size(), length + length / 100 + 600));
+
+        bzstream.next_in = const_cast<char*>(reinterpret_cast<const char*>(chunk));
+        bzstream.avail_in = static_cast<unsigned int>(length);
+        size_t outputLength = 0;
+        int result;
+        do
+        {
+          if (outputLength == worker.output.size())
+          {
+            worker.output.resize(worker.output.size() * 2);
+          }
+          bzstream.next_out = reinterpret_cast<char*>(worker.output.data() + outputLength);
+          bzstream.avail_out = static_cast<unsigned int>(worker.output.size() - outputLength);
+          result = BZ2_bzCompress(&bzstream, BZ_FINISH);
+          outputLength = worker.output.size() - bzstream.avail_out;
+        }
+        while (result == BZ_FINISH_OK);
+        BZ2_bzCompressEnd(&bzstream);
+
+        if (result != BZ_STREAM_END)
+        {
+          return;
+        }
+
+        // an empty chunk would have no block, but there aren't any
+        const auto* const data = worker.output.data();
+        const uint64_t bits = static_cast<uint64_t>(outputLength) * 8;
+        if (bits < bzip2_bits::HeaderBits + 2 * (bzip2_bits::MagicBits + 32))
+        {
+          return;
+        }
+        worker.blockCrc = static_cast<uint32_t>(bzip2_bits::read(data, bzip2_bits::HeaderBits + bzip2_bits::MagicBits, 32));
+
+        // the block ends where the end of stream magic is, before the stream's CRC (the same as the block's) and the padding
+        for (unsigned padding = 0; padding < 8; padding++)
+        {
+          const uint64_t end = bits - padding - 32 - bzip2_bits::MagicBits;
+          if (bzip2_bits::read(data, end, bzip2_bits::MagicBits) == bzip2_bits::EndMagic
+              && bzip2_bits::read(data, end + bzip2_bits::MagicBits, 32) == worker.blockCrc)
+          {
+            worker.blockBits = end - bzip2_bits::HeaderBits;
+            worker.succeeded = true;
+            return;
+          }
+        }
+      }
+
+      int    _blockSize;
+      int    _workFactor;
+      size_t _numThreads;
+      size_t _chunkSize;
+
+      std::unique_ptr<uint8_t[]> _buffer; // the input
+      std::vector<worker> _workers;       // one for each chunk of the input
+
+      bzip2_bits::writer _writer;
+      uint32_t _streamCrc;
+      uint32_t _crc32;
+  };
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <cstdint>
 #include <algorithm>
 
 struct compression_properties_interface
@@ -53,6 +54,11 @@ class compression_encoder_interface_basic
     virtual void init(ostream_type& stream, compression_encoder_properties_interface& props) = 0;
     virtual void encode_next(size_t length) = 0;
     virtual void sync() = 0;
+
+    // if the encoder computes the CRC-32 of its input itself, i.e. when it splits it up to compress it in parallel,
+    // so it doesn't have to be computed again, which is only known after init()
+    virtual bool has_crc32() const { return false; }
+    virtual uint32_t get_crc32() const { return 0; }
 };
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
@@ -66,6 +72,27 @@ class compression_decoder_interface_basic
     virtual void init(istream_type& stream) = 0;
     virtual void init(istream_type& stream, compression_decoder_properties_interface& props) = 0;
     virtual size_t decode_next() = 0;
+
+    /**
+     * \brief Decodes the next bytes straight into output instead of into the decoder's own buffer,
+     *        which then isn't even allocated.
+     *        Don't mix with decode_next() on the same stream.
+     *
+     * \return how many bytes were decoded, at most length, or 0 at the end of the stream or on an error.
+     */
+    virtual size_t decode_into(ELEM_TYPE* output, size_t length) = 0;
+
+    /**
+     * \brief Initializes the decoder to read its whole input directly from memory
+     *        (e.g. a memory mapped archive) instead of copying it out of a stream.
+     *
+     * \return false if the decoder doesn't support memory input, in which case it is left uninitialized.
+     */
+    virtual bool init(const ELEM_TYPE* input [[maybe_unused]], size_t length [[maybe_unused]],
+                      compression_decoder_properties_interface& props [[maybe_unused]])
+    {
+      return false;
+    }
 };
 
 typedef compression_interface_basic<uint8_t, std::char_traits<uint8_t>>           byte_compression_interface;
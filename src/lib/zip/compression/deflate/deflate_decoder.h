@@ -5,7 +5,9 @@
 
 #include "../../extlibs/zlib/zlib.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class basic_deflate_decoder
@@ -18,6 +20,7 @@ class basic_deflate_decoder
     basic_deflate_decoder()
       : _lastError(Z_OK)
       , _stream(nullptr)
+      , _memoryInput(nullptr)
       , _endOfStream(false)
       , _bufferCapacity(0)
       , _inputBufferSize(0)
@@ -32,11 +35,11 @@ class basic_deflate_decoder
 
     ~basic_deflate_decoder()
     {
-      if (is_init())
+      if (_zstreamInit)
       {
         inflateEnd(&_zstream);
-        uninit_buffers();
       }
+      uninit_buffers();
     }
 
     void init(istream_type& stream) override
@@ -49,36 +52,83 @@ class basic_deflate_decoder
     {
       // init stream
       _stream = &stream;
+      _memoryInput = nullptr;
+
+      init_buffers(props, true);
+      init_zstream();
+    }
+
+    bool init(const ELEM_TYPE* input, size_t length, compression_decoder_properties_interface& props) override
+    {
+      // the whole input is already in memory,
+      // so inflate straight from it without an input buffer
+      _stream = nullptr;
+      _memoryInput = input;
+      _inputBufferSize = length;
+
+      init_buffers(props, false);
+      init_zstream();
+      return true;
+    }
+
+  private:
+    void init_buffers(compression_decoder_properties_interface& props, bool needsInputBuffer)
+    {
       _endOfStream = false;
 
       // init values
-      _inputBufferSize = _outputBufferSize = 0;
+      _outputBufferSize = 0;
       _bytesRead = _bytesWritten = 0;
+      if (needsInputBuffer)
+      {
+        _inputBufferSize = 0;
+      }
 
-      // init buffers
+      // init buffers, keeping the ones from the last init if they're the same size
       deflate_decoder_properties& deflateProps = static_cast<deflate_decoder_properties&>(props);
-      _bufferCapacity = deflateProps.BufferCapacity;
-
-      uninit_buffers();
-      _inputBuffer = new ELEM_TYPE[_bufferCapacity];
-      _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      if (deflateProps.BufferCapacity != _bufferCapacity)
+      {
+        uninit_buffers();
+        _bufferCapacity = deflateProps.BufferCapacity;
+      }
 
-      // init deflate
-      _zstream.zalloc = nullptr;
-      _zstream.zfree = nullptr;
-      _zstream.opaque = nullptr;
+      // the output buffer is only allocated by decode_next(), decode_into() doesn't need it
+      if (needsInputBuffer && _inputBuffer == nullptr)
+      {
+        _inputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
+    }
 
+    void init_zstream()
+    {
       _zstream.next_in = nullptr;
       _zstream.next_out = nullptr;
       _zstream.avail_in = 0;
       _zstream.avail_out = uInt(-1); // force first load of data
 
-      inflateInit2(&_zstream, -MAX_WBITS);
+      // reset the inflate state from the last init instead of reallocating it
+      if (_zstreamInit)
+      {
+        _zstreamInit = inflateReset(&_zstream) == Z_OK;
+        if (_zstreamInit)
+        {
+          return;
+        }
+        inflateEnd(&_zstream);
+      }
+
+      // init deflate
+      _zstream.zalloc = nullptr;
+      _zstream.zfree = nullptr;
+      _zstream.opaque = nullptr;
+
+      _zstreamInit = inflateInit2(&_zstream, -MAX_WBITS) == Z_OK;
     }
 
+  public:
     bool is_init() const override
     {
-      return (_inputBuffer != nullptr && _outputBuffer != nullptr);
+      return _zstreamInit && _bufferCapacity != 0;
     }
 
     size_t get_bytes_read() const override
@@ -103,6 +153,30 @@ class basic_deflate_decoder
 
     size_t decode_next() override
     {
+      if (_outputBuffer == nullptr)
+      {
+        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
+
+      _outputBufferSize = inflate_next(_outputBuffer, _bufferCapacity);
+      return _outputBufferSize;
+    }
+
+    size_t decode_into(ELEM_TYPE* output, size_t length) override
+    {
+      return inflate_next(output, length);
+    }
+
+  private:
+    size_t inflate_next(ELEM_TYPE* output, size_t length)
+    {
+      // zlib can't take more than a uInt of output at once
+      const auto capacity = static_cast<uInt>(std::min<size_t>(length, std::numeric_limits<uInt>::max()));
+      if (capacity == 0)
+      {
+        return 0;
+      }
+
       size_t bytesProcessed = 0;
       do
       {
@@ -117,17 +191,32 @@ class basic_deflate_decoder
             return 0;
           }
 
-          // read data into buffer
-          read_next();
+          if (_memoryInput != nullptr)
+          {
+            // hand zlib the input straight from memory, a uInt of it at a time,
+            // so Zip64 entries of 4 GiB or more aren't cut short
+            const auto slice = std::min<size_t>(_inputBufferSize, std::numeric_limits<uInt>::max());
+            _zstream.next_in = reinterpret_cast<Bytef*>(const_cast<ELEM_TYPE*>(_memoryInput));
+            _zstream.avail_in = static_cast<uInt>(slice);
+            _memoryInput += slice;
+            _inputBufferSize -= slice;
+            _bytesRead += slice;
+            _endOfStream = _inputBufferSize == 0;
+          }
+          else
+          {
+            // read data into buffer
+            read_next();
 
-          // set input buffer and its size
-          _zstream.next_in = reinterpret_cast<Bytef*>(_inputBuffer);
-          _zstream.avail_in = static_cast<uInt>(_inputBufferSize);
+            // set input buffer and its size
+            _zstream.next_in = reinterpret_cast<Bytef*>(_inputBuffer);
+            _zstream.avail_in = static_cast<uInt>(_inputBufferSize);
+          }
         }
 
         // zstream output
-        _zstream.next_out = reinterpret_cast<Bytef*>(_outputBuffer);
-        _zstream.avail_out = static_cast<uInt>(_bufferCapacity);
+        _zstream.next_out = reinterpret_cast<Bytef*>(output);
+        _zstream.avail_out = capacity;
 
         // inflate stream
         if (!zlib_suceeded(inflate(&_zstream, Z_NO_FLUSH)))
@@ -136,7 +225,7 @@ class basic_deflate_decoder
         }
 
         // associate output buffer
-        bytesProcessed += _bufferCapacity - static_cast<size_t>(_zstream.avail_out);
+        bytesProcessed += capacity - _zstream.avail_out;
 
         // increase amount of total written bytes
         _bytesWritten += bytesProcessed;
@@ -146,34 +235,25 @@ class basic_deflate_decoder
           _endOfStream = true;
 
           // if we read more than we should last time, move pointer to the correct position
-          if (_zstream.avail_in > 0)
+          if (_zstream.avail_in > 0 && _stream != nullptr)
           {
             _stream->clear();
             _stream->seekg(-static_cast<typename istream_type::off_type>(_zstream.avail_in), std::ios::cur);
           }
         }
-
-        _outputBufferSize = bytesProcessed;
       }
       // Keep consuming input until we are able to produce some output
-      while (_zstream.avail_out == static_cast<uInt>(_bufferCapacity));
+      while (_zstream.avail_out == capacity);
 
       // return count of processed bytes from input stream
       return bytesProcessed;
     }
 
-  private:
     void uninit_buffers()
     {
-      if (_inputBuffer != nullptr)
-      {
-        delete[] _inputBuffer;
-      }
-
-      if (_outputBuffer != nullptr)
-      {
-        delete[] _outputBuffer;
-      }
+      delete[] _inputBuffer;
+      delete[] _outputBuffer;
+      _inputBuffer = _outputBuffer = nullptr;
     }
 
     void read_next()
@@ -199,13 +279,15 @@ class basic_deflate_decoder
     }
 
     z_stream    _zstream;         // internal zlib structure
+    bool        _zstreamInit = false;
     int         _lastError;       // last error of zlib operation
 
-    istream_type* _stream;
+    istream_type*    _stream;
+    const ELEM_TYPE* _memoryInput; // rest of the input when decoding from memory, otherwise nullptr
     bool       _endOfStream;
 
     size_t     _bufferCapacity;
-    size_t     _inputBufferSize;  // how many bytes are read in the input buffer
+    size_t     _inputBufferSize;  // how many bytes are read in the input buffer, or left of the memory input
     size_t     _outputBufferSize; // how many bytes are written in the output buffer
     ELEM_TYPE* _inputBuffer;      // pointer to the start of the input buffer
     ELEM_TYPE* _outputBuffer;     // pointer to the start of the output buffer
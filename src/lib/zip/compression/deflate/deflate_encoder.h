@@ -2,10 +2,12 @@
 #include "../compression_interface.h"
 
 #include "deflate_encoder_properties.h"
+#include "detail/parallel_deflate.h"
 
 #include "../../extlibs/zlib/zlib.h"
 
 #include <cstdint>
+#include <memory>
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class basic_deflate_encoder
@@ -29,11 +31,11 @@ class basic_deflate_encoder
 
     ~basic_deflate_encoder()
     {
-      if (is_init())
+      if (_zstreamInit)
       {
         deflateEnd(&_zstream);
-        uninit_buffers();
       }
+      uninit_buffers();
     }
 
     void init(ostream_type& stream) override
@@ -50,25 +52,51 @@ class basic_deflate_encoder
       // init values
       _bytesRead = _bytesWritten = 0;
 
-      // init buffers
       deflate_encoder_properties& deflateProps = static_cast<deflate_encoder_properties&>(props);
-      _bufferCapacity = deflateProps.BufferCapacity;
-
-      uninit_buffers();
-      _inputBuffer = new ELEM_TYPE[_bufferCapacity];
-      _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      _isParallel = deflateProps.NumThreads != 1;
+      if (_isParallel)
+      {
+        if (_parallel == nullptr)
+        {
+          _parallel = std::make_unique<detail::parallel_deflate>();
+        }
+        _parallel->init(deflateProps.CompressionLevel, deflateProps.NumThreads, deflateProps.ChunkSize);
+        _parallelFinished = false;
+        return;
+      }
 
-      // init deflate
-      _zstream.zalloc = nullptr;
-      _zstream.zfree = nullptr;
-      _zstream.opaque = nullptr;
+      // init buffers, keeping the ones from the last init if they're the same size
+      if (deflateProps.BufferCapacity != _bufferCapacity || _inputBuffer == nullptr)
+      {
+        uninit_buffers();
+        _bufferCapacity = deflateProps.BufferCapacity;
+        _inputBuffer = new ELEM_TYPE[_bufferCapacity];
+        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
 
       _zstream.next_in = nullptr;
       _zstream.next_out = nullptr;
       _zstream.avail_in = 0;
       _zstream.avail_out = 0;
 
-      deflateInit2(&_zstream, deflateProps.CompressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+      // reset the deflate state from the last init instead of reallocating it,
+      // unless the level changed, since that can change how much memory it needs
+      if (_zstreamInit)
+      {
+        if (deflateProps.CompressionLevel == _compressionLevel && deflateReset(&_zstream) == Z_OK)
+        {
+          return;
+        }
+        deflateEnd(&_zstream);
+      }
+
+      // init deflate
+      _zstream.zalloc = nullptr;
+      _zstream.zfree = nullptr;
+      _zstream.opaque = nullptr;
+
+      _compressionLevel = deflateProps.CompressionLevel;
+      _zstreamInit = deflateInit2(&_zstream, _compressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
     }
 
     bool is_init() const override
@@ -88,16 +116,40 @@ class basic_deflate_encoder
 
     ELEM_TYPE* get_buffer_begin() override
     {
+      if (_isParallel)
+      {
+        return reinterpret_cast<ELEM_TYPE*>(_parallel->get_input());
+      }
       return _inputBuffer;
     }
 
     ELEM_TYPE* get_buffer_end() override
     {
+      if (_isParallel)
+      {
+        return get_buffer_begin() + _parallel->get_capacity() / sizeof(ELEM_TYPE);
+      }
       return _inputBuffer + _bufferCapacity;
     }
 
+    bool has_crc32() const override
+    {
+      return _isParallel;
+    }
+
+    uint32_t get_crc32() const override
+    {
+      return _isParallel ? _parallel->get_crc32() : 0;
+    }
+
     void encode_next(size_t length) override
     {
+      if (_isParallel)
+      {
+        encode_next_parallel(length);
+        return;
+      }
+
       // set the input buffer
       _zstream.next_in = reinterpret_cast<Bytef*>(_inputBuffer);
       _zstream.avail_in = static_cast<uInt>(length);
@@ -131,6 +183,25 @@ class basic_deflate_encoder
     }
 
   private:
+    void encode_next_parallel(size_t length)
+    {
+      // the stream is flushed again when it's destroyed, after it's already finished
+      if (_parallelFinished)
+      {
+        return;
+      }
+
+      const size_t byteLength = length * sizeof(ELEM_TYPE);
+      _bytesRead += length;
+      _parallelFinished = byteLength < _parallel->get_capacity();
+
+      _parallel->compress(byteLength, _parallelFinished, [this](const uint8_t* data, size_t size)
+      {
+        _stream->write(reinterpret_cast<const ELEM_TYPE*>(data), size / sizeof(ELEM_TYPE));
+        _bytesWritten += size / sizeof(ELEM_TYPE);
+      });
+    }
+
     void uninit_buffers()
     {
       if (_inputBuffer != nullptr)
@@ -142,6 +213,8 @@ class basic_deflate_encoder
       {
         delete[] _outputBuffer;
       }
+
+      _inputBuffer = _outputBuffer = nullptr;
     }
 
     bool zlib_suceeded(int errorCode)
@@ -150,10 +223,16 @@ class basic_deflate_encoder
     }
 
     z_stream    _zstream;         // internal zlib structure
+    bool        _zstreamInit = false;
+    int         _compressionLevel = 0; // of the current zlib structure
     int         _lastError;       // last error of zlib operation
 
     ostream_type* _stream;
 
+    bool _isParallel = false;
+    bool _parallelFinished = false;
+    std::unique_ptr<detail::parallel_deflate> _parallel; // kept once it's made, so it can be reused
+
     size_t     _bufferCapacity;
     ELEM_TYPE* _inputBuffer;      // pointer to the start of the input buffer
     ELEM_TYPE* _outputBuffer;     // pointer to the start of the output buffer
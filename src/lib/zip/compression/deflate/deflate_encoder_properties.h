@@ -9,6 +9,8 @@ struct deflate_encoder_properties
   deflate_encoder_properties()
     : BufferCapacity(1 << 15)
     , CompressionLevel(6)
+    , NumThreads(1)
+    , ChunkSize(1 << 17)
   {
 
   }
@@ -16,8 +18,11 @@ struct deflate_encoder_properties
   void normalize() override
   {
     CompressionLevel = clamp(0, 9, CompressionLevel);
+    ChunkSize = clamp<size_t>(1 << 12, 1 << 30, ChunkSize);
   }
 
   size_t BufferCapacity;
   int    CompressionLevel;
+  size_t NumThreads;       // more than 1 (or 0 for the hardware concurrency) compresses ChunkSize chunks in parallel
+  size_t ChunkSize;
 };
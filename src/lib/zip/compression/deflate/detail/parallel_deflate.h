@@ -0,0 +1,225 @@
+#pragma once
+#include "../../../extlibs/zlib/zlib.h"
+#include "../../../utils/crc32_utils.h"
+#include "../../../utils/thread_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace detail
+{
+  /**
+   * \brief Compresses raw deflate data on multiple threads, like pigz.
+   *        The input is split into chunks that are compressed independently,
+   *        each with the 32 KiB of input before it as its dictionary, so the compression ratio barely suffers.
+   *        Each chunk but the last one ends with a sync flush, which ends it on a byte boundary without ending the stream,
+   *        so the compressed chunks can just be concatenated into one deflate stream.
+   *        The chunks only depend on the chunk size, so any number of threads gives the same output,
+   *        but not the same as deflate_encoder gives with 1 thread, which doesn't use this and has no sync flushes.
+   */
+  class parallel_deflate
+  {
+    public:
+      static constexpr size_t WindowSize = 1 << 15;
+
+      parallel_deflate()
+        : _level(Z_DEFAULT_COMPRESSION)
+        , _numThreads(0)
+        , _chunkSize(0)
+        , _windowLength(0)
+        , _crc32(0)
+      {
+
+      }
+
+      ~parallel_deflate()
+      {
+        uninit_workers();
+      }
+
+      parallel_deflate(const parallel_deflate& other) = delete;
+
+      parallel_deflate& operator=(const parallel_deflate& other) = delete;
+
+      /**
+       * \brief Starts a new stream, reusing the buffers and zlib streams of the last one if the properties are the same.
+       *
+       * \param numThreads  The number of threads to compress on, or 0 for the hardware concurrency.
+       */
+      void init(int level, size_t numThreads, size_t chunkSize)
+      {
+        if (numThreads == 0)
+        {
+          numThreads = utils::thread::defaultNumThreads();
+        }
+
+        if (level != _level || numThreads != _numThreads || chunkSize != _chunkSize)
+        {
+          uninit_workers();
+          _level = level;
+          _numThreads = numThreads;
+          _chunkSize = chunkSize;
+
+          // the window, then a chunk for each thread
+          _buffer = std::make_unique<uint8_t[]>(WindowSize + get_capacity());
+          _workers.resize(_numThreads);
+        }
+
+        _windowLength = 0;
+        _crc32 = 0;
+      }
+
+      // where to put the next input
+      uint8_t* get_input()
+      {
+        return _buffer.get() + WindowSize;
+      }
+
+      // how much input to put there before compressing it
+      size_t get_capacity() const
+      {
+        return _chunkSize * _numThreads;
+      }
+
+      // of all the input so far
+      uint32_t get_crc32() const
+      {
+        return _crc32;
+      }
+
+      /**
+       * \brief Compresses the next length bytes of input, and writes what they compress to in order.
+       *
+       * \param finish  If this is the end of the input, so the last chunk ends the deflate stream.
+       * \param write   Called with each compressed chunk in order, as write(data, length).
+       * \return  false if zlib failed.
+       */
+      template <typename WRITE>
+      bool compress(size_t length, bool finish, WRITE&& write)
+      {
+        // the end of the stream is still a chunk, even if it's empty
+        size_t numChunks = (length + _chunkSize - 1) / _chunkSize;
+        if (finish && numChunks == 0)
+        {
+          numChunks = 1;
+        }
+
+        const auto* const input = get_input();
+        utils::thread::parallelFor(numChunks, _numThreads, [&](size_t i)
+        {
+          const size_t offset = i * _chunkSize;
+          const bool isLast = finish && i == numChunks - 1;
+          compress_chunk(_workers[i], input + offset, std::min(_chunkSize, length - offset),
+                         std::min(WindowSize, _windowLength + offset), isLast);
+        });
+
+        bool succeeded = true;
+        for (size_t i = 0; i < numChunks; i++)
+        {
+          auto& worker = _workers[i];
+          succeeded = succeeded && worker.succeeded;
+          write(worker.output.data(), worker.outputLength);
+          _crc32 = utils::crc32::combine(_crc32, worker.crc32, worker.inputLength);
+        }
+
+        // the end of this input is the window of the next
+        const size_t kept = std::min(WindowSize, _windowLength + length);
+        std::memmove(_buffer.get() + WindowSize - kept, get_input() + length - kept, kept);
+        _windowLength = kept;
+        return succeeded;
+      }
+
+    private:
+      struct worker
+      {
+        z_stream zstream;
+        bool zstreamInit = false;
+
+        size_t inputLength = 0;
+        uint32_t crc32 = 0;
+        std::vector<uint8_t> output;
+        size_t outputLength = 0;
+        bool succeeded = false;
+      };
+
+      void compress_chunk(worker& worker, const uint8_t* chunk, size_t length, size_t dictionaryLength, bool isLast)
+      {
+        auto& zstream = worker.zstream;
+        worker.inputLength = length;
+        worker.crc32 = utils::crc32::update(0, chunk, length);
+        worker.outputLength = 0;
+        worker.succeeded = false;
+
+        // each worker's zlib stream is reused for every chunk it compresses
+        if (worker.zstreamInit)
+        {
+          worker.zstreamInit = deflateReset(&zstream) == Z_OK;
+        }
+        if (!worker.zstreamInit)
+        {
+          zstream.zalloc = nullptr;
+          zstream.zfree = nullptr;
+          zstream.opaque = nullptr;
+          worker.zstreamInit = deflateInit2(&zstream, _level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+          if (!worker.zstreamInit)
+          {
+            return;
+          }
+        }
+
+        if (dictionaryLength != 0
+            && deflateSetDictionary(&zstream, chunk - dictionaryLength, static_cast<uInt>(dictionaryLength)) != Z_OK)
+        {
+          return;
+        }
+
+        // enough for the chunk and the sync flush, almost always
+        worker.output.resize(std::max(worker.output.size(), deflateBound(&zstream, static_cast<uLong>(length)) + 16));
+
+        const int flush = isLast ? Z_FINISH : Z_SYNC_FLUSH;
+        zstream.next_in = const_cast<Bytef*>(chunk);
+        zstream.avail_in = static_cast<uInt>(length);
+        int result;
+        do
+        {
+          if (worker.outputLength == worker.output.size())
+          {
+            worker.output.resize(worker.output.size() * 2);
+          }
+          zstream.next_out = worker.output.data() + worker.outputLength;
+          zstream.avail_out = static_cast<uInt>(worker.output.size() - worker.outputLength);
+          result = deflate(&zstream, flush);
+          worker.outputLength = worker.output.size() - zstream.avail_out;
+        }
+        // keep going while the output fills up, since there may be more
+        while (result == Z_OK && zstream.avail_out == 0);
+
+        worker.succeeded = isLast ? result == Z_STREAM_END : result == Z_OK;
+      }
+
+      void uninit_workers()
+      {
+        for (auto& worker : _workers)
+        {
+          if (worker.zstreamInit)
+          {
+            deflateEnd(&worker.zstream);
+          }
+        }
+        _workers.clear();
+      }
+
+      int    _level;
+      size_t _numThreads;
+      size_t _chunkSize;
+
+      std::unique_ptr<uint8_t[]> _buffer; // the window, and then the input
+      size_t _windowLength;               // how much of the window is filled, less than WindowSize only at the start
+
+      std::vector<worker> _workers;       // one for each chunk of the input
+      uint32_t _crc32;
+  };
+}
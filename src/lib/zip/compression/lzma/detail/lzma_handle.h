@@ -1,7 +1,7 @@
 #pragma once
 #include "lzma_alloc.h"
 
-#include "../../../extlibs/lzma/LzmaEnc.h"
+#include "../../../extlibs/lzma/unix/LzmaEnc.h"
 
 namespace detail
 {
@@ -11,7 +11,7 @@ namespace detail
       lzma_handle()
         : _handle(nullptr)
       {
-        _handle = LzmaEnc_Create(&_alloc);
+
       }
 
       ~lzma_handle()
@@ -22,10 +22,18 @@ namespace detail
         }
       }
 
-      CLzmaEncHandle get_native_handle() const { return _handle; }
+      // created on first use, so an encoder that's never used (i.e. a method only used to decode) doesn't allocate it
+      CLzmaEncHandle get_native_handle() const
+      {
+        if (_handle == nullptr)
+        {
+          _handle = LzmaEnc_Create(&_alloc);
+        }
+        return _handle;
+      }
 
     private:
-      CLzmaEncHandle  _handle;
-      lzma_alloc      _alloc;
+      mutable CLzmaEncHandle _handle;
+      mutable lzma_alloc _alloc;
   };
 }
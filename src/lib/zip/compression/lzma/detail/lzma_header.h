@@ -3,7 +3,7 @@
 #include "lzma_out_stream.h"
 
 #include "../../../extlibs/lzma/7zVersion.h"
-#include "../../../extlibs/lzma/LzmaEnc.h"
+#include "../../../extlibs/lzma/unix/LzmaEnc.h"
 
 namespace detail
 {
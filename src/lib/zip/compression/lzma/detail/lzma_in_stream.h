@@ -4,10 +4,13 @@
 #include <condition_variable>
 #include <mutex>
 
-// forward declaration
+// forward declarations
 template <typename ELEM_TYPE_, typename TRAITS_TYPE_>
 class basic_lzma_encoder;
 
+template <typename ELEM_TYPE_, typename TRAITS_TYPE_>
+class basic_xz_encoder;
+
 namespace detail
 {
   template <typename ELEM_TYPE, typename TRAITS_TYPE>
@@ -18,6 +21,9 @@ namespace detail
       template <typename ELEM_TYPE_, typename TRAITS_TYPE_>
       friend class ::basic_lzma_encoder;
 
+      template <typename ELEM_TYPE_, typename TRAITS_TYPE_>
+      friend class ::basic_xz_encoder;
+
       typedef std::condition_variable event_t;
       typedef std::mutex              mutex_t;
 
@@ -42,13 +48,11 @@ namespace detail
         _internalInputBuffer = static_cast<ELEM_TYPE*>(buf);
         _internalBufferSize = *size / sizeof(ELEM_TYPE);
 
-        // give control back to the main thread
-        set_event();
-
-        // wait for buffer fill
+        // give control back to the main thread,
+        // and wait for it to fill the buffer
         if (!_endOfStream)
         {
-          wait_for_event();
+          pass_turn(false);
         }
 
         // copy the data
@@ -64,6 +68,16 @@ namespace detail
 
       size_t get_bytes_read() const { return _bytesRead; }
 
+      // for reusing the stream for the next compression
+      void reset()
+      {
+        _bytesRead = 0;
+        _internalBufferSize = 0;
+        _internalInputBuffer = nullptr;
+        _endOfStream = false;
+        _mainThreadsTurn = false;
+      }
+
     private:
       size_t      _bytesRead;
       size_t      _internalBufferSize;
@@ -71,19 +85,42 @@ namespace detail
       event_t     _event;
       mutex_t     _mutex;
       bool        _endOfStream;
+      bool        _mainThreadsTurn = false;
 
       ELEM_TYPE* get_buffer_begin() { return _internalInputBuffer; }
       ELEM_TYPE* get_buffer_end() { return _internalInputBuffer + _internalBufferSize; }
 
-      void set_event()
+      /**
+       * \brief Lets the other thread run, and waits until it passes the turn back.
+       *        Only one of the main thread and the compression thread runs at a time,
+       *        so the buffer is only ever used by one of them.
+       *        The turn is a flag instead of just a notification, so a notification can't be missed
+       *        if it's sent before the other thread starts waiting.
+       *
+       * \param isMainThread  If this is the main thread, otherwise it's the compression thread.
+       */
+      void pass_turn(bool isMainThread)
       {
+        std::unique_lock<std::mutex> lk(_mutex);
+        _mainThreadsTurn = !isMainThread;
         _event.notify_one();
+        _event.wait(lk, [this, isMainThread] { return _mainThreadsTurn == isMainThread; });
       }
 
-      void wait_for_event()
+      // in the main thread, until the compression thread has asked for the first buffer
+      void wait_for_turn()
       {
         std::unique_lock<std::mutex> lk(_mutex);
-        _event.wait(lk);
+        _event.wait(lk, [this] { return _mainThreadsTurn; });
+      }
+
+      // in the compression thread when it's done, so the main thread doesn't wait for it anymore
+      void finish()
+      {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _endOfStream = true;
+        _mainThreadsTurn = true;
+        _event.notify_one();
       }
 
       void compress(size_t length)
@@ -95,11 +132,9 @@ namespace detail
 
         _bytesRead += length;
 
-        // set event in "read" method -> continue compression
-        set_event();
-
-        // wait until compression of the buffer is done
-        wait_for_event();
+        // continue compression in "read" method,
+        // and wait until compression of the buffer is done
+        pass_turn(true);
       }
   };
 }
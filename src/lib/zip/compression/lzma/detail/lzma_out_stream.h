@@ -25,13 +25,15 @@ namespace detail {
         }
         
         size_t write(const void* buf, size_t size) {
-            auto currentPosition = _stream->tellp();
             _stream->write(reinterpret_cast<const ELEM_TYPE*>(buf), size);
             
-            size_t delta = static_cast<size_t>(_stream->tellp()) - static_cast<size_t>(currentPosition);
-            _bytesWritten += delta;
+            // not every stream can tell its position (i.e. an encrypting one), so only its state says if it all got written
+            if (!*_stream) {
+                return 0;
+            }
+            _bytesWritten += size;
             
-            return delta;
+            return size;
         }
         
         size_t get_bytes_written() const { return _bytesWritten; }
@@ -40,7 +42,10 @@ namespace detail {
         
         stream_t& get_stream() { return *_stream; }
         
-        void set_stream(stream_t& stream) { _stream = &stream; }
+        void set_stream(stream_t& stream) {
+            _stream = &stream;
+            _bytesWritten = 0;
+        }
         
     };
 }
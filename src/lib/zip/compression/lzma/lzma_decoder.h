@@ -45,10 +45,9 @@ public:
     }
     
     ~basic_lzma_decoder() {
-        if (is_init()) {
-            LzmaDec_Free(&_handle, &_alloc);
-            uninit_buffers();
-        }
+        // LzmaDec_Construct() nulled everything, so this is fine even if it was never allocated
+        LzmaDec_Free(&_handle, &_alloc);
+        uninit_buffers();
     }
     
     void init(istream_type& stream) override {
@@ -62,27 +61,29 @@ public:
         
         // init values
         _inPos = _inProcessed = _outProcessed = 0;
-        _inputBufferSize = 0;
+        _inputBufferSize = _outputBufferSize = 0;
+        _bytesRead = _bytesWritten = 0;
         
-        // init buffers
+        // init buffers, keeping the ones from the last init if they're the same size
         auto& lzmaProps = dynamic_cast<lzma_decoder_properties&>(props);
-        _bufferCapacity = lzmaProps.BufferCapacity;
-        
-        uninit_buffers();
-        _inputBuffer = new ELEM_TYPE[_bufferCapacity];
-        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+        if (lzmaProps.BufferCapacity != _bufferCapacity || !_inputBuffer) {
+            // the output buffer is only allocated by decode_next(), decode_into() doesn't need it
+            uninit_buffers();
+            _bufferCapacity = lzmaProps.BufferCapacity;
+            _inputBuffer = new ELEM_TYPE[_bufferCapacity];
+        }
         
         // read lzma header
         Byte header[LZMA_PROPS_SIZE + 4];
         _stream->read(reinterpret_cast<ELEM_TYPE*>(header), sizeof(header) / sizeof(ELEM_TYPE));
         
-        // init lzma
+        // init lzma, which keeps the last probabilities and dictionary if the properties are the same
         LzmaDec_Allocate(&_handle, &header[4], LZMA_PROPS_SIZE, &_alloc);
         LzmaDec_Init(&_handle);
     }
     
     bool is_init() const override {
-        return (_inputBuffer != nullptr && _outputBuffer != nullptr);
+        return _inputBuffer != nullptr;
     }
     
     size_t get_bytes_read() const override {
@@ -102,51 +103,56 @@ public:
     }
     
     size_t decode_next() override {
-        if (_inPos == _inputBufferSize) {
-            read_next();
+        if (_outputBuffer == nullptr) {
+            _outputBuffer = new ELEM_TYPE[_bufferCapacity];
         }
         
-        _inProcessed = _inputBufferSize - _inPos;
-        _outProcessed = _bufferCapacity;
-        
-        ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
-        ELzmaStatus status;
-        /*SRes res = */LzmaDec_DecodeToBuf(
-                &_handle,
-                reinterpret_cast<Byte*>(_outputBuffer),
-                &_outProcessed,
-                reinterpret_cast<Byte*>(_inputBuffer) + _inPos,
-                &_inProcessed,
-                finishMode,
-                &status);
-        
-        _inPos += _inProcessed;
-        _bytesWritten += _outProcessed;
-        
-        _outputBufferSize = _outProcessed;
-        
+        _outputBufferSize = decompress_next(_outputBuffer, _bufferCapacity);
         return _outputBufferSize;
-        
-        // if (res != SZ_OK)
-        //   return _lzmaInProcessed;
-        //
-        // if (_lzmaInProcessed == 0 && _lzmaOutProcessed == 0)
-        // {
-        //   if (status != LZMA_STATUS_FINISHED_WITH_MARK)
-        //     return _lzmaOutProcessed;
-        //   return _lzmaOutProcessed;
-        // }
+    }
+    
+    size_t decode_into(ELEM_TYPE* output, size_t length) override {
+        return decompress_next(output, length);
     }
 
 private:
-    void uninit_buffers() {
-        if (_inputBuffer != nullptr) {
-            delete[] _inputBuffer;
-        }
+    
+    size_t decompress_next(ELEM_TYPE* output, size_t length) {
+        // keep consuming input until we are able to produce some output
+        do {
+            if (_inPos == _inputBufferSize) {
+                read_next();
+            }
+            
+            _inProcessed = _inputBufferSize - _inPos;
+            _outProcessed = length;
+            
+            ELzmaFinishMode finishMode = LZMA_FINISH_ANY;
+            ELzmaStatus status;
+            const SRes res = LzmaDec_DecodeToBuf(
+                    &_handle,
+                    reinterpret_cast<Byte*>(output),
+                    &_outProcessed,
+                    reinterpret_cast<Byte*>(_inputBuffer) + _inPos,
+                    &_inProcessed,
+                    finishMode,
+                    &status);
+            
+            _inPos += _inProcessed;
+            _bytesWritten += _outProcessed;
+            
+            if (res != SZ_OK) {
+                return 0;
+            }
+        } while (_outProcessed == 0 && _inProcessed != 0);
         
-        if (_outputBuffer != nullptr) {
-            delete[] _outputBuffer;
-        }
+        return _outProcessed;
+    }
+    
+    void uninit_buffers() {
+        delete[] _inputBuffer;
+        delete[] _outputBuffer;
+        _inputBuffer = _outputBuffer = nullptr;
     }
     
     void read_next() {
@@ -43,6 +43,10 @@ class basic_lzma_encoder
     {
       lzma_encoder_properties& lzmaProps = static_cast<lzma_encoder_properties&>(props);
 
+      // finish the last compression if there was one, so this one can reuse the encoder
+      sync();
+      _istream.reset();
+
       _ostream.set_stream(stream);
       lzmaProps.apply(_handle);
 
@@ -96,12 +100,14 @@ class basic_lzma_encoder
 
       _compressionThread = std::thread(&basic_lzma_encoder::encode_threadroutine, this);
 
-      _istream.wait_for_event();
+      _istream.wait_for_turn();
     }
 
     bool encode_threadroutine()
     {
-      return LzmaEnc_Encode(_handle.get_native_handle(), &_ostream, &_istream, nullptr, &_alloc, &_alloc) == SZ_OK;
+      const bool succeeded = LzmaEnc_Encode(_handle.get_native_handle(), &_ostream, &_istream, nullptr, &_alloc, &_alloc) == SZ_OK;
+      _istream.finish();
+      return succeeded;
     }
 
     detail::lzma_handle _handle;
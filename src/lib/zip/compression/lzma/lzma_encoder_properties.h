@@ -3,7 +3,7 @@
 
 #include "detail/lzma_handle.h"
 
-#include "../../extlibs/lzma/LzmaEnc.h"
+#include "../../extlibs/lzma/unix/LzmaEnc.h"
 
 struct lzma_encoder_properties
   : compression_encoder_properties_interface
@@ -18,6 +18,7 @@ struct lzma_encoder_properties
   void normalize() override
   {
     CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
     props.level = CompressionLevel;
     props.numThreads = IsMultithreaded ? 2 : 1;
 
@@ -30,6 +31,7 @@ struct lzma_encoder_properties
   void apply(detail::lzma_handle& handle)
   {
     CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
     props.level = CompressionLevel;
     props.numThreads = IsMultithreaded ? 2 : 1;
 
@@ -29,10 +29,7 @@ class basic_store_decoder
 
     ~basic_store_decoder()
     {
-      if (is_init())
-      {
-        uninit_buffers();
-      }
+      uninit_buffers();
     }
 
     void init(istream_type& stream) override
@@ -54,13 +51,13 @@ class basic_store_decoder
       store_decoder_properties& storeProps = static_cast<store_decoder_properties&>(props);
       _bufferCapacity = storeProps.BufferCapacity;
 
+      // the output buffer is only allocated by decode_next(), decode_into() doesn't need it
       uninit_buffers();
-      _outputBuffer = new ELEM_TYPE[_bufferCapacity];
     }
 
     bool is_init() const override
     {
-      return (_outputBuffer != nullptr);
+      return _stream != nullptr;
     }
 
     size_t get_bytes_read() const override
@@ -84,28 +81,36 @@ class basic_store_decoder
     }
 
     size_t decode_next() override
+    {
+      if (_outputBuffer == nullptr)
+      {
+        _outputBuffer = new ELEM_TYPE[_bufferCapacity];
+      }
+
+      _outputBufferSize = decode_into(_outputBuffer, _bufferCapacity);
+      return _outputBufferSize;
+    }
+
+    size_t decode_into(ELEM_TYPE* output, size_t length) override
     {
       // read next bytes from input stream
-      _stream->read(_outputBuffer, _bufferCapacity);
+      _stream->read(output, length);
 
-      // set the size of buffer
-      _outputBufferSize = static_cast<size_t>(_stream->gcount());
+      const auto bytesProcessed = static_cast<size_t>(_stream->gcount());
 
       // increase amount of total read & written bytes
-      _bytesRead += _outputBufferSize;
-      _bytesWritten += _outputBufferSize;
+      _bytesRead += bytesProcessed;
+      _bytesWritten += bytesProcessed;
 
       // return count of processed bytes from input stream
-      return _outputBufferSize;
+      return bytesProcessed;
     }
 
   private:
     void uninit_buffers()
     {
-      if (_outputBuffer != nullptr)
-      {
-        delete[] _outputBuffer;
-      }
+      delete[] _outputBuffer;
+      _outputBuffer = nullptr;
     }
 
     istream_type* _stream;
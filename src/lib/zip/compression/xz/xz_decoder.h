@@ -0,0 +1,550 @@
+#pragma once
+
+#include "../compression_interface.h"
+
+#include "../lzma/detail/lzma_alloc.h"
+#include "xz_decoder_properties.h"
+
+#include "../../extlibs/lzma/unix/Lzma2Dec.h"
+#include "../../utils/crc32_utils.h"
+#include "../../utils/thread_utils.h"
+#include "src/main/util/numbers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * \brief Decompresses the .xz format with LZMA2, as compressed by basic_xz_encoder.
+ *        When the whole input is in memory, the LZMA2 data is split at the chunks that reset the dictionary,
+ *        which is where each of the encoder's blocks starts, and those parts are decoded in parallel,
+ *        straight into the output if it's big enough.
+ *        Otherwise it's decoded sequentially.
+ *        The xz checks aren't verified, since a zip entry has its own CRC-32.
+ */
+template <typename ELEM_TYPE, typename TRAITS_TYPE>
+class basic_xz_decoder
+        : public compression_decoder_interface_basic<ELEM_TYPE, TRAITS_TYPE> {
+
+public:
+
+    typedef typename compression_interface_basic<ELEM_TYPE, TRAITS_TYPE>::istream_type istream_type;
+    typedef typename compression_interface_basic<ELEM_TYPE, TRAITS_TYPE>::ostream_type ostream_type;
+
+private:
+
+    static constexpr size_t MIN_BUFFER_CAPACITY = 1 << 12; // more than the biggest header
+    static constexpr size_t STREAM_HEADER_SIZE = 12;
+    static constexpr u8 LZMA2_FILTER_ID = 0x21;
+
+    enum class State {
+        StreamHeader,
+        BlockHeader,
+        Lzma2,
+        BlockEnd,
+        End,
+        Error,
+    };
+
+    // LZMA2 chunks that start by resetting the dictionary, so they don't depend on anything before them
+    struct Segment {
+        size_t inputOffset = 0;
+        size_t inputSize = 0;
+        size_t outputOffset = 0;
+        size_t outputSize = 0;
+    };
+
+    CLzma2Dec _handle = {};
+    detail::lzma_alloc _alloc;
+
+    State _state = State::Error;
+    size_t _checkSize = 0;
+    Byte _dictionaryProp = 0;
+    u64 _blockDataSize = 0; //< how much compressed data of the current block there's been, for its padding
+
+    istream_type* _stream = nullptr;
+    bool _isMemoryInput = false;
+
+    // the memory input, or the input buffer filled from the stream
+    const Byte* _input = nullptr;
+    size_t _inputSize = 0;
+    size_t _inPos = 0;
+
+    size_t _numThreads = 1;
+    std::vector<Segment> _segments;
+    std::vector<Byte> _pending; //< decoded in parallel, but not returned yet since the output was too small
+    size_t _pendingPos = 0;
+
+    // a segment of the memory input too big for the output, which is decoded sequentially
+    size_t _sequentialOutputLeft = 0;
+    size_t _sequentialInputEnd = 0;
+
+    size_t _bufferCapacity = 0;
+    std::unique_ptr<Byte[]> _inputBuffer;
+    std::unique_ptr<ELEM_TYPE[]> _outputBuffer;
+    size_t _outputBufferSize = 0;
+
+    size_t _bytesRead = 0;
+    size_t _bytesWritten = 0;
+
+public:
+
+    basic_xz_decoder() {
+        Lzma2Dec_Construct(&_handle);
+    }
+
+    ~basic_xz_decoder() {
+        // Lzma2Dec_Construct() nulled everything, so this is fine even if it was never allocated
+        Lzma2Dec_Free(&_handle, &_alloc);
+    }
+
+    basic_xz_decoder(const basic_xz_decoder& other) = delete;
+
+    basic_xz_decoder& operator=(const basic_xz_decoder& other) = delete;
+
+    void init(istream_type& stream) override {
+        xz_decoder_properties props;
+        init(stream, props);
+    }
+
+    void init(istream_type& stream, compression_decoder_properties_interface& props) override {
+        auto& xzProps = dynamic_cast<xz_decoder_properties&>(props);
+        reset(xzProps);
+        _stream = &stream;
+        _isMemoryInput = false;
+
+        // keep the buffers from the last init if they're the same size
+        if (!_inputBuffer) {
+            _inputBuffer = std::make_unique<Byte[]>(_bufferCapacity);
+        }
+        _input = _inputBuffer.get();
+        _inputSize = 0;
+    }
+
+    bool init(const ELEM_TYPE* input, size_t length, compression_decoder_properties_interface& props) override {
+        auto& xzProps = dynamic_cast<xz_decoder_properties&>(props);
+        reset(xzProps);
+        _stream = nullptr;
+        _isMemoryInput = true;
+        _input = reinterpret_cast<const Byte*>(input);
+        _inputSize = length;
+        return true;
+    }
+
+    bool is_init() const override {
+        return _input != nullptr;
+    }
+
+    size_t get_bytes_read() const override {
+        return _isMemoryInput ? _inPos : _bytesRead;
+    }
+
+    size_t get_bytes_written() const override {
+        return _bytesWritten;
+    }
+
+    ELEM_TYPE* get_buffer_begin() override {
+        return _outputBuffer.get();
+    }
+
+    ELEM_TYPE* get_buffer_end() override {
+        return _outputBuffer.get() + _outputBufferSize;
+    }
+
+    size_t decode_next() override {
+        if (!_outputBuffer) {
+            _outputBuffer = std::make_unique<ELEM_TYPE[]>(_bufferCapacity);
+        }
+
+        _outputBufferSize = decode(reinterpret_cast<Byte*>(_outputBuffer.get()), _bufferCapacity);
+        return _outputBufferSize;
+    }
+
+    size_t decode_into(ELEM_TYPE* output, size_t length) override {
+        return decode(reinterpret_cast<Byte*>(output), length);
+    }
+
+private:
+
+    void reset(const xz_decoder_properties& props) {
+        const size_t bufferCapacity = std::max(props.BufferCapacity, MIN_BUFFER_CAPACITY);
+        if (bufferCapacity != _bufferCapacity) {
+            _bufferCapacity = bufferCapacity;
+            _inputBuffer = nullptr;
+            _outputBuffer = nullptr;
+        }
+        _numThreads = props.NumThreads == 0 ? utils::thread::defaultNumThreads() : props.NumThreads;
+
+        _state = State::StreamHeader;
+        _inPos = 0;
+        _pending.clear();
+        _pendingPos = 0;
+        _sequentialOutputLeft = 0;
+        _outputBufferSize = 0;
+        _bytesRead = _bytesWritten = 0;
+    }
+
+    /**
+     * \brief Decodes as much as fits in output, stopping early only at the end of the stream or on an error.
+     */
+    size_t decode(Byte* output, size_t length) {
+        size_t produced = 0;
+        while (produced < length) {
+            // what was decoded in parallel last time, but didn't fit then
+            if (_pendingPos < _pending.size()) {
+                const size_t n = std::min(length - produced, _pending.size() - _pendingPos);
+                std::memcpy(output + produced, _pending.data() + _pendingPos, n);
+                _pendingPos += n;
+                produced += n;
+                continue;
+            }
+
+            bool succeeded = true;
+            switch (_state) {
+                case State::StreamHeader:
+                    succeeded = read_stream_header();
+                    break;
+                case State::BlockHeader:
+                    succeeded = read_block_header();
+                    break;
+                case State::Lzma2:
+                    produced += _isMemoryInput && _sequentialOutputLeft == 0
+                                ? decode_segments(output + produced, length - produced)
+                                : decode_sequentially(output + produced, length - produced);
+                    break;
+                case State::BlockEnd:
+                    succeeded = read_block_end();
+                    break;
+                case State::End:
+                case State::Error:
+                    _bytesWritten += produced;
+                    return produced;
+            }
+            if (!succeeded) {
+                _state = State::Error;
+            }
+        }
+        _bytesWritten += produced;
+        return produced;
+    }
+
+    // makes sure there are at least n bytes of input after _inPos, reading more from the stream if needed
+    bool ensure_input(size_t n) {
+        if (_inputSize - _inPos >= n) {
+            return true;
+        }
+        if (_isMemoryInput) {
+            return false;
+        }
+        std::memmove(_inputBuffer.get(), _inputBuffer.get() + _inPos, _inputSize - _inPos);
+        _inputSize -= _inPos;
+        _inPos = 0;
+        while (_inputSize < n) {
+            if (!read_more()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // reads as much as fits after the input that's already in the buffer
+    bool read_more() {
+        _stream->read(reinterpret_cast<ELEM_TYPE*>(_inputBuffer.get() + _inputSize), _bufferCapacity - _inputSize);
+        const auto n = static_cast<size_t>(_stream->gcount());
+        _inputSize += n;
+        _bytesRead += n;
+        return n != 0;
+    }
+
+    static u32 read_u32(const Byte* p) {
+        return static_cast<u32>(p[0]) | static_cast<u32>(p[1]) << 8 | static_cast<u32>(p[2]) << 16 | static_cast<u32>(p[3]) << 24;
+    }
+
+    static bool read_varint(const Byte* p, size_t end, size_t& pos, u64& value) {
+        value = 0;
+        for (size_t i = 0; i < 9 && pos < end; i++) {
+            const Byte b = p[pos++];
+            value |= static_cast<u64>(b & 0x7F) << (i * 7);
+            if ((b & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool read_stream_header() {
+        static constexpr Byte magic[] = {0xFD, '7', 'z', 'X', 'Z', 0};
+        if (!ensure_input(STREAM_HEADER_SIZE)) {
+            return false;
+        }
+        const Byte* const header = _input + _inPos;
+        const Byte checkType = header[7];
+        if (std::memcmp(header, magic, sizeof(magic)) != 0 || header[6] != 0 || checkType > 0xF
+            || utils::crc32::update(0, header + 6, 2) != read_u32(header + 8)) {
+            return false;
+        }
+        // the check sizes go up by one size every three types
+        _checkSize = checkType == 0 ? 0 : 4u << ((checkType - 1) / 3);
+        _inPos += STREAM_HEADER_SIZE;
+        _state = State::BlockHeader;
+        return true;
+    }
+
+    bool read_block_header() {
+        if (!ensure_input(1)) {
+            return false;
+        }
+
+        // the index, so all the blocks are done
+        if (_input[_inPos] == 0) {
+            _state = State::End;
+            return true;
+        }
+
+        const size_t size = (static_cast<size_t>(_input[_inPos]) + 1) * 4;
+        if (!ensure_input(size)) {
+            return false;
+        }
+        const Byte* const header = _input + _inPos;
+        const size_t end = size - 4;
+        if (utils::crc32::update(0, header, end) != read_u32(header + end)) {
+            return false;
+        }
+
+        // only a single filter, which has to be LZMA2
+        const Byte flags = header[1];
+        if ((flags & 0x3F) != 0) {
+            return false;
+        }
+        size_t pos = 2;
+        u64 value;
+        if ((flags & 0x40) && !read_varint(header, end, pos, value)) {
+            return false; // compressed size
+        }
+        if ((flags & 0x80) && !read_varint(header, end, pos, value)) {
+            return false; // uncompressed size
+        }
+        u64 filterId;
+        u64 propsSize;
+        if (!read_varint(header, end, pos, filterId) || filterId != LZMA2_FILTER_ID
+            || !read_varint(header, end, pos, propsSize) || propsSize != 1 || pos >= end) {
+            return false;
+        }
+        _dictionaryProp = header[pos];
+        _inPos += size;
+        _blockDataSize = 0;
+        _state = State::Lzma2;
+
+        // only the memory input is split into segments first
+        return _isMemoryInput || init_lzma2();
+    }
+
+    bool read_block_end() {
+        // the block is padded to a multiple of 4, and then its check
+        const size_t padding = static_cast<size_t>((4 - _blockDataSize % 4) % 4);
+        if (!ensure_input(padding + _checkSize)) {
+            return false;
+        }
+        for (size_t i = 0; i < padding; i++) {
+            if (_input[_inPos + i] != 0) {
+                return false;
+            }
+        }
+        _inPos += padding + _checkSize;
+        _state = State::BlockHeader;
+        return true;
+    }
+
+    bool init_lzma2() {
+        // keeps the last dictionary if it's the same size
+        if (Lzma2Dec_Allocate(&_handle, _dictionaryProp, &_alloc) != SZ_OK) {
+            return false;
+        }
+        Lzma2Dec_Init(&_handle);
+        return true;
+    }
+
+    /**
+     * \brief Gets the sizes of the LZMA2 chunk at pos in the memory input, including its header.
+     *
+     * \return  false if it's cut off or corrupt.
+     */
+    bool scan_chunk(size_t pos, size_t& inputSize, size_t& outputSize, bool& resetsDictionary) const {
+        const Byte* const chunk = _input + pos;
+        const size_t left = _inputSize - pos;
+        const Byte control = chunk[0];
+        if (control < 0x80) {
+            // uncompressed, 1 if it resets the dictionary and 2 if it doesn't
+            if (control > 2 || left < 3) {
+                return false;
+            }
+            outputSize = (static_cast<size_t>(chunk[1]) << 8 | chunk[2]) + 1;
+            inputSize = 3 + outputSize;
+            resetsDictionary = control == 1;
+        } else {
+            // LZMA, with a reset mode in bits 5 and 6, where 3 resets the dictionary and 2 or 3 have new properties
+            if (left < 5) {
+                return false;
+            }
+            const int resetMode = (control >> 5) & 3;
+            outputSize = (static_cast<size_t>(control & 0x1F) << 16 | static_cast<size_t>(chunk[1]) << 8 | chunk[2]) + 1;
+            inputSize = 5 + (resetMode >= 2 ? 1 : 0) + (static_cast<size_t>(chunk[3]) << 8 | chunk[4]) + 1;
+            resetsDictionary = resetMode == 3;
+        }
+        return inputSize <= left;
+    }
+
+    // splits the LZMA2 data at _inPos into up to _numThreads segments, stopping at its end
+    void scan_segments() {
+        _segments.clear();
+        size_t pos = _inPos;
+        size_t outputOffset = 0;
+        while (pos < _inputSize && _input[pos] != 0) {
+            size_t inputSize;
+            size_t outputSize;
+            bool resetsDictionary;
+            if (!scan_chunk(pos, inputSize, outputSize, resetsDictionary)) {
+                break;
+            }
+            if (resetsDictionary || _segments.empty()) {
+                if (_segments.size() == _numThreads) {
+                    break;
+                }
+                _segments.push_back({pos, 0, outputOffset, 0});
+            }
+            auto& segment = _segments.back();
+            segment.inputSize += inputSize;
+            segment.outputSize += outputSize;
+            outputOffset += outputSize;
+            pos += inputSize;
+        }
+    }
+
+    /**
+     * \brief Decodes a whole segment of the memory input into its place in output,
+     *        which is also the dictionary, so only the probabilities are allocated.
+     *        Like Lzma2Decode(), which doesn't initialize the decoder's state in this version of the SDK.
+     */
+    bool decode_segment(const Segment& segment, Byte* output) {
+        CLzma2Dec handle;
+        Lzma2Dec_Construct(&handle);
+        if (Lzma2Dec_AllocateProbs(&handle, _dictionaryProp, &_alloc) != SZ_OK) {
+            return false;
+        }
+        handle.decoder.dic = output + segment.outputOffset;
+        handle.decoder.dicBufSize = segment.outputSize;
+        Lzma2Dec_Init(&handle);
+
+        SizeT inputSize = segment.inputSize;
+        ELzmaStatus status;
+        const SRes res = Lzma2Dec_DecodeToDic(&handle, segment.outputSize, _input + segment.inputOffset, &inputSize,
+                                              LZMA_FINISH_ANY, &status);
+        const bool succeeded = res == SZ_OK && handle.decoder.dicPos == segment.outputSize;
+        Lzma2Dec_FreeProbs(&handle, &_alloc);
+        return succeeded;
+    }
+
+    size_t decode_segments(Byte* output, size_t length) {
+        scan_segments();
+        if (_segments.empty()) {
+            // the end of the LZMA2 data, unless it's corrupt
+            if (_inPos < _inputSize && _input[_inPos] == 0) {
+                _inPos++;
+                _blockDataSize++;
+                _state = State::BlockEnd;
+            } else {
+                _state = State::Error;
+            }
+            return 0;
+        }
+
+        const auto& last = _segments.back();
+        const size_t outputSize = last.outputOffset + last.outputSize;
+        const size_t inputEnd = last.inputOffset + last.inputSize;
+
+        // a single segment that doesn't fit is decoded a piece at a time instead of all into the pending buffer
+        if (_segments.size() == 1 && outputSize > length) {
+            if (!init_lzma2()) {
+                _state = State::Error;
+                return 0;
+            }
+            _sequentialOutputLeft = outputSize;
+            _sequentialInputEnd = inputEnd;
+            return decode_sequentially(output, length);
+        }
+
+        Byte* target = output;
+        if (outputSize > length) {
+            _pending.resize(outputSize);
+            _pendingPos = 0;
+            target = _pending.data();
+        }
+
+        std::atomic<bool> succeeded = true;
+        utils::thread::parallelFor(_segments.size(), _numThreads, [&](size_t i) {
+            if (!decode_segment(_segments[i], target)) {
+                succeeded = false;
+            }
+        });
+
+        if (!succeeded) {
+            _pending.clear();
+            _state = State::Error;
+            return 0;
+        }
+        _blockDataSize += inputEnd - _inPos;
+        _inPos = inputEnd;
+        return target == output ? outputSize : 0;
+    }
+
+    size_t decode_sequentially(Byte* output, size_t length) {
+        if (_isMemoryInput) {
+            length = std::min(length, _sequentialOutputLeft);
+        }
+
+        size_t produced = 0;
+        while (produced < length) {
+            if (!_isMemoryInput && _inPos == _inputSize) {
+                _inPos = _inputSize = 0;
+                read_more();
+            }
+
+            SizeT outputSize = length - produced;
+            SizeT inputSize = (_isMemoryInput ? _sequentialInputEnd : _inputSize) - _inPos;
+            ELzmaStatus status;
+            const SRes res = Lzma2Dec_DecodeToBuf(&_handle, output + produced, &outputSize,
+                                                  _input + _inPos, &inputSize, LZMA_FINISH_ANY, &status);
+            _inPos += inputSize;
+            _blockDataSize += inputSize;
+            produced += outputSize;
+
+            if (res != SZ_OK || (inputSize == 0 && outputSize == 0)) {
+                // corrupt, or truncated
+                _state = State::Error;
+                break;
+            }
+            if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
+                _state = State::BlockEnd;
+                break;
+            }
+        }
+
+        if (_isMemoryInput) {
+            _sequentialOutputLeft -= produced;
+            if (_sequentialOutputLeft == 0) {
+                // the decoder can be done with the output before it's read the very end of the input
+                _blockDataSize += _sequentialInputEnd - _inPos;
+                _inPos = _sequentialInputEnd;
+            }
+        }
+        return produced;
+    }
+
+};
+
+typedef basic_xz_decoder<uint8_t, std::char_traits<uint8_t>> byte_xz_decoder;
+typedef basic_xz_decoder<char, std::char_traits<char>> xz_decoder;
+typedef basic_xz_decoder<wchar_t, std::char_traits<wchar_t>> wxz_decoder;
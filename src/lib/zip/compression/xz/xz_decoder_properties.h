@@ -0,0 +1,21 @@
+#pragma once
+#include "../compression_interface.h"
+
+struct xz_decoder_properties
+  : compression_decoder_properties_interface
+{
+  xz_decoder_properties()
+    : BufferCapacity(1 << 15)
+    , NumThreads(1)
+  {
+
+  }
+
+  void normalize() override
+  {
+
+  }
+
+  size_t BufferCapacity;
+  size_t NumThreads;     // how many blocks are decoded in parallel (0 for the hardware concurrency), 1 by default since entries are too
+};
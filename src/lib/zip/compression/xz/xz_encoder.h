@@ -0,0 +1,132 @@
+#pragma once
+#include "../compression_interface.h"
+
+#include "xz_encoder_properties.h"
+#include "../lzma/detail/lzma_in_stream.h"
+#include "../lzma/detail/lzma_out_stream.h"
+
+#include "../../extlibs/lzma/unix/7zCrc.h"
+#include "../../extlibs/lzma/unix/XzEnc.h"
+
+#include <ostream>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+
+/**
+ * \brief Compresses into the .xz format with LZMA2, which is split into blocks that are compressed in parallel
+ *        when there's more than 1 thread.
+ *        Each block starts with a fresh dictionary, so they can also be decompressed in parallel.
+ *        With 1 thread it's one solid block, which compresses a little better, so the output differs from then on;
+ *        with more, the blocks only depend on the block size, so the output is the same for 2 threads or 16.
+ */
+template <typename ELEM_TYPE, typename TRAITS_TYPE>
+class basic_xz_encoder
+  : public compression_encoder_interface_basic<ELEM_TYPE, TRAITS_TYPE>
+{
+  public:
+    typedef typename compression_interface_basic<ELEM_TYPE, TRAITS_TYPE>::istream_type istream_type;
+    typedef typename compression_interface_basic<ELEM_TYPE, TRAITS_TYPE>::ostream_type ostream_type;
+
+    basic_xz_encoder()
+      : _isInit(false)
+    {
+
+    }
+
+    ~basic_xz_encoder()
+    {
+      sync();
+    }
+
+    void init(ostream_type& stream) override
+    {
+      xz_encoder_properties props;
+      init(stream, props);
+    }
+
+    void init(ostream_type& stream, compression_encoder_properties_interface& props) override
+    {
+      xz_encoder_properties& xzProps = static_cast<xz_encoder_properties&>(props);
+
+      // finish the last compression if there was one, so this one can reuse the encoder
+      sync();
+      _istream.reset();
+
+      _ostream.set_stream(stream);
+      xzProps.apply(_props);
+      _isInit = true;
+
+      start_compression_thread();
+    }
+
+    bool is_init() const override
+    {
+      return _isInit;
+    }
+
+    size_t get_bytes_read() const override
+    {
+      return _istream.get_bytes_read();
+    }
+
+    size_t get_bytes_written() const override
+    {
+      return _ostream.get_bytes_written();
+    }
+
+    ELEM_TYPE* get_buffer_begin() override
+    {
+      return _istream.get_buffer_begin();
+    }
+
+    ELEM_TYPE* get_buffer_end() override
+    {
+      return _istream.get_buffer_end();
+    }
+
+    void encode_next(size_t length) override
+    {
+      _istream.compress(length);
+    }
+
+    void sync() override
+    {
+      if (_compressionThread.joinable())
+      {
+        _compressionThread.join();
+      }
+    }
+
+  private:
+    void start_compression_thread()
+    {
+      // the xz headers and checks are CRC-32s, which need the table first
+      static std::once_flag crcTableGenerated;
+      std::call_once(crcTableGenerated, CrcGenerateTable);
+
+      _compressionThread = std::thread(&basic_xz_encoder::encode_threadroutine, this);
+
+      _istream.wait_for_turn();
+    }
+
+    bool encode_threadroutine()
+    {
+      // with more than one block thread, Lzma2Enc reads each block from _istream on whichever thread compresses it,
+      // but only one of them reads at a time, so it still takes turns with the main thread
+      const bool succeeded = Xz_Encode(&_ostream, &_istream, &_props, False, nullptr) == SZ_OK;
+      _istream.finish();
+      return succeeded;
+    }
+
+    bool            _isInit;
+    CLzma2EncProps  _props;
+    detail::lzma_in_stream<ELEM_TYPE, TRAITS_TYPE>  _istream;
+    detail::lzma_out_stream<ELEM_TYPE, TRAITS_TYPE> _ostream;
+
+    std::thread _compressionThread;
+};
+
+typedef basic_xz_encoder<uint8_t, std::char_traits<uint8_t>>  byte_xz_encoder;
+typedef basic_xz_encoder<char, std::char_traits<char>>        xz_encoder;
+typedef basic_xz_encoder<wchar_t, std::char_traits<wchar_t>>  wxz_encoder;
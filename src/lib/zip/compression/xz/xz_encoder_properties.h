@@ -0,0 +1,39 @@
+#pragma once
+#include "../compression_interface.h"
+
+#include "../../extlibs/lzma/unix/Lzma2Enc.h"
+#include "../../utils/thread_utils.h"
+
+struct xz_encoder_properties
+  : compression_encoder_properties_interface
+{
+  xz_encoder_properties()
+    : CompressionLevel(5)
+    , NumThreads(1)
+    , BlockSize(0)
+  {
+
+  }
+
+  void normalize() override
+  {
+    CompressionLevel = clamp(0, 9, CompressionLevel);
+  }
+
+  void apply(CLzma2EncProps& props) const
+  {
+    Lzma2EncProps_Init(&props);
+    props.lzmaProps.level = CompressionLevel;
+
+    // each block is compressed on a single thread, so all the threads go to compressing blocks in parallel
+    props.lzmaProps.numThreads = 1;
+    props.numBlockThreads = static_cast<int>(NumThreads == 0 ? utils::thread::defaultNumThreads() : NumThreads);
+    props.blockSize = BlockSize;
+
+    Lzma2EncProps_Normalize(&props);
+  }
+
+  int    CompressionLevel;
+  size_t NumThreads;       // how many blocks are compressed in parallel (0 for the hardware concurrency), 1 by default since entries are too
+  size_t BlockSize;        // 0 for 4 times the dictionary size, which is at least 1 MiB; only used with more than 1 thread
+};
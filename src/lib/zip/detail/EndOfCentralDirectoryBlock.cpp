@@ -1,6 +1,8 @@
 #include "EndOfCentralDirectoryBlock.h"
+#include "Zip64EndOfCentralDirectory.h"
 #include "../streams/serialization.h"
 #include <cstring>
+#include <algorithm>
 
 namespace detail {
     
@@ -8,15 +10,63 @@ namespace detail {
         signature = constants::signature;
     }
     
+    namespace {
+        
+        constexpr u16 maxU16 = 0xFFFF;
+        constexpr u32 maxU32 = 0xFFFFFFFF;
+        
+    }
+    
+    bool EndOfCentralDirectoryBlock::needsZip64() const noexcept {
+        return numberEntriesInDiskCentralDirectory >= maxU16
+               || numberEntriesInCentralDirectory >= maxU16
+               || centralDirectorySize >= maxU32
+               || offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber >= maxU32;
+    }
+    
+    void EndOfCentralDirectoryBlock::readZip64(const Zip64EndOfCentralDirectoryRecord& record) noexcept {
+        numberEntriesInDiskCentralDirectory = record.numberEntriesInDiskCentralDirectory;
+        numberEntriesInCentralDirectory = record.numberEntriesInCentralDirectory;
+        centralDirectorySize = record.centralDirectorySize;
+        offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber =
+                record.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber;
+    }
+    
     bool EndOfCentralDirectoryBlock::deserialize(std::istream& stream) {
         deserializeBase(stream);
         ::deserialize(stream, comment, commentLength);
+        readBase();
         return true;
     }
     
+    bool EndOfCentralDirectoryBlock::deserialize(std::string_view buffer) {
+        if (!deserializeBase(buffer) || signature != constants::signature) {
+            return false;
+        }
+        readBase();
+        // be lenient with truncated comments, like the stream version
+        ::deserialize(buffer, comment, std::min<size_t>(commentLength, buffer.size()));
+        return true;
+    }
+    
+    void EndOfCentralDirectoryBlock::readBase() noexcept {
+        const auto& base = static_cast<const Base&>(*this);
+        numberEntriesInDiskCentralDirectory = base.numberEntriesInDiskCentralDirectory;
+        numberEntriesInCentralDirectory = base.numberEntriesInCentralDirectory;
+        centralDirectorySize = base.centralDirectorySize;
+        offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber =
+                base.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber;
+    }
+    
     void EndOfCentralDirectoryBlock::serialize(std::ostream& stream) const {
         commentLength = static_cast<u16>(comment.length());
-        serializeBase(stream);
+        auto base = static_cast<const Base&>(*this);
+        base.numberEntriesInDiskCentralDirectory = static_cast<u16>(std::min<u64>(numberEntriesInDiskCentralDirectory, maxU16));
+        base.numberEntriesInCentralDirectory = static_cast<u16>(std::min<u64>(numberEntriesInCentralDirectory, maxU16));
+        base.centralDirectorySize = static_cast<u32>(std::min<u64>(centralDirectorySize, maxU32));
+        base.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber = static_cast<u32>(std::min<u64>(
+                offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber, maxU32));
+        base.serializeBase(stream);
         ::serialize(stream, comment);
     }
     
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 
 #include "src/main/util/numbers.h"
@@ -13,6 +14,8 @@ class ZipArchiveEntry;
 
 namespace detail {
     
+    struct Zip64EndOfCentralDirectoryRecord;
+    
     struct EndOfCentralDirectoryBlockBase : Serializable<EndOfCentralDirectoryBlockBase> {
         
         u32 signature;
@@ -36,12 +39,33 @@ namespace detail {
             
         };
         
+        // the real values, the on-disk fields are maxed out
+        // and they're stored in the Zip64 end of central directory record if they don't fit
+        u64 numberEntriesInDiskCentralDirectory = 0;
+        u64 numberEntriesInCentralDirectory = 0;
+        u64 centralDirectorySize = 0;
+        u64 offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber = 0;
+        
         std::string comment;
         
+    private:
+        
+        using Base = EndOfCentralDirectoryBlockBase;
+        
+        void readBase() noexcept;
+    
+    public:
+        
         EndOfCentralDirectoryBlock();
         
+        bool needsZip64() const noexcept;
+        
+        void readZip64(const Zip64EndOfCentralDirectoryRecord& record) noexcept;
+        
         bool deserialize(std::istream& stream);
         
+        bool deserialize(std::string_view buffer);
+        
         void serialize(std::ostream& stream) const;
         
     };
@@ -0,0 +1,63 @@
+#include "Zip64EndOfCentralDirectory.h"
+#include "EndOfCentralDirectoryBlock.h"
+
+#include "src/lib/zip/streams/serialization.h"
+
+namespace detail {
+    
+    // these have unaligned u64s, so they're (de)serialized field by field
+    
+    bool Zip64EndOfCentralDirectoryLocator::deserialize(std::string_view buffer) {
+        return buffer.size() >= size
+               && ::deserialize(buffer, signature)
+               && signature == constants::signature
+               && ::deserialize(buffer, diskWithZip64EndOfCentralDirectory)
+               && ::deserialize(buffer, offsetOfZip64EndOfCentralDirectory)
+               && ::deserialize(buffer, totalNumberOfDisks);
+    }
+    
+    void Zip64EndOfCentralDirectoryLocator::serialize(std::ostream& stream) const {
+        ::serialize(stream, signature);
+        ::serialize(stream, diskWithZip64EndOfCentralDirectory);
+        ::serialize(stream, offsetOfZip64EndOfCentralDirectory);
+        ::serialize(stream, totalNumberOfDisks);
+    }
+    
+    Zip64EndOfCentralDirectoryRecord::Zip64EndOfCentralDirectoryRecord(const EndOfCentralDirectoryBlock& block)
+            : diskNumber(block.diskNumber),
+              startOfCentralDirectoryDiskNum(block.startOfCentralDirectoryDiskNum),
+              numberEntriesInDiskCentralDirectory(block.numberEntriesInDiskCentralDirectory),
+              numberEntriesInCentralDirectory(block.numberEntriesInCentralDirectory),
+              centralDirectorySize(block.centralDirectorySize),
+              offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber(
+                      block.offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber) {}
+    
+    bool Zip64EndOfCentralDirectoryRecord::deserialize(std::string_view buffer) {
+        return buffer.size() >= size
+               && ::deserialize(buffer, signature)
+               && signature == constants::signature
+               && ::deserialize(buffer, sizeOfRecord)
+               && ::deserialize(buffer, versionMadeBy)
+               && ::deserialize(buffer, versionNeededToExtract)
+               && ::deserialize(buffer, diskNumber)
+               && ::deserialize(buffer, startOfCentralDirectoryDiskNum)
+               && ::deserialize(buffer, numberEntriesInDiskCentralDirectory)
+               && ::deserialize(buffer, numberEntriesInCentralDirectory)
+               && ::deserialize(buffer, centralDirectorySize)
+               && ::deserialize(buffer, offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber);
+    }
+    
+    void Zip64EndOfCentralDirectoryRecord::serialize(std::ostream& stream) const {
+        ::serialize(stream, signature);
+        ::serialize(stream, sizeOfRecord);
+        ::serialize(stream, versionMadeBy);
+        ::serialize(stream, versionNeededToExtract);
+        ::serialize(stream, diskNumber);
+        ::serialize(stream, startOfCentralDirectoryDiskNum);
+        ::serialize(stream, numberEntriesInDiskCentralDirectory);
+        ::serialize(stream, numberEntriesInCentralDirectory);
+        ::serialize(stream, centralDirectorySize);
+        ::serialize(stream, offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber);
+    }
+    
+}
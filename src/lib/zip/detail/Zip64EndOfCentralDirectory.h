@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+#include "src/main/util/numbers.h"
+
+namespace detail {
+    
+    struct EndOfCentralDirectoryBlock;
+    
+    /**
+     * \brief Points to the Zip64 end of central directory record.
+     *        It immediately precedes the regular end of central directory block.
+     */
+    struct Zip64EndOfCentralDirectoryLocator {
+        
+        struct constants {
+            
+            static constexpr u32 signature = 0x07064b50;
+            
+        };
+        
+        static constexpr size_t size = 20;
+        
+        u32 signature = constants::signature;
+        u32 diskWithZip64EndOfCentralDirectory = 0;
+        u64 offsetOfZip64EndOfCentralDirectory = 0;
+        u32 totalNumberOfDisks = 1;
+        
+        bool deserialize(std::string_view buffer);
+        
+        void serialize(std::ostream& stream) const;
+        
+    };
+    
+    /**
+     * \brief The Zip64 end of central directory record,
+     *        which holds the values of the end of central directory block that don't fit in it.
+     */
+    struct Zip64EndOfCentralDirectoryRecord {
+        
+        struct constants {
+            
+            static constexpr u32 signature = 0x06064b50;
+            
+        };
+        
+        // without the extensible data sector, which we skip
+        static constexpr size_t size = 56;
+        
+        u32 signature = constants::signature;
+        u64 sizeOfRecord = size - sizeof(signature) - sizeof(sizeOfRecord);
+        u16 versionMadeBy = 0;
+        u16 versionNeededToExtract = 0;
+        u32 diskNumber = 0;
+        u32 startOfCentralDirectoryDiskNum = 0;
+        u64 numberEntriesInDiskCentralDirectory = 0;
+        u64 numberEntriesInCentralDirectory = 0;
+        u64 centralDirectorySize = 0;
+        u64 offsetOfStartOfCentralDirectoryWithRespectToStartingDiskNumber = 0;
+        
+        Zip64EndOfCentralDirectoryRecord() = default;
+        
+        explicit Zip64EndOfCentralDirectoryRecord(const EndOfCentralDirectoryBlock& block);
+        
+        bool deserialize(std::string_view buffer);
+        
+        void serialize(std::ostream& stream) const;
+        
+    };
+    
+}
@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <ctime>
+#include <utility>
 
 #include "src/lib/zip/streams/serialization.h"
 
@@ -23,10 +24,67 @@ namespace detail {
         fileCommentLength = static_cast<u16>(fileComment.length());
     }
     
+    namespace {
+        
+        constexpr u32 maxU32 = 0xFFFFFFFF;
+        
+    }
+    
+    bool ZipCentralDirectoryFileHeader::needsZip64() const noexcept {
+        return compressedSize >= maxU32 || unCompressedSize >= maxU32 || relativeOffsetOfLocalHeader >= maxU32;
+    }
+    
+    bool ZipCentralDirectoryFileHeader::readZip64ExtraField() {
+        compressedSize = Base1::compressedSize;
+        unCompressedSize = Base1::unCompressedSize;
+        relativeOffsetOfLocalHeader = static_cast<u32>(Base2::relativeOffsetOfLocalHeader);
+        const bool unCompressedSizeIsZip64 = Base1::unCompressedSize == maxU32;
+        const bool compressedSizeIsZip64 = Base1::compressedSize == maxU32;
+        const bool offsetIsZip64 = relativeOffsetOfLocalHeader == maxU32;
+        if (!unCompressedSizeIsZip64 && !compressedSizeIsZip64 && !offsetIsZip64) {
+            // don't parse the extra fields unless we have to
+            return true;
+        }
+        return ZipGenericExtraField::readZip64(extraFields(), {
+                unCompressedSizeIsZip64 ? &unCompressedSize : nullptr,
+                compressedSizeIsZip64 ? &compressedSize : nullptr,
+                offsetIsZip64 ? &relativeOffsetOfLocalHeader : nullptr,
+        });
+    }
+    
+    void ZipCentralDirectoryFileHeader::parseExtraFields() const {
+        ZipGenericExtraField extraField;
+        while (extraField.deserialize(unParsedExtraFields)) {
+            _extraFields.push_back(extraField);
+        }
+        unParsedExtraFields = {};
+    }
+    
+    const std::vector<ZipGenericExtraField>& ZipCentralDirectoryFileHeader::extraFields() const {
+        if (!unParsedExtraFields.empty()) {
+            parseExtraFields();
+        }
+        return _extraFields;
+    }
+    
+    std::vector<ZipGenericExtraField>& ZipCentralDirectoryFileHeader::extraFields() {
+        return const_cast<std::vector<ZipGenericExtraField>&>(std::as_const(*this).extraFields());
+    }
+    
+    void ZipCentralDirectoryFileHeader::ownBorrowedData() {
+        fileName.mut();
+        fileComment.mut();
+        extraFields();
+    }
+    
     void ZipCentralDirectoryFileHeaderBase1::deserializeBase1(std::istream& stream) {
         ::deserialize<sizeof(padding1)>(stream, *this);
     }
     
+    bool ZipCentralDirectoryFileHeaderBase1::deserializeBase1(std::string_view& buffer) {
+        return ::deserialize<sizeof(padding1)>(buffer, *this);
+    }
+    
     void ZipCentralDirectoryFileHeaderBase1::serializeBase1(std::ostream& stream) const {
         ::serialize<sizeof(padding1)>(stream, *this);
     }
@@ -35,6 +93,10 @@ namespace detail {
         ::deserialize<sizeof(padding2)>(stream, *this);
     }
     
+    bool ZipCentralDirectoryFileHeaderBase2::deserializeBase2(std::string_view& buffer) {
+        return ::deserialize<sizeof(padding2)>(buffer, *this);
+    }
+    
     void ZipCentralDirectoryFileHeaderBase2::serializeBase2(std::ostream& stream) const {
         ::serialize<sizeof(padding2)>(stream, *this);
     }
@@ -46,47 +108,117 @@ namespace detail {
         // If there is not any other entry.
         if (stream.fail() || signature != constants::signature) {
             stream.clear();
-            auto offset = static_cast<std::ios::streamoff>(stream.tellg()) - stream.gcount();
+            auto offset = static_cast<std::streamoff>(stream.tellg()) - stream.gcount();
             stream.seekg(static_cast<std::ios::off_type>(offset), std::istream::beg);
             return false;
         }
         
-        ::deserialize(stream, fileName, fileNameLength);
+        ::deserialize(stream, fileName.mut(), fileNameLength);
         
         if (extraFieldLength > 0) {
             ZipGenericExtraField extraField;
             auto extraFieldEnd = extraFieldLength + stream.tellg();
             while (extraField.deserialize(stream, extraFieldEnd)) {
-                extraFields.push_back(extraField);
+                _extraFields.push_back(extraField);
             }
         }
         
-        ::deserialize(stream, fileComment, fileCommentLength);
+        ::deserialize(stream, fileComment.mut(), fileCommentLength);
+        
+        readZip64ExtraField();
+        return true;
+    }
+    
+    bool ZipCentralDirectoryFileHeader::deserialize(std::string_view& buffer) {
+        auto remaining = buffer;
+        if (!deserializeBase1(remaining) || !deserializeBase2(remaining) || signature != constants::signature) {
+            return false;
+        }
+        
+        const size_t variableLength = fileNameLength + extraFieldLength + fileCommentLength;
+        if (remaining.size() < variableLength) {
+            return false;
+        }
+        
+        fileName = CopyOnWriteString::borrow(remaining.substr(0, fileNameLength));
+        remaining.remove_prefix(fileNameLength);
+        _extraFields.clear();
+        unParsedExtraFields = remaining.substr(0, extraFieldLength);
+        remaining.remove_prefix(extraFieldLength);
+        fileComment = CopyOnWriteString::borrow(remaining.substr(0, fileCommentLength));
+        remaining.remove_prefix(fileCommentLength);
+        
+        if (!readZip64ExtraField()) {
+            return false;
+        }
         
+        buffer = remaining;
         return true;
     }
     
     void ZipCentralDirectoryFileHeader::serialize(std::ostream& stream) const {
+        const bool unCompressedSizeIsZip64 = unCompressedSize >= maxU32;
+        const bool compressedSizeIsZip64 = compressedSize >= maxU32;
+        const bool offsetIsZip64 = relativeOffsetOfLocalHeader >= maxU32;
+        const bool zip64 = unCompressedSizeIsZip64 || compressedSizeIsZip64 || offsetIsZip64;
+        
+        // only the values that don't fit go in the Zip64 extra field
+        ZipGenericExtraField zip64ExtraField;
+        if (zip64) {
+            std::vector<u64> values;
+            if (unCompressedSizeIsZip64) {
+                values.push_back(unCompressedSize);
+            }
+            if (compressedSizeIsZip64) {
+                values.push_back(compressedSize);
+            }
+            if (offsetIsZip64) {
+                values.push_back(relativeOffsetOfLocalHeader);
+            }
+            zip64ExtraField = ZipGenericExtraField::makeZip64(values);
+        }
+        
         fileNameLength = static_cast<uint16_t>(fileName.length());
         fileCommentLength = static_cast<uint16_t>(fileComment.length());
-        extraFieldLength = 0;
         
-        for (auto& extraField : extraFields) {
-            extraFieldLength += extraField.size();
+        // unparsed extra fields can be copied as is, since they can only contain a Zip64 extra field if it was needed
+        const bool copyUnParsedExtraFields = !zip64 && !unParsedExtraFields.empty();
+        if (copyUnParsedExtraFields) {
+            extraFieldLength = static_cast<u16>(unParsedExtraFields.size());
+        } else {
+            extraFieldLength = zip64 ? zip64ExtraField.size() : 0;
+            for (auto& extraField : extraFields()) {
+                if (extraField.header.tag != ZipGenericExtraField::tags::zip64) {
+                    extraFieldLength += extraField.size();
+                }
+            }
         }
-    
-        serializeBase1(stream);
-        serializeBase2(stream);
         
-        ::serialize(stream, fileName);
+        auto base1 = static_cast<const Base1&>(*this);
+        auto base2 = static_cast<const Base2&>(*this);
+        base1.unCompressedSize = unCompressedSizeIsZip64 ? maxU32 : static_cast<u32>(unCompressedSize);
+        base1.compressedSize = compressedSizeIsZip64 ? maxU32 : static_cast<u32>(compressedSize);
+        base2.relativeOffsetOfLocalHeader = static_cast<i32>(offsetIsZip64 ? maxU32 : relativeOffsetOfLocalHeader);
         
-        if (extraFieldLength > 0) {
-            for (auto& extraField : extraFields) {
-                extraField.serialize(stream);
+        base1.serializeBase1(stream);
+        base2.serializeBase2(stream);
+        
+        ::serialize(stream, fileName.view());
+        
+        if (copyUnParsedExtraFields) {
+            ::serialize(stream, unParsedExtraFields);
+        } else {
+            if (zip64) {
+                zip64ExtraField.serialize(stream);
+            }
+            for (auto& extraField : extraFields()) {
+                if (extraField.header.tag != ZipGenericExtraField::tags::zip64) {
+                    extraField.serialize(stream);
+                }
             }
         }
         
-        ::serialize(stream, fileComment);
+        ::serialize(stream, fileComment.view());
     }
     
 }
@@ -4,10 +4,12 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
 #include "src/main/util/numbers.h"
+#include "src/lib/zip/utils/CopyOnWriteString.h"
 
 class ZipArchive;
 
@@ -39,6 +41,8 @@ namespace detail {
         
         void deserializeBase1(std::istream& stream);
         
+        bool deserializeBase1(std::string_view& buffer);
+        
         void serializeBase1(std::ostream& stream) const;
         
     };
@@ -52,6 +56,8 @@ namespace detail {
     
         void deserializeBase2(std::istream& stream);
     
+        bool deserializeBase2(std::string_view& buffer);
+    
         void serializeBase2(std::ostream& stream) const;
         
     };
@@ -72,16 +78,53 @@ namespace detail {
                 (sizeof(Base1) - sizeof(Base1().padding1))
                 + (sizeof(Base2) - sizeof(Base2().padding2));
         
-        std::string fileName;
-        std::vector<ZipGenericExtraField> extraFields;
-        std::string fileComment;
+        // the real values, the on-disk fields are maxed out and they're stored in a Zip64 extra field if they don't fit
+        u64 compressedSize = 0;
+        u64 unCompressedSize = 0;
+        u64 relativeOffsetOfLocalHeader = 0;
+        
+        // when deserialized from a buffer, these borrow from it
+        CopyOnWriteString fileName;
+        CopyOnWriteString fileComment;
+    
+    private:
+        
+        // extra fields are only parsed from the raw bytes when they're first needed
+        mutable std::vector<ZipGenericExtraField> _extraFields;
+        mutable std::string_view unParsedExtraFields;
+        
+        void parseExtraFields() const;
+        
+        bool readZip64ExtraField();
+        
+    public:
         
         ZipCentralDirectoryFileHeader();
         
+        bool needsZip64() const noexcept;
+        
+        const std::vector<ZipGenericExtraField>& extraFields() const;
+        
+        std::vector<ZipGenericExtraField>& extraFields();
+        
         void syncWithLocalFileHeader(const ZipLocalFileHeader& localFileHeader);
         
         bool deserialize(std::istream& stream);
         
+        /**
+         * \brief Deserializes the header from the front of buffer, advancing buffer past it.
+         *        The file name, comment and extra fields borrow from buffer, so it must outlive the header.
+         *
+         * \return  false if the buffer doesn't start with a complete central directory file header.
+         */
+        bool deserialize(std::string_view& buffer);
+        
+        /**
+         * \brief Copies the file name, comment and extra fields out of the buffer they were deserialized from,
+         *        so that it no longer has to outlive the header.
+         */
+        void ownBorrowedData();
+        
         void serialize(std::ostream& stream) const;
         
     };
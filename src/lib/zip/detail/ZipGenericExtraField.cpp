@@ -2,6 +2,9 @@
 
 #include "src/lib/zip/streams/serialization.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace detail {
     
     u16 ZipGenericExtraField::size() const noexcept {
@@ -24,10 +27,69 @@ namespace detail {
         return true;
     }
     
+    bool ZipGenericExtraField::deserialize(std::string_view& buffer) {
+        auto remaining = buffer;
+        if (!header.deserializeBase(remaining) || remaining.size() < header.size) {
+            return false;
+        }
+        ::deserialize(remaining, data, header.size);
+        buffer = remaining;
+        return true;
+    }
+    
     void ZipGenericExtraField::serialize(std::ostream& stream) const {
         header.size = static_cast<u16>(data.size());
         header.serializeBase(stream);
         ::serialize(stream, data);
     }
     
+    const ZipGenericExtraField* ZipGenericExtraField::find(const std::vector<ZipGenericExtraField>& extraFields,
+                                                           u16 tag) noexcept {
+        for (const auto& extraField : extraFields) {
+            if (extraField.header.tag == tag) {
+                return &extraField;
+            }
+        }
+        return nullptr;
+    }
+    
+    void ZipGenericExtraField::remove(std::vector<ZipGenericExtraField>& extraFields, u16 tag) {
+        extraFields.erase(std::remove_if(extraFields.begin(), extraFields.end(), [tag](const auto& extraField) {
+            return extraField.header.tag == tag;
+        }), extraFields.end());
+    }
+    
+    bool ZipGenericExtraField::readZip64(const std::vector<ZipGenericExtraField>& extraFields,
+                                         std::initializer_list<u64*> values) {
+        const auto zip64 = find(extraFields, tags::zip64);
+        if (!zip64) {
+            return false;
+        }
+        std::string_view buffer(reinterpret_cast<const char*>(zip64->data.data()), zip64->data.size());
+        for (const auto value : values) {
+            if (value && !::deserialize(buffer, *value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    ZipGenericExtraField ZipGenericExtraField::makeZip64(const std::vector<u64>& values) {
+        ZipGenericExtraField zip64 = {};
+        zip64.header.tag = tags::zip64;
+        zip64.data.resize(values.size() * sizeof(u64));
+        std::memcpy(zip64.data.data(), values.data(), zip64.data.size());
+        zip64.header.size = static_cast<u16>(zip64.data.size());
+        return zip64;
+    }
+    
+    ZipGenericExtraField ZipGenericExtraField::makeAlignment(u16 alignment, size_t padding) {
+        ZipGenericExtraField field = {};
+        field.header.tag = tags::alignment;
+        field.data.resize(sizeof(alignment) + padding);
+        std::memcpy(field.data.data(), &alignment, sizeof(alignment));
+        field.header.size = static_cast<u16>(field.data.size());
+        return field;
+    }
+    
 }
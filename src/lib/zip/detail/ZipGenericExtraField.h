@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <initializer_list>
 #include <vector>
 #include <iostream>
+#include <string_view>
 
 #include "src/main/util/numbers.h"
 #include "src/lib/zip/streams/Serializable.h"
@@ -11,6 +13,15 @@ namespace detail {
     
     struct ZipGenericExtraField {
         
+        struct tags {
+            
+            static constexpr u16 zip64 = 0x0001;
+            
+            // Android's zipalign, the alignment and then zeros padding the entry's data to a multiple of it
+            static constexpr u16 alignment = 0xD935;
+            
+        };
+        
         struct Header : Serializable<Header> {
             
             u16 tag;
@@ -26,8 +37,37 @@ namespace detail {
         
         bool deserialize(std::istream& stream, std::istream::pos_type extraFieldEnd);
         
+        bool deserialize(std::string_view& buffer);
+        
         void serialize(std::ostream& stream) const;
         
+        /**
+         * \brief Finds the first extra field with tag.
+         *
+         * \return  nullptr if there isn't one.
+         */
+        static const ZipGenericExtraField* find(const std::vector<ZipGenericExtraField>& extraFields, u16 tag) noexcept;
+        
+        static void remove(std::vector<ZipGenericExtraField>& extraFields, u16 tag);
+        
+        /**
+         * \brief Reads the Zip64 extended information extra field,
+         *        which only holds the values that don't fit in their regular header fields, in order.
+         *
+         * \param values  The values to read, with nullptr for the ones that aren't present.
+         * \return  false if there's no Zip64 extra field or it's too short.
+         */
+        static bool readZip64(const std::vector<ZipGenericExtraField>& extraFields, std::initializer_list<u64*> values);
+        
+        static ZipGenericExtraField makeZip64(const std::vector<u64>& values);
+        
+        /**
+         * \brief The size of an alignment extra field without any padding.
+         */
+        static constexpr size_t minAlignmentSize = Header::Serializable::size + sizeof(u16);
+        
+        static ZipGenericExtraField makeAlignment(u16 alignment, size_t padding);
+        
     };
     
 }
@@ -7,10 +7,56 @@
 
 namespace detail {
     
-    ZipLocalFileHeader::ZipLocalFileHeader() : ZipLocalFileHeaderBase({}) {
+    ZipLocalFileHeader::ZipLocalFileHeader() : ZipLocalFileHeaderBase1({}), ZipLocalFileHeaderBase2({}) {
         signature = constants::signature;
     }
     
+    namespace {
+        
+        constexpr u32 maxU32 = 0xFFFFFFFF;
+        
+    }
+    
+    bool ZipLocalFileHeader::needsZip64() const noexcept {
+        return isZip64 || compressedSize >= maxU32 || unCompressedSize >= maxU32;
+    }
+    
+    void ZipLocalFileHeader::readZip64ExtraField() {
+        compressedSize = Base2::compressedSize;
+        unCompressedSize = Base2::unCompressedSize;
+        isZip64 = ZipGenericExtraField::find(extraFields, ZipGenericExtraField::tags::zip64) != nullptr;
+        if (isZip64) {
+            ZipGenericExtraField::readZip64(extraFields, {
+                    Base2::unCompressedSize == maxU32 ? &unCompressedSize : nullptr,
+                    Base2::compressedSize == maxU32 ? &compressedSize : nullptr,
+            });
+        }
+    }
+    
+    void ZipLocalFileHeaderBase1::deserializeBase1(std::istream& stream) {
+        ::deserialize<sizeof(padding1)>(stream, *this);
+    }
+    
+    bool ZipLocalFileHeaderBase1::deserializeBase1(std::string_view& buffer) {
+        return ::deserialize<sizeof(padding1)>(buffer, *this);
+    }
+    
+    void ZipLocalFileHeaderBase1::serializeBase1(std::ostream& stream) const {
+        ::serialize<sizeof(padding1)>(stream, *this);
+    }
+    
+    void ZipLocalFileHeaderBase2::deserializeBase2(std::istream& stream) {
+        ::deserialize<sizeof(padding2)>(stream, *this);
+    }
+    
+    bool ZipLocalFileHeaderBase2::deserializeBase2(std::string_view& buffer) {
+        return ::deserialize<sizeof(padding2)>(buffer, *this);
+    }
+    
+    void ZipLocalFileHeaderBase2::serializeBase2(std::ostream& stream) const {
+        ::serialize<sizeof(padding2)>(stream, *this);
+    }
+    
     void ZipLocalFileHeader::syncWithCentralDirectoryFileHeader(
             const ZipCentralDirectoryFileHeader& centralDirectoryFileHeader) {
         const auto& central = centralDirectoryFileHeader;
@@ -23,23 +69,25 @@ namespace detail {
         compressedSize = central.compressedSize;
         unCompressedSize = central.unCompressedSize;
         
-        fileName = centralDirectoryFileHeader.fileName;
+        fileName = centralDirectoryFileHeader.fileName.view();
         fileNameLength = static_cast<u16>(fileName.length());
     }
     
     bool ZipLocalFileHeader::deserialize(std::istream& stream) {
-        deserializeBase(stream);
+        deserializeBase1(stream);
+        deserializeBase2(stream);
         
         // If there is not any other entry.
         if (stream.fail() || signature != constants::signature) {
             stream.clear();
-            const auto offset = static_cast<std::ios::streamoff>(stream.tellg()) - stream.gcount();
+            const auto offset = static_cast<std::streamoff>(stream.tellg()) - stream.gcount();
             stream.seekg(static_cast<std::ios::off_type>(offset), std::ios::beg);
             return false;
         }
         
         ::deserialize(stream, fileName, fileNameLength);
         
+        extraFields.clear();
         if (extraFieldLength > 0) {
             ZipGenericExtraField extraField;
             auto extraFieldEnd = extraFieldLength + stream.tellg();
@@ -54,23 +102,81 @@ namespace detail {
             stream.seekg(extraFieldEnd, std::ios::beg);
         }
         
+        readZip64ExtraField();
         return true;
     }
     
-    void ZipLocalFileHeader::serialize(std::ostream& stream) const {
-        fileNameLength = static_cast<u16>(fileName.length());
-        extraFieldLength = 0;
+    bool ZipLocalFileHeader::deserialize(std::string_view& buffer) {
+        auto remaining = buffer;
+        if (!deserializeBase1(remaining) || !deserializeBase2(remaining) || signature != constants::signature) {
+            return false;
+        }
+        
+        if (!::deserialize(remaining, fileName, fileNameLength) || remaining.size() < extraFieldLength) {
+            return false;
+        }
+        
+        auto extraFieldsBuffer = remaining.substr(0, extraFieldLength);
+        extraFields.clear();
+        ZipGenericExtraField extraField;
+        while (extraField.deserialize(extraFieldsBuffer)) {
+            extraFields.push_back(extraField);
+        }
+        // like above, skip over any extra field data that isn't in tag, size and data form
+        remaining.remove_prefix(extraFieldLength);
+        readZip64ExtraField();
         
+        buffer = remaining;
+        return true;
+    }
+    
+    size_t ZipLocalFileHeader::sizeWithVariableFields(std::string_view buffer) noexcept {
+        Base1 base1;
+        Base2 base2;
+        if (!base1.deserializeBase1(buffer) || !base2.deserializeBase2(buffer)) {
+            return size;
+        }
+        return size + base2.fileNameLength + base2.extraFieldLength;
+    }
+    
+    u16 ZipLocalFileHeader::serializedExtraFieldLength(bool zip64) const noexcept {
+        // the unCompressedSize and compressedSize of a Zip64 extra field
+        u16 length = zip64 ? static_cast<u16>(ZipGenericExtraField::Header::Serializable::size + 2 * sizeof(u64)) : 0;
         for (auto& extraField : extraFields) {
-            extraFieldLength += extraField.size();
+            if (extraField.header.tag != ZipGenericExtraField::tags::zip64) {
+                length += extraField.size();
+            }
         }
+        return length;
+    }
+    
+    size_t ZipLocalFileHeader::serializedSize() const noexcept {
+        return size + fileName.length() + serializedExtraFieldLength(needsZip64());
+    }
+    
+    void ZipLocalFileHeader::serialize(std::ostream& stream) const {
+        const bool zip64 = needsZip64();
+        const auto zip64ExtraField = zip64
+                                     ? ZipGenericExtraField::makeZip64({unCompressedSize, compressedSize})
+                                     : ZipGenericExtraField();
         
-        serializeBase(stream);
+        fileNameLength = static_cast<u16>(fileName.length());
+        extraFieldLength = serializedExtraFieldLength(zip64);
+        
+        auto base2 = static_cast<const Base2&>(*this);
+        base2.compressedSize = zip64 ? maxU32 : static_cast<u32>(compressedSize);
+        base2.unCompressedSize = zip64 ? maxU32 : static_cast<u32>(unCompressedSize);
+        
+        serializeBase1(stream);
+        base2.serializeBase2(stream);
         
         ::serialize(stream, fileName);
         
-        if (extraFieldLength > 0) {
-            for (auto& extraField : extraFields) {
+        if (zip64) {
+            zip64ExtraField.serialize(stream);
+        }
+        for (auto& extraField : extraFields) {
+            if (extraField.header.tag != ZipGenericExtraField::tags::zip64) {
                 extraField.serialize(stream);
             }
         }
@@ -82,21 +188,35 @@ namespace detail {
         
         // the signature is optional, if it's missing,
         // we're starting with crc32
-        if (firstWord != constants::dataDescriptorSignature) {
+        if (firstWord == constants::dataDescriptorSignature) {
             ::deserialize(stream, crc32);
         } else {
             crc32 = firstWord;
         }
         
-        ::deserialize(stream, compressedSize);
-        ::deserialize(stream, unCompressedSize);
+        // sizes are 8 bytes if there's a Zip64 extra field
+        if (isZip64) {
+            ::deserialize(stream, compressedSize);
+            ::deserialize(stream, unCompressedSize);
+        } else {
+            u32 size;
+            ::deserialize(stream, size);
+            compressedSize = size;
+            ::deserialize(stream, size);
+            unCompressedSize = size;
+        }
     }
     
     void ZipLocalFileHeader::serializeAsDataDescriptor(std::ostream& stream) const {
         ::serialize(stream, constants::dataDescriptorSignature);
         ::serialize(stream, crc32);
-        ::serialize(stream, compressedSize);
-        ::serialize(stream, unCompressedSize);
+        if (isZip64) {
+            ::serialize(stream, compressedSize);
+            ::serialize(stream, unCompressedSize);
+        } else {
+            ::serialize(stream, static_cast<u32>(compressedSize));
+            ::serialize(stream, static_cast<u32>(unCompressedSize));
+        }
     }
     
 }
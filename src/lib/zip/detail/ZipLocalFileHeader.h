@@ -3,6 +3,7 @@
 #include "ZipGenericExtraField.h"
 
 #include <iostream>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
@@ -12,7 +13,8 @@ namespace detail {
     
     struct ZipCentralDirectoryFileHeader;
     
-    struct ZipLocalFileHeaderBase : Serializable<ZipLocalFileHeaderBase> {
+    // split in two so that crc32 isn't padded away from its on-disk offset of 14
+    struct ZipLocalFileHeaderBase1 {
         
         u32 signature;
         u16 versionNeededToExtract;
@@ -20,17 +22,36 @@ namespace detail {
         u16 compressionMethod;
         u16 lastModificationTime;
         u16 lastModificationDate;
+        
+        u8 padding1[2];
+        
+        void deserializeBase1(std::istream& stream);
+        
+        bool deserializeBase1(std::string_view& buffer);
+        
+        void serializeBase1(std::ostream& stream) const;
+        
+    };
+    
+    struct ZipLocalFileHeaderBase2 {
+        
         u32 crc32;
         u32 compressedSize;
         u32 unCompressedSize;
         mutable u16 fileNameLength;
         mutable u16 extraFieldLength;
         
-        u8 padding[2];
+        u8 padding2[0];
+        
+        void deserializeBase2(std::istream& stream);
+        
+        bool deserializeBase2(std::string_view& buffer);
+        
+        void serializeBase2(std::ostream& stream) const;
         
     };
     
-    struct ZipLocalFileHeader: ZipLocalFileHeaderBase {
+    struct ZipLocalFileHeader : ZipLocalFileHeaderBase1, ZipLocalFileHeaderBase2 {
         
         struct constants {
     
@@ -39,20 +60,66 @@ namespace detail {
             
         };
         
+        using Base1 = ZipLocalFileHeaderBase1;
+        using Base2 = ZipLocalFileHeaderBase2;
+        
+        static constexpr size_t size =
+                (sizeof(Base1) - sizeof(Base1().padding1))
+                + (sizeof(Base2) - sizeof(Base2().padding2));
+        
+        // the real sizes, the on-disk fields are maxed out and they're stored in a Zip64 extra field if they don't fit
+        u64 compressedSize = 0;
+        u64 unCompressedSize = 0;
+        
+        // if the header has a Zip64 extra field even if the sizes fit,
+        // i.e. when they aren't known yet when it's first written
+        bool isZip64 = false;
+        
         std::string fileName;
         std::vector<ZipGenericExtraField> extraFields;
         
         ZipLocalFileHeader();
         
+        bool needsZip64() const noexcept;
+        
         void syncWithCentralDirectoryFileHeader(const ZipCentralDirectoryFileHeader& centralDirectoryFileHeader);
         
         bool deserialize(std::istream& stream);
         
+        /**
+         * \brief Deserializes the header from the front of buffer, advancing buffer past it.
+         *
+         * \return  false if the buffer doesn't start with a complete local file header.
+         */
+        bool deserialize(std::string_view& buffer);
+        
+        /**
+         * \brief Gets the size of the whole header, including its file name and extra fields,
+         *        from the fixed size part at the front of buffer.
+         *
+         * \return  The size of the header, or just the fixed size if buffer is too short for it.
+         */
+        static size_t sizeWithVariableFields(std::string_view buffer) noexcept;
+        
         void serialize(std::ostream& stream) const;
         
+        /**
+         * \brief Gets the size serialize() writes, including the file name and extra fields.
+         */
+        size_t serializedSize() const noexcept;
+        
+        void readZip64ExtraField();
+        
         void deserializeAsDataDescriptor(std::istream& stream);
         
         void serializeAsDataDescriptor(std::ostream& stream) const;
+    
+    private:
+        
+        /**
+         * \brief Gets the length of the extra fields serialize() writes, which replace any Zip64 one if zip64.
+         */
+        u16 serializedExtraFieldLength(bool zip64) const noexcept;
         
     };
     
@@ -7,6 +7,13 @@
  * tables for updating the shift register in one step with three exclusive-ors
  * instead of four steps with four exclusive-ors.  This results in about a
  * factor of two increase in speed on a Power PC G4 (PPC7455) using gcc -O3.
+ *
+ * Modified to use the CPU's CRC hardware when it's there, chosen at run time:
+ * folding with carry-less multiplies (PCLMULQDQ) on x86, following Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction",
+ * or the CRC32 instructions on ARMv8.  Otherwise little-endian machines use
+ * eight tables to do eight bytes at a time (slice-by-8).  Define NOCRC32HW to
+ * only use the tables.
  */
 
 /* @(#) $Id$ */
@@ -46,6 +53,41 @@
 #  define TBLS 1
 #endif /* BYFOUR */
 
+/* Definitions for using the CPU's CRC hardware. */
+#if !defined(NOCRC32HW) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define CRC32_PCLMUL
+#  define CRC32_HW
+#  include <stdint.h>
+#  include <immintrin.h>
+#  define CRC32_HW_TARGET __attribute__((target("pclmul,sse4.1")))
+#elif !defined(NOCRC32HW) && defined(__GNUC__) && defined(__aarch64__) && \
+    defined(__linux__)
+#  define CRC32_ARMV8
+#  define CRC32_HW
+#  include <stdint.h>
+#  include <sys/auxv.h>
+#  ifndef HWCAP_CRC32
+#    define HWCAP_CRC32 (1 << 7)
+#  endif
+#  ifdef __clang__
+#    define CRC32_HW_TARGET __attribute__((target("crc")))
+#    define crc32_hw_byte __builtin_arm_crc32b
+#    define crc32_hw_dword __builtin_arm_crc32d
+#  else
+#    define CRC32_HW_TARGET __attribute__((target("+crc")))
+#    define crc32_hw_byte __builtin_aarch64_crc32b
+#    define crc32_hw_dword __builtin_aarch64_crc32x
+#  endif
+#endif
+#ifdef CRC32_HW
+   /* shorter buffers aren't worth it, and the folding needs 64 bytes */
+#  define CRC32_HW_MIN 64
+   local int crc32_hw_available OF((void));
+   local unsigned long crc32_hw OF((unsigned long,
+                        const unsigned char FAR *, unsigned));
+#endif /* CRC32_HW */
+
 /* Local functions for crc concatenation */
 local unsigned long gf2_matrix_times OF((unsigned long *mat,
                                          unsigned long vec));
@@ -57,6 +99,9 @@ local uLong crc32_combine_ OF((uLong crc1, uLong crc2, z_off64_t len2));
 
 local volatile int crc_table_empty = 1;
 local z_crc_t FAR crc_table[TBLS][256];
+#ifdef BYFOUR
+local z_crc_t FAR crc_table8[4][256];
+#endif /* BYFOUR */
 local void make_crc_table OF((void));
 #ifdef MAKECRCH
    local void write_table OF((FILE *, const z_crc_t FAR *));
@@ -126,6 +171,11 @@ local void make_crc_table()
                 crc_table[k][n] = c;
                 crc_table[k + 4][n] = ZSWAP32(c);
             }
+            /* and followed by four to seven zeros, for eight bytes at a time */
+            for (k = 0; k < 4; k++) {
+                c = crc_table[0][c & 0xff] ^ (c >> 8);
+                crc_table8[k][n] = c;
+            }
         }
 #endif /* BYFOUR */
 
@@ -158,6 +208,17 @@ local void make_crc_table()
         fprintf(out, "#endif\n");
 #  endif /* BYFOUR */
         fprintf(out, "  }\n};\n");
+#  ifdef BYFOUR
+        fprintf(out, "\n#ifdef BYFOUR\n");
+        fprintf(out, "local const z_crc_t FAR ");
+        fprintf(out, "crc_table8[4][256] =\n{\n  {\n");
+        write_table(out, crc_table8[0]);
+        for (k = 1; k < 4; k++) {
+            fprintf(out, "  },\n  {\n");
+            write_table(out, crc_table8[k]);
+        }
+        fprintf(out, "  }\n};\n#endif /* BYFOUR */\n");
+#  endif /* BYFOUR */
         fclose(out);
     }
 #endif /* MAKECRCH */
@@ -213,6 +274,11 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef CRC32_HW
+    if (len >= CRC32_HW_MIN && crc32_hw_available())
+        return crc32_hw(crc, buf, len);
+#endif /* CRC32_HW */
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         z_crc_t endian;
@@ -241,7 +307,13 @@ unsigned long ZEXPORT crc32(crc, buf, len)
 #define DOLIT4 c ^= *buf4++; \
         c = crc_table[3][c & 0xff] ^ crc_table[2][(c >> 8) & 0xff] ^ \
             crc_table[1][(c >> 16) & 0xff] ^ crc_table[0][c >> 24]
-#define DOLIT32 DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4
+#define DOLIT8 c ^= *buf4++; \
+        w = *buf4++; \
+        c = crc_table8[3][c & 0xff] ^ crc_table8[2][(c >> 8) & 0xff] ^ \
+            crc_table8[1][(c >> 16) & 0xff] ^ crc_table8[0][c >> 24] ^ \
+            crc_table[3][w & 0xff] ^ crc_table[2][(w >> 8) & 0xff] ^ \
+            crc_table[1][(w >> 16) & 0xff] ^ crc_table[0][w >> 24]
+#define DOLIT32 DOLIT8; DOLIT8; DOLIT8; DOLIT8
 
 /* ========================================================================= */
 local unsigned long crc32_little(crc, buf, len)
@@ -249,7 +321,7 @@ local unsigned long crc32_little(crc, buf, len)
     const unsigned char FAR *buf;
     unsigned len;
 {
-    register z_crc_t c;
+    register z_crc_t c, w;
     register const z_crc_t FAR *buf4;
 
     c = (z_crc_t)crc;
@@ -321,6 +393,179 @@ local unsigned long crc32_big(crc, buf, len)
 
 #endif /* BYFOUR */
 
+#ifdef CRC32_HW
+
+/* ========================================================================= */
+local int crc32_hw_available()
+{
+    /* -1 until checked; every thread that checks gets the same answer */
+    static volatile int available = -1;
+
+    if (available < 0) {
+#  ifdef CRC32_PCLMUL
+        __builtin_cpu_init();
+        available = __builtin_cpu_supports("pclmul") &&
+                    __builtin_cpu_supports("sse4.1");
+#  else
+        available = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#  endif
+    }
+    return available;
+}
+
+#ifdef CRC32_PCLMUL
+
+/* =========================================================================
+ * Folds len bytes, a multiple of 16 and at least 64, into the inverted crc c,
+ * four 128-bit lanes at a time, using the bit-reflected constants of Intel's
+ * paper: k1 = x^(4*128+32) mod P, k2 = x^(4*128-32) mod P, k3 and k4 likewise
+ * for 128, k5 = x^64 mod P, and the Barrett reduction's mu and P itself.
+ */
+local CRC32_HW_TARGET z_crc_t crc32_pclmul(c, buf, len)
+    z_crc_t c;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+        {0x0154442bd4ULL, 0x01c6e41596ULL};
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+        {0x01751997d0ULL, 0x00ccaa009eULL};
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+        {0x0163cd6124ULL, 0x0000000000ULL};
+    static const uint64_t poly[2] __attribute__((aligned(16))) =
+        {0x01db710641ULL, 0x01f7011641ULL};
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* fold 64 bytes at a time into the four lanes */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold the rest 16 bytes at a time */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits into 64 */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduce to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (z_crc_t)_mm_extract_epi32(x1, 1);
+}
+
+/* ========================================================================= */
+local unsigned long crc32_hw(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    register z_crc_t c;
+    unsigned folded = len & ~15U;
+
+    c = ~(z_crc_t)crc;
+    c = crc32_pclmul(c, buf, folded);
+    buf += folded;
+    len -= folded;
+    while (len--)
+        c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+    return (unsigned long)~c;
+}
+
+#else /* CRC32_ARMV8 */
+
+/* ========================================================================= */
+local CRC32_HW_TARGET unsigned long crc32_hw(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    unsigned len;
+{
+    register uint32_t c;
+    const uint64_t FAR *buf8;
+
+    c = ~(uint32_t)crc;
+    while (len && ((ptrdiff_t)buf & 7)) {
+        c = crc32_hw_byte(c, *buf++);
+        len--;
+    }
+    buf8 = (const uint64_t FAR *)(const void FAR *)buf;
+    while (len >= 32) {
+        c = crc32_hw_dword(c, *buf8++);
+        c = crc32_hw_dword(c, *buf8++);
+        c = crc32_hw_dword(c, *buf8++);
+        c = crc32_hw_dword(c, *buf8++);
+        len -= 32;
+    }
+    while (len >= 8) {
+        c = crc32_hw_dword(c, *buf8++);
+        len -= 8;
+    }
+    buf = (const unsigned char FAR *)buf8;
+    while (len--)
+        c = crc32_hw_byte(c, *buf++);
+    return (unsigned long)~c;
+}
+
+#endif /* CRC32_PCLMUL */
+
+#endif /* CRC32_HW */
+
 #define GF2_DIM 32      /* dimension of GF(2) vectors (length of CRC) */
 
 /* ========================================================================= */
@@ -0,0 +1,258 @@
+#pragma once
+#include "ICompressionMethod.h"
+#include "StoreMethod.h"
+#include "DeflateMethod.h"
+#include "LzmaMethod.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * \brief Picks Store, Deflate or LZMA for each entry it's set on, by what its data looks like.
+ *        Entries that are already compressed (i.e. PNG, MP3 or ADPCM WAV assets), by their extension or magic bytes,
+ *        or whose first few KB look random, are stored, since compressing them costs a lot of time for nothing.
+ *        Everything else is deflated, or compressed with LZMA if it's very redundant and LZMA is allowed.
+ *
+ *        It's resolved to a copy of the method it picks when set on an entry, so the entry is written with that one,
+ *        and entries sharing an AutoMethod can still be compressed in parallel, since each has its own encoder.
+ *        Used on its own, it's just Deflate.
+ */
+class AutoMethod :
+  public ICompressionMethod
+{
+  public:
+    typedef std::shared_ptr<AutoMethod> Ptr;
+
+    // how much of the start of an entry is looked at
+    static constexpr size_t ProbeSize = 8 * 1024;
+
+    AutoMethod()
+      : _store(StoreMethod::Create())
+      , _deflate(DeflateMethod::Create())
+      , _lzma(LzmaMethod::Create())
+      , _storeEntropyThreshold(7.5)
+      , _lzmaEntropyThreshold(5.0)
+      , _usesLzma(false)
+    {
+      this->SetEncoder(_deflate->GetEncoder());
+      this->SetDecoder(_deflate->GetDecoder());
+    }
+
+    static Ptr Create()
+    {
+      return std::make_shared<AutoMethod>();
+    }
+
+    compression_encoder_properties_interface& GetEncoderProperties() override
+    {
+      return _deflate->GetEncoderProperties();
+    }
+
+    compression_decoder_properties_interface& GetDecoderProperties() override
+    {
+      return _deflate->GetDecoderProperties();
+    }
+
+    const ZipMethodDescriptor& GetZipMethodDescriptor() const override
+    {
+      return _deflate->GetZipMethodDescriptor();
+    }
+
+    // the methods it picks from, so they can be configured, i.e. with a compression level, before it's set on entries
+    const StoreMethod::Ptr& GetStoreMethod() const { return _store; }
+    const DeflateMethod::Ptr& GetDeflateMethod() const { return _deflate; }
+    const LzmaMethod::Ptr& GetLzmaMethod() const { return _lzma; }
+
+    // in bits per byte, from 0 to 8, at or above which the start of an entry looks too random to compress
+    double GetStoreEntropyThreshold() const { return _storeEntropyThreshold; }
+    void SetStoreEntropyThreshold(double storeEntropyThreshold) { _storeEntropyThreshold = storeEntropyThreshold; }
+
+    // in bits per byte, below which an entry is compressed with LZMA instead of Deflate if LZMA is allowed
+    double GetLzmaEntropyThreshold() const { return _lzmaEntropyThreshold; }
+    void SetLzmaEntropyThreshold(double lzmaEntropyThreshold) { _lzmaEntropyThreshold = lzmaEntropyThreshold; }
+
+    // off by default, since not every unzipper supports LZMA (i.e. Scratch can't load an .sb3 with it)
+    bool GetUsesLzma() const { return _usesLzma; }
+    void SetUsesLzma(bool usesLzma) { _usesLzma = usesLzma; }
+
+    /**
+     * \brief Picks the method for an entry from its name and the start of its data.
+     *        It's a new copy of one of the configured methods, so it's only used by that entry.
+     *
+     * \param fileName  The name of the entry, for its extension.
+     * \param prefix    The first bytes of the entry, ideally ProbeSize of them, or all of them if it's smaller.
+     */
+    ICompressionMethod::Ptr Select(std::string_view fileName, const uint8_t* prefix, size_t length) const
+    {
+      if (length == 0 || IsCompressedExtension(fileName) || IsCompressedFormat(prefix, length))
+      {
+        return std::make_shared<StoreMethod>(*_store);
+      }
+
+      const double entropy = GetEntropy(prefix, length);
+      if (entropy >= _storeEntropyThreshold)
+      {
+        return std::make_shared<StoreMethod>(*_store);
+      }
+      if (_usesLzma && entropy < _lzmaEntropyThreshold)
+      {
+        return std::make_shared<LzmaMethod>(*_lzma);
+      }
+      return std::make_shared<DeflateMethod>(*_deflate);
+    }
+
+    /**
+     * \brief Picks the method for an entry, reading the start of its stream and seeking back.
+     *        If the stream isn't seekable, it's picked by the name alone.
+     */
+    ICompressionMethod::Ptr Select(std::string_view fileName, std::istream& stream) const
+    {
+      const auto position = stream.tellg();
+      if (position == std::istream::pos_type(-1))
+      {
+        return IsCompressedExtension(fileName)
+               ? ICompressionMethod::Ptr(std::make_shared<StoreMethod>(*_store))
+               : ICompressionMethod::Ptr(std::make_shared<DeflateMethod>(*_deflate));
+      }
+
+      std::array<uint8_t, ProbeSize> prefix;
+      stream.read(reinterpret_cast<char*>(prefix.data()), prefix.size());
+      const auto length = static_cast<size_t>(stream.gcount());
+      stream.clear();
+      stream.seekg(position);
+      return Select(fileName, prefix.data(), length);
+    }
+
+    /**
+     * \brief Gets the order 0 entropy of some bytes in bits per byte, which is about how well they'd compress
+     *        with only Huffman coding (8 for random bytes, around 4.5 for English text).
+     */
+    static double GetEntropy(const uint8_t* data, size_t length)
+    {
+      if (length == 0)
+      {
+        return 0;
+      }
+
+      std::array<size_t, 256> counts = {};
+      for (size_t i = 0; i < length; i++)
+      {
+        counts[data[i]]++;
+      }
+
+      double entropy = 0;
+      for (const auto count : counts)
+      {
+        if (count != 0)
+        {
+          const double p = static_cast<double>(count) / static_cast<double>(length);
+          entropy -= p * std::log2(p);
+        }
+      }
+      return entropy;
+    }
+
+    /**
+     * \brief Checks if a file name has the extension of a format that's already compressed.
+     */
+    static bool IsCompressedExtension(std::string_view fileName)
+    {
+      const auto dot = fileName.rfind('.');
+      if (dot == std::string_view::npos || fileName.find('/', dot) != std::string_view::npos)
+      {
+        return false;
+      }
+      const auto extension = fileName.substr(dot + 1);
+
+      static constexpr std::string_view CompressedExtensions[] = {
+        // images
+        "png", "jpg", "jpeg", "gif", "webp",
+        // audio and video
+        "mp3", "ogg", "oga", "opus", "m4a", "aac", "flac", "mp4", "webm",
+        // archives, including Scratch projects and sprites
+        "zip", "sb", "sb2", "sb3", "sprite2", "sprite3", "gz", "tgz", "bz2", "xz", "lzma", "7z", "zst",
+        // fonts
+        "woff", "woff2",
+      };
+      return std::any_of(std::begin(CompressedExtensions), std::end(CompressedExtensions), [extension](std::string_view compressed)
+      {
+        return std::equal(extension.begin(), extension.end(), compressed.begin(), compressed.end(), [](char a, char b)
+        {
+          return std::tolower(static_cast<unsigned char>(a)) == b;
+        });
+      });
+    }
+
+    /**
+     * \brief Checks if some data starts with the magic bytes of a format that's already compressed.
+     *        WAV is only compressed if it's not PCM, like the ADPCM WAVs Scratch saves.
+     */
+    static bool IsCompressedFormat(const uint8_t* data, size_t length)
+    {
+      const auto startsWith = [data, length](std::string_view magic, size_t offset = 0)
+      {
+        return length >= offset + magic.size() && std::memcmp(data + offset, magic.data(), magic.size()) == 0;
+      };
+
+      if (startsWith("RIFF") && startsWith("WAVE", 8))
+      {
+        // the format tag of the fmt chunk, which is almost always first
+        if (!startsWith("fmt ", 12) || length < 22)
+        {
+          return false;
+        }
+        const auto formatTag = static_cast<uint16_t>(data[20] | data[21] << 8);
+        constexpr uint16_t Pcm = 1;
+        constexpr uint16_t IeeeFloat = 3;
+        constexpr uint16_t Extensible = 0xFFFE;
+        return formatTag != Pcm && formatTag != IeeeFloat && formatTag != Extensible;
+      }
+
+      // an MPEG audio frame header, for MP3s without an ID3 tag: the sync, layer III, and a valid bitrate and sample rate,
+      // which rules out text that starts with a UTF-16LE byte order mark (FF FE would be layer I)
+      if (length >= 3 && data[0] == 0xFF && (data[1] & 0xE0) == 0xE0 && (data[1] & 0x06) == 0x02
+          && (data[2] & 0xF0) != 0xF0 && (data[2] & 0x0C) != 0x0C)
+      {
+        return true;
+      }
+
+      static constexpr std::string_view Magics[] = {
+        std::string_view("\x89PNG\r\n\x1A\n", 8),
+        std::string_view("\xFF\xD8\xFF", 3),            // JPEG
+        std::string_view("GIF8", 4),
+        std::string_view("ID3", 3),                     // MP3
+        std::string_view("OggS", 4),
+        std::string_view("fLaC", 4),
+        std::string_view("PK\x03\x04", 4),              // zip
+        std::string_view("\x1F\x8B", 2),                // gzip
+        std::string_view("BZh", 3),
+        std::string_view("\xFD" "7zXZ\0", 6),
+        std::string_view("7z\xBC\xAF\x27\x1C", 6),
+        std::string_view("\x28\xB5\x2F\xFD", 4),        // zstd
+        std::string_view("wOFF", 4),
+        std::string_view("wOF2", 4),
+      };
+      if (std::any_of(std::begin(Magics), std::end(Magics), [&](std::string_view magic) { return startsWith(magic); }))
+      {
+        return true;
+      }
+      return startsWith("RIFF") && startsWith("WEBP", 8);
+    }
+
+  private:
+    StoreMethod::Ptr   _store;
+    DeflateMethod::Ptr _deflate;
+    LzmaMethod::Ptr    _lzma;
+
+    double _storeEntropyThreshold;
+    double _lzmaEntropyThreshold;
+    bool   _usesLzma;
+};
@@ -40,6 +40,13 @@ class Bzip2Method :
     BlockSize GetBlockSize() const { return static_cast<BlockSize>(_encoderProps.BlockSize); }
     void SetBlockSize(BlockSize compressionLevel) { _encoderProps.BlockSize = static_cast<int>(compressionLevel); }
 
+    // the number of threads to compress and decompress on (0 for one per core), each working on its own blocks,
+    // 1 by default, since entries are already compressed and extracted in parallel;
+    // more than 1 compresses a little worse since the blocks are a bit smaller than BlockSize,
+    // but the output is then the same for any number above 1
+    size_t GetNumThreads() const { return _encoderProps.NumThreads; }
+    void SetNumThreads(size_t numThreads) { _encoderProps.NumThreads = _decoderProps.NumThreads = numThreads; }
+
   private:
     bzip2_encoder_properties _encoderProps;
     bzip2_decoder_properties _decoderProps;
@@ -40,6 +40,14 @@ class DeflateMethod :
     CompressionLevel GetCompressionLevel() const { return static_cast<CompressionLevel>(_encoderProps.CompressionLevel); }
     void SetCompressionLevel(CompressionLevel compressionLevel) { _encoderProps.CompressionLevel = static_cast<int>(compressionLevel); }
 
+    // compressing with more than 1 thread (0 for one per core) splits the input into independently compressed chunks,
+    // which makes the output a little bigger, but big entries compress as many times faster
+    size_t GetNumThreads() const { return _encoderProps.NumThreads; }
+    void SetNumThreads(size_t numThreads) { _encoderProps.NumThreads = numThreads; }
+
+    size_t GetChunkSize() const { return _encoderProps.ChunkSize; }
+    void SetChunkSize(size_t chunkSize) { _encoderProps.ChunkSize = chunkSize; }
+
   private:
     deflate_encoder_properties _encoderProps;
     deflate_decoder_properties _decoderProps;
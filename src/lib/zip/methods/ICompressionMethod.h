@@ -26,6 +26,17 @@
     this->SetDecoder(std::make_shared<decoder_class>());                        \
   }                                                                             \
                                                                                 \
+  /* a copy has the same properties, but its own encoder and decoder */         \
+  method_class(const method_class& other)                                       \
+    : encoder_props_member(other.encoder_props_member)                          \
+    , decoder_props_member(other.decoder_props_member)                          \
+  {                                                                             \
+    this->SetEncoder(std::make_shared<encoder_class>());                        \
+    this->SetDecoder(std::make_shared<decoder_class>());                        \
+  }                                                                             \
+                                                                                \
+  method_class& operator=(const method_class& other) = delete;                  \
+                                                                                \
   static Ptr Create()                                                           \
   {                                                                             \
     return std::make_shared<method_class>();                                    \
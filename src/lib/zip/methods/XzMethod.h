@@ -0,0 +1,53 @@
+#pragma once
+#include "ICompressionMethod.h"
+#include "../compression/xz/xz_encoder.h"
+#include "../compression/xz/xz_decoder.h"
+
+#include <memory>
+
+class XzMethod :
+  public ICompressionMethod
+{
+  public:
+    ZIP_METHOD_CLASS_PROLOGUE(
+      XzMethod,
+      xz_encoder, xz_decoder,
+      _encoderProps, _decoderProps,
+      /* CompressionMethod */ 95,
+      /* VersionNeededToExtract */ 63
+    );
+
+    enum class CompressionLevel : int
+    {
+      L1 = 1,
+      L2 = 2,
+      L3 = 3,
+      L4 = 4,
+      L5 = 5,
+      L6 = 6,
+      L7 = 7,
+      L8 = 8,
+      L9 = 9,
+
+      Fastest = L1,
+      Default = L6,
+      Best = L9
+    };
+
+    CompressionLevel GetCompressionLevel() const { return static_cast<CompressionLevel>(_encoderProps.CompressionLevel); }
+    void SetCompressionLevel(CompressionLevel compressionLevel) { _encoderProps.CompressionLevel = static_cast<int>(compressionLevel); }
+
+    // the number of threads to compress and decompress on (0 for one per core), 1 by default,
+    // since entries are already compressed in parallel, so this is for archives with a few big entries;
+    // more than 1 splits the input into blocks that are each compressed with a fresh dictionary,
+    // so smaller blocks compress a little worse, but are spread over more threads
+    size_t GetNumThreads() const { return _encoderProps.NumThreads; }
+    void SetNumThreads(size_t numThreads) { _encoderProps.NumThreads = _decoderProps.NumThreads = numThreads; }
+
+    size_t GetBlockSize() const { return _encoderProps.BlockSize; }
+    void SetBlockSize(size_t blockSize) { _encoderProps.BlockSize = blockSize; }
+
+  private:
+    xz_encoder_properties _encoderProps;
+    xz_decoder_properties _decoderProps;
+};
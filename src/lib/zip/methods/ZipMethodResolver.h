@@ -1,23 +1,100 @@
 #pragma once
 #include <cstdint>
+#include <iterator>
 #include <memory>
+#include <vector>
 #include "ICompressionMethod.h"
 
 #include "StoreMethod.h"
 #include "DeflateMethod.h"
 #include "Bzip2Method.h"
 #include "LzmaMethod.h"
+#include "XzMethod.h"
 
-#define ZIP_METHOD_TABLE          \
-  ZIP_METHOD_ADD(StoreMethod);    \
-  ZIP_METHOD_ADD(DeflateMethod);  \
-  ZIP_METHOD_ADD(Bzip2Method);    \
-  ZIP_METHOD_ADD(LzmaMethod);
+#define ZIP_METHOD_TABLE           \
+  ZIP_METHOD_ADD(StoreMethod);     \
+  ZIP_METHOD_ADD(DeflateMethod);   \
+  ZIP_METHOD_ADD(Bzip2Method);     \
+  ZIP_METHOD_ADD(LzmaMethod);      \
+  ZIP_METHOD_ADD(XzMethod);
 
 #define ZIP_METHOD_ADD(method_class)                                                            \
   if (compressionMethod == method_class::GetZipMethodDescriptorStatic().GetCompressionMethod()) \
     return method_class::Create()
 
+namespace detail
+{
+  /**
+   * \brief The idle method instances of one thread.
+   *        Their encoders and decoders are reset the next time they're initialized instead of rebuilt,
+   *        so their buffers and codec state (i.e. the inflate window or the LZMA dictionary) are reused.
+   */
+  class zip_method_pool
+  {
+    public:
+      // how many idle instances of each method are kept, since each can hold a lot of memory
+      static constexpr size_t MaxIdleInstances = 2;
+
+      ~zip_method_pool()
+      {
+        _destroyed = true;
+      }
+
+      /**
+       * \brief Gets this thread's pool.
+       *
+       * \return  null if the thread is exiting and its pool was already destroyed.
+       */
+      static zip_method_pool* current()
+      {
+        if (_destroyed)
+        {
+          return nullptr;
+        }
+        thread_local zip_method_pool pool;
+        return &pool;
+      }
+
+      ICompressionMethod::Ptr take(uint16_t compressionMethod)
+      {
+        for (auto it = _idle.rbegin(); it != _idle.rend(); ++it)
+        {
+          if ((*it)->GetZipMethodDescriptor().GetCompressionMethod() == compressionMethod)
+          {
+            auto method = std::move(*it);
+            _idle.erase(std::next(it).base());
+            return method;
+          }
+        }
+        return nullptr;
+      }
+
+      void put(ICompressionMethod::Ptr method)
+      {
+        const auto compressionMethod = method->GetZipMethodDescriptor().GetCompressionMethod();
+        size_t count = 0;
+        for (const auto& idle : _idle)
+        {
+          count += idle->GetZipMethodDescriptor().GetCompressionMethod() == compressionMethod;
+        }
+        if (count < MaxIdleInstances)
+        {
+          _idle.push_back(std::move(method));
+        }
+      }
+
+      void clear()
+      {
+        _idle.clear();
+      }
+
+    private:
+      std::vector<ICompressionMethod::Ptr> _idle;
+
+      static inline thread_local bool _destroyed = false;
+  };
+}
+
 struct ZipMethodResolver
 {
   static ICompressionMethod::Ptr GetZipMethodInstance(uint16_t compressionMethod)
@@ -25,6 +102,48 @@ struct ZipMethodResolver
     ZIP_METHOD_TABLE;
     return ICompressionMethod::Ptr();
   }
+
+  /**
+   * \brief Gets an instance from this thread's pool, or a new one if there isn't an idle one.
+   *        When the last reference to it is released, it goes back to the pool of the thread that released it,
+   *        so decompressing many entries in a row doesn't allocate a new codec for each one.
+   *        The instance is shared over time, so its properties shouldn't be changed.
+   */
+  static ICompressionMethod::Ptr GetPooledZipMethodInstance(uint16_t compressionMethod)
+  {
+    auto* pool = detail::zip_method_pool::current();
+    ICompressionMethod::Ptr method = pool ? pool->take(compressionMethod) : nullptr;
+    if (method == nullptr)
+    {
+      method = GetZipMethodInstance(compressionMethod);
+      if (method == nullptr)
+      {
+        return method;
+      }
+    }
+
+    // the returned pointer owns a reference to the pooled one, which is returned to the pool when it's deleted
+    auto* const instance = method.get();
+    return ICompressionMethod::Ptr(instance, [method = std::move(method)](ICompressionMethod*) mutable
+    {
+      if (auto* pool = detail::zip_method_pool::current())
+      {
+        pool->put(std::move(method));
+      }
+      method = nullptr;
+    });
+  }
+
+  /**
+   * \brief Frees the idle instances in this thread's pool.
+   */
+  static void ReleasePooledZipMethodInstances()
+  {
+    if (auto* pool = detail::zip_method_pool::current())
+    {
+      pool->clear();
+    }
+  }
 };
 
 #undef ZIP_METHOD
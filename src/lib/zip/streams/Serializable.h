@@ -18,6 +18,10 @@ struct Serializable {
         ::deserializeWithPadding<T>(stream, reinterpret_cast<T&>(*this));
     }
     
+    bool deserializeBase(std::string_view& buffer) {
+        return ::deserializeWithPadding<T>(buffer, reinterpret_cast<T&>(*this));
+    }
+    
     void serializeBase(std::ostream& stream) const {
         ::serializeWithPadding<T>(stream, reinterpret_cast<const T&>(*this));
     }
@@ -46,6 +46,11 @@ class basic_compression_decoder_stream
       return _compressionDecoderStreambuf.init(compressionDecoder, props, stream);
     }
 
+    bool init(icompression_decoder_ptr_type compressionDecoder, compression_decoder_properties_interface& props, const ELEM_TYPE* input, size_t length)
+    {
+      return _compressionDecoderStreambuf.init(compressionDecoder, props, input, length);
+    }
+
     bool is_init() const
     {
       return _compressionDecoderStreambuf.is_init();
@@ -61,6 +66,16 @@ class basic_compression_decoder_stream
       return _compressionDecoderStreambuf.get_bytes_written();
     }
 
+    void verify(uint32_t expectedCrc32, size_t expectedSize)
+    {
+      _compressionDecoderStreambuf.verify(expectedCrc32, expectedSize);
+    }
+
+    uint32_t get_crc32() const
+    {
+      return _compressionDecoderStreambuf.get_crc32();
+    }
+
   private:
     compression_decoder_streambuf<ELEM_TYPE, TRAITS_TYPE> _compressionDecoderStreambuf;
 };
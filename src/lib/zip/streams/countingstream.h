@@ -0,0 +1,51 @@
+#pragma once
+#include <ostream>
+#include <cstdint>
+#include "streambuffs/counting_streambuf.h"
+
+/**
+ * \brief Basic output stream that counts what is written to an existing output stream.
+ *        tellp() returns the count without seeking the existing stream, and other seeks fail.
+ */
+template <typename ELEM_TYPE, typename TRAITS_TYPE>
+class basic_ocountingstream
+  : public std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>
+{
+  public:
+    basic_ocountingstream()
+      : std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>(&_countingStreambuf)
+    {
+
+    }
+
+    basic_ocountingstream(std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>& output)
+      : std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>(&_countingStreambuf)
+      , _countingStreambuf(output)
+    {
+
+    }
+
+    void init(std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>& output)
+    {
+      _countingStreambuf.init(output);
+    }
+
+    bool is_init() const
+    {
+      return _countingStreambuf.is_init();
+    }
+
+    uint64_t get_count() const
+    {
+      return _countingStreambuf.get_count();
+    }
+
+  private:
+    counting_streambuf<ELEM_TYPE, TRAITS_TYPE> _countingStreambuf;
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+typedef basic_ocountingstream<uint8_t, std::char_traits<uint8_t>>  byte_ocountingstream;
+typedef basic_ocountingstream<char, std::char_traits<char>>        ocountingstream;
+typedef basic_ocountingstream<wchar_t, std::char_traits<wchar_t>>  wocountingstream;
@@ -3,7 +3,7 @@
 #include "streambuffs/crc32_streambuf.h"
 
 /**
- * \brief Basic CRC32 output stream. Computes CRC32 of input data.
+ * \brief Basic CRC32 output stream. Computes CRC32 of input data, and its SHA-256 if asked to.
  */
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class basic_crc32stream
@@ -23,9 +23,9 @@ class basic_crc32stream
 
     }
 
-    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& stream)
+    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& stream, bool computesSha256 = false)
     {
-      _crc32Streambuf.init(stream);
+      _crc32Streambuf.init(stream, computesSha256);
     }
 
     size_t get_bytes_read() const
@@ -38,6 +38,11 @@ class basic_crc32stream
       return _crc32Streambuf.get_crc32();
     }
 
+    std::optional<std::array<uint8_t, SHA256_DIGEST_SIZE>> get_sha256() const
+    {
+      return _crc32Streambuf.get_sha256();
+    }
+
   private:
     crc32_streambuf<ELEM_TYPE, TRAITS_TYPE> _crc32Streambuf;
 };
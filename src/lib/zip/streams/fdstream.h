@@ -0,0 +1,61 @@
+#pragma once
+#include <ostream>
+#include "streambuffs/fd_streambuf.h"
+
+/**
+ * \brief Output stream writing to a file descriptor.
+ *        Archives written to one copy unchanged entries inside the kernel.
+ */
+class ofdstream
+  : public std::ostream
+{
+  public:
+    ofdstream()
+      : std::ostream(&_fdStreambuf)
+    {
+
+    }
+
+    /**
+     * \param ownsFd  If the file descriptor is closed with the stream.
+     */
+    ofdstream(int fd, bool ownsFd)
+      : std::ostream(&_fdStreambuf)
+      , _fdStreambuf(fd, ownsFd)
+    {
+
+    }
+
+    /**
+     * \brief Creates or truncates the file at path and writes to it.
+     */
+    explicit ofdstream(const char* path)
+      : std::ostream(&_fdStreambuf)
+    {
+      open(path);
+    }
+
+    void open(const char* path)
+    {
+      if (!_fdStreambuf.open(path))
+      {
+        this->setstate(std::ios::failbit);
+      }
+    }
+
+    void close()
+    {
+      if (!_fdStreambuf.close())
+      {
+        this->setstate(std::ios::failbit);
+      }
+    }
+
+    bool is_open() const
+    {
+      return _fdStreambuf.is_init();
+    }
+
+  private:
+    fd_streambuf _fdStreambuf;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <istream>
+#include "streambuffs/pread_streambuf.h"
+
+/**
+ * \brief Input stream over a slice of a file, read with pread().
+ *        Unlike isubstream, it doesn't seek a shared stream,
+ *        so streams over the same file can be read from different threads at once.
+ */
+class ipreadstream
+  : public std::istream
+{
+  public:
+    ipreadstream()
+      : std::istream(&_preadStreambuf)
+    {
+
+    }
+
+    ipreadstream(const RandomAccessFile& file, uint64_t startOffset, size_t length)
+      : std::istream(&_preadStreambuf)
+      , _preadStreambuf(file, startOffset, length)
+    {
+
+    }
+
+    void init(const RandomAccessFile& file, uint64_t startOffset, size_t length)
+    {
+      _preadStreambuf.init(file, startOffset, length);
+    }
+
+    bool is_init() const
+    {
+      return _preadStreambuf.is_init();
+    }
+
+  private:
+    pread_streambuf _preadStreambuf;
+};
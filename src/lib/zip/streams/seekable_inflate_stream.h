@@ -0,0 +1,23 @@
+#pragma once
+#include <istream>
+#include "streambuffs/seekable_inflate_streambuf.h"
+
+/**
+ * \brief Raw deflate decompression stream that supports seeking, see seekable_inflate_streambuf.
+ */
+class seekable_inflate_stream
+  : public std::istream
+{
+  public:
+    typedef seekable_inflate_streambuf::input_opener input_opener;
+
+    seekable_inflate_stream(input_opener openInput, std::shared_ptr<DeflateIndex> index, u64 size)
+      : std::istream(&_seekableInflateStreambuf)
+      , _seekableInflateStreambuf(std::move(openInput), std::move(index), size)
+    {
+
+    }
+
+  private:
+    seekable_inflate_streambuf _seekableInflateStreambuf;
+};
@@ -2,7 +2,9 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstring>
 
 template <typename T>
 size_t constexpr paddingSize() {
@@ -81,6 +83,56 @@ deserialize(std::basic_istream<E, Traits>& stream, Vector<VectorElement, Allocat
     return 0;
 }
 
+template <size_t paddingSize, typename R>
+bool deserialize(std::string_view& buffer, R& out) {
+    constexpr size_t size = sizeof(R) - paddingSize;
+    if (buffer.size() < size) {
+        return false;
+    }
+    std::memcpy(&out, buffer.data(), size);
+    buffer.remove_prefix(size);
+    return true;
+}
+
+/**
+ * \brief Deserializes the basic input type from the front of a buffer and advances the buffer past it.
+ *
+ * \tparam  R  Type of the value to be deserialized.
+ * \param   buffer    The buffer to be deserialized from.
+ * \param   [out] out The deserialized value.
+ *
+ * \return  false if the buffer is too short, in which case neither out nor buffer are changed.
+ */
+template <typename R>
+bool deserialize(std::string_view& buffer, R& out) {
+    return deserialize<0, R>(buffer, out);
+}
+
+// assumes R is padded with a member called padding
+template <typename R>
+bool deserializeWithPadding(std::string_view& buffer, R& out) {
+    return deserialize<paddingSize<R>(), R>(buffer, out);
+}
+
+/**
+ * \brief Deserializes a string or vector of bytes from the front of a buffer and advances the buffer past it.
+ *
+ * \param   buffer    The buffer to be deserialized from.
+ * \param   [out] out The deserialized string or vector.
+ * \param   length    The expected amount of elements.
+ *
+ * \return  false if the buffer is too short, in which case neither out nor buffer are changed.
+ */
+template <typename Container>
+bool deserialize(std::string_view& buffer, Container& out, size_t length) {
+    if (buffer.size() < length) {
+        return false;
+    }
+    out.assign(buffer.data(), buffer.data() + length);
+    buffer.remove_prefix(length);
+    return true;
+}
+
 template <size_t paddingSize, typename T, typename E, typename Traits>
 void serialize(std::basic_ostream<E, Traits>& stream, const T& value) {
     stream.write(reinterpret_cast<const E*>(&value), ((sizeof(T) - paddingSize) / sizeof(E)));
@@ -114,6 +166,16 @@ void serialize(std::basic_ostream<E, Traits>& stream, const String<E, Traits, Al
     stream.write(reinterpret_cast<const E*>(value.data()), value.length());
 }
 
+/**
+ * \brief Serializes the string view.
+ * \param   stream    The stream to be serialized into.
+ * \param   value     The string view to be serialized.
+ */
+template <typename E, typename Traits>
+void serialize(std::basic_ostream<E, Traits>& stream, std::basic_string_view<E, Traits> value) {
+    stream.write(value.data(), value.length());
+}
+
 /**
  * \brief Serializes the vector.
  *
@@ -3,9 +3,13 @@
 #include <streambuf>
 #include <istream>
 #include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <stdexcept>
+#include <string>
 
 #include "../../compression/compression_interface.h"
+#include "../../utils/crc32_utils.h"
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class compression_decoder_streambuf
@@ -30,6 +34,13 @@ public:
 private:
     
     icompression_decoder_ptr_type _compressionDecoder;
+    
+    bool _verify = false;
+    uint32_t _expectedCrc32 = 0;
+    size_t _expectedSize = 0;
+    uint32_t _crc32 = 0;
+    size_t _bytesDecoded = 0;
+    bool _crc32Checked = false;
 
 public:
     
@@ -45,8 +56,15 @@ public:
         init(compressionDecoder, stream);
     }
     
+    compression_decoder_streambuf(icompression_decoder_ptr_type compressionDecoder,
+                                  compression_decoder_properties_interface& props,
+                                  const ELEM_TYPE* input, size_t length) {
+        init(compressionDecoder, props, input, length);
+    }
+    
     void init(icompression_decoder_ptr_type compressionDecoder, istream_type& stream) {
         _compressionDecoder = compressionDecoder;
+        reset_verification();
         
         // compression decoder init
         _compressionDecoder->init(stream);
@@ -59,6 +77,7 @@ public:
     void init(icompression_decoder_ptr_type compressionDecoder, compression_decoder_properties_interface& props,
               istream_type& stream) {
         _compressionDecoder = compressionDecoder;
+        reset_verification();
         
         // compression decoder init
         _compressionDecoder->init(stream, props);
@@ -68,6 +87,27 @@ public:
                    _compressionDecoder->get_buffer_end());
     }
     
+    /**
+     * \brief Decodes directly from input instead of from a stream, if the decoder supports it.
+     *
+     * \return false if the decoder doesn't support memory input.
+     */
+    bool init(icompression_decoder_ptr_type compressionDecoder, compression_decoder_properties_interface& props,
+              const ELEM_TYPE* input, size_t length) {
+        _compressionDecoder = compressionDecoder;
+        reset_verification();
+        
+        // compression decoder init
+        if (!_compressionDecoder->init(input, length, props)) {
+            return false;
+        }
+        
+        // set stream buffer
+        this->setg(_compressionDecoder->get_buffer_end(), _compressionDecoder->get_buffer_end(),
+                   _compressionDecoder->get_buffer_end());
+        return true;
+    }
+    
     bool is_init() const {
         return _compressionDecoder->is_init();
     }
@@ -79,17 +119,69 @@ public:
     size_t get_bytes_written() const {
         return _compressionDecoder->get_bytes_written();
     }
+    
+    /**
+     * \brief Checks the decoded data against its expected CRC-32 and size.
+     *        The CRC-32 is updated as each block is decoded, while it's still in cache,
+     *        and once expectedSize bytes (not elements) have been decoded, or the data ends before that,
+     *        underflow() throws a std::runtime_error describing the mismatch, if there is one.
+     *        The stream then sets its badbit, and rethrows it if its exceptions() include badbit.
+     *        Must be called after init() and before anything is read.
+     */
+    void verify(uint32_t expectedCrc32, size_t expectedSize) {
+        _verify = true;
+        _expectedCrc32 = expectedCrc32;
+        _expectedSize = expectedSize;
+    }
+    
+    /**
+     * \brief Gets the CRC-32 of everything decoded so far, if verify() was called.
+     */
+    uint32_t get_crc32() const {
+        return _crc32;
+    }
+
+private:
+    
+    void reset_verification() {
+        _verify = false;
+        _crc32 = 0;
+        _bytesDecoded = 0;
+        _crc32Checked = false;
+    }
+    
+    void check_verification(const ELEM_TYPE* decoded, size_t n) {
+        _crc32 = utils::crc32::update(_crc32, decoded, n * sizeof(ELEM_TYPE));
+        _bytesDecoded += n * sizeof(ELEM_TYPE);
+        
+        if (_bytesDecoded > _expectedSize || (n == 0 && _bytesDecoded < _expectedSize)) {
+            throw std::runtime_error("decoded size mismatch: expected " + std::to_string(_expectedSize)
+                                     + " bytes, got " + (n == 0 ? "" : "at least ") + std::to_string(_bytesDecoded));
+        }
+        if (_bytesDecoded == _expectedSize && !_crc32Checked && _crc32 != _expectedCrc32) {
+            char message[64];
+            std::snprintf(message, sizeof(message), "crc32 mismatch: expected %08x, got %08x",
+                          static_cast<unsigned>(_expectedCrc32), static_cast<unsigned>(_crc32));
+            throw std::runtime_error(message);
+        }
+        _crc32Checked = _bytesDecoded == _expectedSize;
+    }
 
 protected:
     
     int_type underflow() override {
         // buffer exhausted
         if (this->gptr() >= this->egptr()) {
-            ELEM_TYPE* base = _compressionDecoder->get_buffer_begin();
-            
             // how many bytes has been read
             size_t n = _compressionDecoder->decode_next();
             
+            // the decoder allocates its buffer on first use
+            ELEM_TYPE* base = _compressionDecoder->get_buffer_begin();
+            
+            if (_verify) {
+                check_verification(base, n);
+            }
+            
             if (n == 0) {
                 return traits_type::eof();
             }
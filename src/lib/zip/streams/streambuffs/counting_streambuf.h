@@ -0,0 +1,105 @@
+#pragma once
+#include <streambuf>
+#include <ostream>
+#include <cstdint>
+
+/**
+ * \brief Output stream buffer that forwards everything to an output stream and counts what was written.
+ *        It never seeks the output stream, it only answers tellp() with the count,
+ *        so it works for pipes and sockets.
+ */
+template <typename ELEM_TYPE, typename TRAITS_TYPE>
+class counting_streambuf :
+  public std::basic_streambuf<ELEM_TYPE, TRAITS_TYPE>
+{
+  public:
+    typedef std::basic_streambuf<ELEM_TYPE, TRAITS_TYPE> base_type;
+    typedef typename std::basic_streambuf<ELEM_TYPE, TRAITS_TYPE>::traits_type traits_type;
+
+    typedef typename base_type::char_type char_type;
+    typedef typename base_type::int_type  int_type;
+    typedef typename base_type::pos_type  pos_type;
+    typedef typename base_type::off_type  off_type;
+
+    counting_streambuf()
+      : _outputStream(nullptr)
+      , _count(0)
+    {
+
+    }
+
+    counting_streambuf(std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>& output)
+      : counting_streambuf()
+    {
+      init(output);
+    }
+
+    void init(std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>& output)
+    {
+      _outputStream = &output;
+      _count = 0;
+    }
+
+    bool is_init() const
+    {
+      return _outputStream != nullptr;
+    }
+
+    uint64_t get_count() const
+    {
+      return _count;
+    }
+
+  protected:
+    int_type overflow(int_type c) override
+    {
+      if (traits_type::eq_int_type(c, traits_type::eof()))
+      {
+        return traits_type::not_eof(c);
+      }
+
+      if (!_outputStream->put(traits_type::to_char_type(c)))
+      {
+        return traits_type::eof();
+      }
+
+      _count++;
+      return c;
+    }
+
+    std::streamsize xsputn(const char_type* s, std::streamsize n) override
+    {
+      if (!_outputStream->write(s, n))
+      {
+        return 0;
+      }
+
+      _count += static_cast<uint64_t>(n);
+      return n;
+    }
+
+    int sync() override
+    {
+      return _outputStream->flush() ? 0 : -1;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::out) override
+    {
+      // only tellp() is supported
+      if (off == 0 && dir == std::ios_base::cur && (which & std::ios_base::out))
+      {
+        return pos_type(static_cast<off_type>(_count));
+      }
+
+      return pos_type(off_type(-1));
+    }
+
+    pos_type seekpos(pos_type, std::ios_base::openmode) override
+    {
+      return pos_type(off_type(-1));
+    }
+
+  private:
+    std::basic_ostream<ELEM_TYPE, TRAITS_TYPE>* _outputStream;
+    uint64_t _count;
+};
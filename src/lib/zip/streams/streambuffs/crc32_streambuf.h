@@ -1,10 +1,13 @@
 #pragma once
 
 #include <streambuf>
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <optional>
 
-#include "../substream.h"
-#include "../../extlibs/zlib/zlib.h"
+#include "../../utils/crc32_utils.h"
+#include "../../extlibs/lzma/unix/Sha256.h"
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class crc32_streambuf
@@ -25,12 +28,11 @@ private:
     static constexpr size_t INTERNAL_BUFFER_SIZE = 1 << 15;
     
     ELEM_TYPE _internalBuffer[INTERNAL_BUFFER_SIZE];
-    ELEM_TYPE* _internalBufferEnd = _internalBuffer + INTERNAL_BUFFER_SIZE;
-    ELEM_TYPE* _internalBufferPosition = _internalBufferEnd;
     
     std::basic_istream<ELEM_TYPE, TRAITS_TYPE>* _inputStream = nullptr;
     size_t _bytesRead = 0;
     uint32_t _crc32 = 0;
+    std::optional<CSha256> _sha256;
 
 public:
     
@@ -41,11 +43,19 @@ public:
         init(input);
     }
     
-    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input) {
+    /**
+     * \param computesSha256  (Optional) If the SHA-256 of the input is computed too, see get_sha256().
+     */
+    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, bool computesSha256 = false) {
         _inputStream = &input;
+        _bytesRead = 0;
+        _crc32 = 0;
+        _sha256.reset();
+        if (computesSha256) {
+            Sha256_Init(&_sha256.emplace());
+        }
         
-        ELEM_TYPE* endOfBuffer = _internalBuffer + INTERNAL_BUFFER_SIZE;
-        this->setg(endOfBuffer, endOfBuffer, endOfBuffer);
+        this->setg(_internalBuffer, _internalBuffer, _internalBuffer);
     }
     
     bool is_init() const {
@@ -56,38 +66,71 @@ public:
         return _bytesRead;
     }
     
+    /**
+     * \brief Gets the CRC-32 of everything read from the input so far,
+     *        which is read a block at a time, so it's the CRC-32 of the whole input once this has been read to the end.
+     */
     uint32_t get_crc32() const {
         return _crc32;
     }
+    
+    /**
+     * \brief Gets the SHA-256 of everything read from the input so far, like get_crc32(),
+     *        if it was asked for in init().
+     */
+    std::optional<std::array<uint8_t, SHA256_DIGEST_SIZE>> get_sha256() const {
+        if (!_sha256) {
+            return std::nullopt;
+        }
+        // finishing it pads it, so finish a copy
+        auto sha256 = *_sha256;
+        std::array<uint8_t, SHA256_DIGEST_SIZE> digest;
+        Sha256_Final(&sha256, digest.data());
+        return digest;
+    }
+
+private:
+    
+    size_t read(ELEM_TYPE* buffer, size_t length) {
+        _inputStream->read(buffer, static_cast<std::streamsize>(length));
+        const auto n = static_cast<size_t>(_inputStream->gcount());
+        _bytesRead += n;
+        _crc32 = utils::crc32::update(_crc32, buffer, n * sizeof(ELEM_TYPE));
+        if (_sha256) {
+            Sha256_Update(&*_sha256, reinterpret_cast<const Byte*>(buffer), n * sizeof(ELEM_TYPE));
+        }
+        return n;
+    }
 
 protected:
     
     int_type underflow() override {
         // buffer exhausted
-        if (this->gptr() >= _internalBufferEnd) {
-            _inputStream->read(_internalBuffer, static_cast<std::streamsize>(INTERNAL_BUFFER_SIZE));
-            size_t n = static_cast<size_t>(_inputStream->gcount());
-            
-            _bytesRead += n;
-            
-            _internalBufferPosition = _internalBuffer;
-            _internalBufferEnd = _internalBuffer + n;
-            
+        if (this->gptr() >= this->egptr()) {
+            const auto n = read(_internalBuffer, INTERNAL_BUFFER_SIZE);
+            this->setg(_internalBuffer, _internalBuffer, _internalBuffer + n);
             if (n == 0) {
                 return traits_type::eof();
             }
         }
         
-        // set buffer pointers, increment current position
-        ELEM_TYPE* base = _internalBufferPosition++;
-        
-        // setting all pointers to the same position forces calling of this method each time,
-        // so crc32 really represents the checksum of what really has been read
-        this->setg(base, base, base + 1);
-        
-        _crc32 = crc32(_crc32, reinterpret_cast<Bytef*>(this->gptr()), static_cast<uInt>(sizeof(ELEM_TYPE)));
-        
         return traits_type::to_int_type(*this->gptr());
     }
     
+    std::streamsize xsgetn(char_type* s, std::streamsize count) override {
+        // first what's left in the buffer
+        const auto buffered = std::min<std::streamsize>(this->egptr() - this->gptr(), count);
+        traits_type::copy(s, this->gptr(), static_cast<size_t>(buffered));
+        this->gbump(static_cast<int>(buffered));
+        if (buffered == count) {
+            return count;
+        }
+        
+        // large reads go straight into s instead of through the buffer
+        if (static_cast<size_t>(count - buffered) >= INTERNAL_BUFFER_SIZE) {
+            return buffered + static_cast<std::streamsize>(read(s + buffered, static_cast<size_t>(count - buffered)));
+        }
+        return buffered + base_type::xsgetn(s + buffered, count - buffered);
+    }
+    
 };
@@ -0,0 +1,266 @@
+#pragma once
+#include <streambuf>
+#include <algorithm>
+#include <memory>
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+/**
+ * \brief Buffered output stream buffer writing to a file descriptor.
+ *        Besides the usual writes, it can copy a range of another file descriptor to itself
+ *        inside the kernel with copy_file_range() or sendfile(), without the bytes passing through user space.
+ */
+class fd_streambuf :
+  public std::streambuf
+{
+  public:
+    typedef std::streambuf base_type;
+
+    typedef base_type::char_type char_type;
+    typedef base_type::int_type  int_type;
+    typedef base_type::pos_type  pos_type;
+    typedef base_type::off_type  off_type;
+
+    fd_streambuf()
+      : _fd(-1)
+      , _ownsFd(false)
+    {
+
+    }
+
+    /**
+     * \param ownsFd  If the file descriptor is closed with the stream buffer.
+     */
+    fd_streambuf(int fd, bool ownsFd)
+      : fd_streambuf()
+    {
+      init(fd, ownsFd);
+    }
+
+    virtual ~fd_streambuf()
+    {
+      close();
+    }
+
+    void init(int fd, bool ownsFd)
+    {
+      close();
+      _fd = fd;
+      _ownsFd = ownsFd;
+      if (_internalBuffer == nullptr)
+      {
+        _internalBuffer = std::make_unique<char_type[]>(INTERNAL_BUFFER_SIZE);
+      }
+      this->setp(_internalBuffer.get(), _internalBuffer.get() + INTERNAL_BUFFER_SIZE);
+    }
+
+    /**
+     * \brief Creates or truncates the file at path and writes to it.
+     *
+     * \return  false if the file can't be opened.
+     */
+    bool open(const char* path)
+    {
+      const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+      if (fd == -1)
+      {
+        return false;
+      }
+
+      init(fd, true);
+      return true;
+    }
+
+    /**
+     * \brief Flushes and closes the file descriptor if owned.
+     *
+     * \return  false if flushing or closing failed.
+     */
+    bool close()
+    {
+      if (!is_init())
+      {
+        return true;
+      }
+
+      bool ok = sync() == 0;
+      if (_ownsFd && ::close(_fd) == -1)
+      {
+        ok = false;
+      }
+
+      _fd = -1;
+      _ownsFd = false;
+      return ok;
+    }
+
+    bool is_init() const
+    {
+      return _fd != -1;
+    }
+
+    int fd() const
+    {
+      return _fd;
+    }
+
+    /**
+     * \brief Appends [offset, offset + length) of the file inFd to what's been written,
+     *        copying it inside the kernel with copy_file_range(), or sendfile() if that's not supported.
+     *
+     * \return  The number of bytes copied, which is less than length
+     *          if neither is supported for these files or inFd ends first.
+     *          The rest has to be copied through user space.
+     */
+    uint64_t copy_from(int inFd, uint64_t offset, uint64_t length)
+    {
+      if (sync() != 0)
+      {
+        return 0;
+      }
+
+      uint64_t copied = 0;
+      bool useCopyFileRange = true;
+      while (copied < length)
+      {
+        const size_t chunk = static_cast<size_t>(std::min<uint64_t>(length - copied, MAX_COPY_CHUNK_SIZE));
+        ssize_t n;
+        if (useCopyFileRange)
+        {
+          loff_t inOffset = static_cast<loff_t>(offset + copied);
+          n = copy_file_range(inFd, &inOffset, _fd, nullptr, chunk, 0);
+          if (n == -1 && errno != EINTR)
+          {
+            // e.g. different file systems on old kernels, or not a regular file
+            useCopyFileRange = false;
+            continue;
+          }
+        }
+        else
+        {
+          off_t inOffset = static_cast<off_t>(offset + copied);
+          n = sendfile(_fd, inFd, &inOffset, chunk);
+        }
+
+        if (n == -1 && errno == EINTR)
+        {
+          continue;
+        }
+
+        if (n <= 0)
+        {
+          break;
+        }
+
+        copied += static_cast<uint64_t>(n);
+      }
+
+      return copied;
+    }
+
+  protected:
+    int_type overflow(int_type c) override
+    {
+      if (!flush_buffer())
+      {
+        return traits_type::eof();
+      }
+
+      if (!traits_type::eq_int_type(c, traits_type::eof()))
+      {
+        *this->pptr() = traits_type::to_char_type(c);
+        this->pbump(1);
+      }
+
+      return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char_type* s, std::streamsize n) override
+    {
+      if (n < this->epptr() - this->pptr())
+      {
+        std::copy(s, s + n, this->pptr());
+        this->pbump(static_cast<int>(n));
+        return n;
+      }
+
+      // too big to be worth buffering, so write it directly
+      if (!flush_buffer() || !write_all(s, static_cast<size_t>(n)))
+      {
+        return 0;
+      }
+
+      return n;
+    }
+
+    int sync() override
+    {
+      return flush_buffer() ? 0 : -1;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::out) override
+    {
+      if (!(which & std::ios_base::out) || !flush_buffer())
+      {
+        return pos_type(off_type(-1));
+      }
+
+      const int whence = dir == std::ios_base::beg ? SEEK_SET : dir == std::ios_base::cur ? SEEK_CUR : SEEK_END;
+      return pos_type(static_cast<off_type>(lseek(_fd, static_cast<off_t>(off), whence)));
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::out) override
+    {
+      return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+  private:
+    bool flush_buffer()
+    {
+      if (!is_init())
+      {
+        return false;
+      }
+
+      const bool ok = write_all(this->pbase(), static_cast<size_t>(this->pptr() - this->pbase()));
+      this->setp(_internalBuffer.get(), _internalBuffer.get() + INTERNAL_BUFFER_SIZE);
+      return ok;
+    }
+
+    bool write_all(const char_type* data, size_t length)
+    {
+      while (length > 0)
+      {
+        const ssize_t n = ::write(_fd, data, length);
+        if (n == -1)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+
+          return false;
+        }
+
+        data += n;
+        length -= static_cast<size_t>(n);
+      }
+
+      return true;
+    }
+
+    enum : size_t
+    {
+      INTERNAL_BUFFER_SIZE = 1 << 18,
+      MAX_COPY_CHUNK_SIZE = 1 << 30
+    };
+
+    std::unique_ptr<char_type[]> _internalBuffer;
+
+    int _fd;
+    bool _ownsFd;
+};
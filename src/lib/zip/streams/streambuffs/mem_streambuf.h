@@ -68,7 +68,8 @@ class mem_streambuf
         if (which & std::ios::in)
         {
           // move gptr to the right position
-          this->gbump(static_cast<int>(this->eback() - this->gptr() + pos));
+          // (setg rather than gbump, which only takes an int and so can't seek past 2 GiB)
+          this->setg(this->eback(), this->eback() + off_type(pos), this->egptr());
 
           if (which & std::ios::out)
           {
@@ -118,7 +119,7 @@ class mem_streambuf
         if (off >= 0 && off <= off_type(this->egptr() - this->eback()))
         {
           // move gptr to the right position
-          this->gbump(static_cast<int>(this->eback() - this->gptr() + off));
+          this->setg(this->eback(), this->eback() + off, this->egptr());
           if (which & std::ios::out)
           {
             // change write position to match
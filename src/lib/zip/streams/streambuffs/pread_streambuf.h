@@ -0,0 +1,127 @@
+#pragma once
+#include <streambuf>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+#include "src/lib/zip/utils/RandomAccessFile.h"
+
+/**
+ * \brief Input stream buffer over [startOffset, startOffset + length) of a file.
+ *        Reads only with pread(), so it doesn't share a file position with anyone
+ *        and any number of them can read the same file from different threads.
+ */
+class pread_streambuf :
+  public std::streambuf
+{
+  public:
+    typedef std::streambuf base_type;
+
+    typedef base_type::char_type char_type;
+    typedef base_type::int_type  int_type;
+    typedef base_type::pos_type  pos_type;
+    typedef base_type::off_type  off_type;
+
+    pread_streambuf()
+      : _file(nullptr)
+      , _startPosition(0)
+      , _currentPosition(0)
+      , _endPosition(0)
+    {
+
+    }
+
+    pread_streambuf(const RandomAccessFile& file, uint64_t startOffset, size_t length)
+      : pread_streambuf()
+    {
+      init(file, startOffset, length);
+    }
+
+    void init(const RandomAccessFile& file, uint64_t startOffset, size_t length)
+    {
+      _file = &file;
+      _startPosition = std::min(startOffset, file.size());
+      _currentPosition = _startPosition;
+      _endPosition = _startPosition + std::min<uint64_t>(length, file.size() - _startPosition);
+      _internalBuffer = std::make_unique<char_type[]>(INTERNAL_BUFFER_SIZE);
+
+      // set stream buffer
+      this->setg(_internalBuffer.get(), _internalBuffer.get(), _internalBuffer.get());
+    }
+
+    bool is_init() const
+    {
+      return (_file != nullptr && _internalBuffer != nullptr);
+    }
+
+  protected:
+    int_type underflow() override
+    {
+      // buffer exhausted
+      if (this->gptr() >= this->egptr())
+      {
+        char_type* base = _internalBuffer.get();
+
+        const size_t n = _file->read(_currentPosition, base,
+          static_cast<size_t>(std::min<uint64_t>(INTERNAL_BUFFER_SIZE, _endPosition - _currentPosition)));
+
+        _currentPosition += n;
+
+        if (n == 0)
+        {
+          return traits_type::eof();
+        }
+
+        // set buffer pointers
+        this->setg(base, base, base + n);
+      }
+
+      return traits_type::to_int_type(*this->gptr());
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override
+    {
+      // position relative to the start of the slice of what is read next
+      const off_type current = static_cast<off_type>(_currentPosition - _startPosition) - (this->egptr() - this->gptr());
+      const off_type length = static_cast<off_type>(_endPosition - _startPosition);
+
+      off_type position = off;
+      if (dir == std::ios_base::cur)
+      {
+        position += current;
+      }
+      else if (dir == std::ios_base::end)
+      {
+        position += length;
+      }
+
+      return seekpos(pos_type(position), which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override
+    {
+      const off_type position = static_cast<off_type>(pos);
+      if (!(which & std::ios_base::in) || position < 0 || position > static_cast<off_type>(_endPosition - _startPosition))
+      {
+        return pos_type(off_type(-1));
+      }
+
+      // no file position to move, just drop the buffered bytes
+      _currentPosition = _startPosition + static_cast<uint64_t>(position);
+      this->setg(_internalBuffer.get(), _internalBuffer.get(), _internalBuffer.get());
+      return pos;
+    }
+
+  private:
+    enum : size_t
+    {
+      INTERNAL_BUFFER_SIZE = 1 << 15
+    };
+
+    std::unique_ptr<char_type[]> _internalBuffer;
+
+    const RandomAccessFile* _file;
+    uint64_t _startPosition;
+    uint64_t _currentPosition;
+    uint64_t _endPosition;
+};
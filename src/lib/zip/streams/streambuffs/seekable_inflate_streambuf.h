@@ -0,0 +1,230 @@
+#pragma once
+
+#include <streambuf>
+#include <istream>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "../../DeflateIndex.h"
+#include "../../extlibs/zlib/zlib.h"
+
+/**
+ * \brief Decompresses raw deflate data, and supports seeking by starting over
+ *        from the last access point in a DeflateIndex before where it seeks to.
+ *        Access points are added to the index as they're decompressed past for the first time,
+ *        so reading the whole stream once builds the whole index.
+ */
+class seekable_inflate_streambuf
+        : public std::streambuf {
+
+public:
+    
+    /**
+     * \brief Opens the compressed data, starting at the given offset into it.
+     */
+    typedef std::function<std::shared_ptr<std::istream>(u64 compressedOffset)> input_opener;
+
+private:
+    
+    static constexpr size_t INPUT_BUFFER_SIZE = 1 << 16;
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 1 << 17;
+    static constexpr size_t WINDOW_SIZE = DeflateIndex::windowSize;
+    
+    input_opener _openInput;
+    std::shared_ptr<std::istream> _input;
+    std::shared_ptr<DeflateIndex> _index;
+    u64 _size = 0; //< uncompressed size
+    
+    z_stream _zstream = {};
+    bool _zstreamInit = false;
+    bool _endOfStream = false;
+    
+    std::unique_ptr<u8[]> _inputBuffer;
+    u64 _inputEnd = 0; //< compressed offset of the end of what's been read into the input buffer
+    
+    // the last WINDOW_SIZE bytes decompressed before the output, and then the output,
+    // so the window before any access point in the output is right before it
+    std::unique_ptr<u8[]> _buffer;
+    size_t _windowLength = 0; //< only less than WINDOW_SIZE at the start of the data
+    u64 _bufferOffset = 0; //< uncompressed offset of the output
+
+public:
+    
+    seekable_inflate_streambuf(input_opener openInput, std::shared_ptr<DeflateIndex> index, u64 size)
+            : _openInput(std::move(openInput)), _index(std::move(index)), _size(size),
+              _inputBuffer(std::make_unique<u8[]>(INPUT_BUFFER_SIZE)),
+              _buffer(std::make_unique<u8[]>(WINDOW_SIZE + OUTPUT_BUFFER_SIZE)) {
+        restart(nullptr);
+    }
+    
+    ~seekable_inflate_streambuf() override {
+        if (_zstreamInit) {
+            inflateEnd(&_zstream);
+        }
+    }
+    
+    seekable_inflate_streambuf(const seekable_inflate_streambuf& other) = delete;
+    
+    seekable_inflate_streambuf& operator=(const seekable_inflate_streambuf& other) = delete;
+
+private:
+    
+    char* output() const noexcept {
+        return reinterpret_cast<char*>(_buffer.get() + WINDOW_SIZE);
+    }
+    
+    u64 position() const noexcept {
+        return _bufferOffset + (this->gptr() - this->eback());
+    }
+    
+    u64 outputEnd() const noexcept {
+        return _bufferOffset + (this->egptr() - this->eback());
+    }
+    
+    /**
+     * \brief Starts decompressing over from point, or from the start if it's null.
+     */
+    void restart(const DeflateIndex::AccessPoint* point) {
+        if (_zstreamInit) {
+            inflateEnd(&_zstream);
+        }
+        _zstream = {};
+        _zstreamInit = inflateInit2(&_zstream, -MAX_WBITS) == Z_OK;
+        _endOfStream = !_zstreamInit;
+        
+        // the first few bits of the access point are in the byte before it
+        const u64 compressedOffset = point ? point->compressedOffset - (point->bits ? 1 : 0) : 0;
+        _input = _openInput(compressedOffset);
+        _inputEnd = compressedOffset;
+        _zstream.avail_in = 0;
+        if (point && point->bits && _zstreamInit) {
+            const auto c = _input->get();
+            _inputEnd++;
+            if (c == std::istream::traits_type::eof()) {
+                _endOfStream = true;
+            } else {
+                inflatePrime(&_zstream, point->bits, static_cast<u8>(c) >> (8 - point->bits));
+            }
+        }
+        
+        _windowLength = point ? point->window.size() : 0;
+        if (point && _zstreamInit) {
+            std::memcpy(_buffer.get() + WINDOW_SIZE - _windowLength, point->window.data(), _windowLength);
+            inflateSetDictionary(&_zstream, point->window.data(), static_cast<uInt>(_windowLength));
+        }
+        _bufferOffset = point ? point->uncompressedOffset : 0;
+        this->setg(output(), output(), output());
+    }
+    
+    /**
+     * \brief Decompresses the next output, after moving the end of the current output into the window.
+     *
+     * \return  false at the end of the data.
+     */
+    bool refill() {
+        const size_t previous = static_cast<size_t>(this->egptr() - this->eback());
+        const size_t total = _windowLength + previous;
+        const size_t kept = std::min(total, WINDOW_SIZE);
+        std::memmove(_buffer.get() + WINDOW_SIZE - kept, _buffer.get() + WINDOW_SIZE - _windowLength + total - kept, kept);
+        _windowLength = kept;
+        _bufferOffset += previous;
+        this->setg(output(), output(), output());
+        if (_endOfStream) {
+            return false;
+        }
+        
+        const size_t n = inflate_next();
+        this->setg(output(), output(), output() + n);
+        return n != 0;
+    }
+    
+    size_t inflate_next() {
+        auto* const out = _buffer.get() + WINDOW_SIZE;
+        size_t produced = 0;
+        while (produced < OUTPUT_BUFFER_SIZE && !_endOfStream) {
+            if (_zstream.avail_in == 0) {
+                // even if there's no more input, inflate() may still have to finish the last block
+                _input->read(reinterpret_cast<char*>(_inputBuffer.get()), INPUT_BUFFER_SIZE);
+                const auto n = static_cast<uInt>(_input->gcount());
+                _inputEnd += n;
+                _zstream.next_in = _inputBuffer.get();
+                _zstream.avail_in = n;
+            }
+            
+            _zstream.next_out = out + produced;
+            _zstream.avail_out = static_cast<uInt>(OUTPUT_BUFFER_SIZE - produced);
+            // stop at the end of each block, so there can be an access point there
+            const int result = inflate(&_zstream, Z_BLOCK);
+            produced = OUTPUT_BUFFER_SIZE - _zstream.avail_out;
+            
+            if (result == Z_STREAM_END) {
+                _endOfStream = true;
+                if (_index) {
+                    // decompression always starts at an access point, so every one after it has been added now
+                    _index->markComplete();
+                }
+            } else if (result != Z_OK) {
+                // corrupt, or truncated if there's no more input
+                _endOfStream = true;
+            } else if (_index && (_zstream.data_type & 128) && !(_zstream.data_type & 64)) {
+                // at the end of a block that isn't the last one
+                _index->add(_bufferOffset + produced, _inputEnd - _zstream.avail_in,
+                            static_cast<u8>(_zstream.data_type & 7),
+                            out - _windowLength, _windowLength + produced);
+            }
+        }
+        return produced;
+    }
+
+protected:
+    
+    int_type underflow() override {
+        // buffer exhausted
+        if (this->gptr() >= this->egptr() && !refill()) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*this->gptr());
+    }
+    
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        off_type target = off;
+        if (dir == std::ios_base::cur) {
+            target += static_cast<off_type>(position());
+        } else if (dir == std::ios_base::end) {
+            target += static_cast<off_type>(_size);
+        }
+        if (target < 0 || static_cast<u64>(target) > _size) {
+            return pos_type(off_type(-1));
+        }
+        const auto offset = static_cast<u64>(target);
+        
+        // already decompressed
+        if (offset >= _bufferOffset && offset <= outputEnd()) {
+            this->setg(this->eback(), this->eback() + (offset - _bufferOffset), this->egptr());
+            return pos_type(target);
+        }
+        
+        // start over from the closest access point, unless it's quicker to keep going from here
+        const auto* point = _index ? _index->find(offset) : nullptr;
+        if (offset < _bufferOffset || (point && point->uncompressedOffset > outputEnd())) {
+            restart(point);
+        }
+        while (offset > outputEnd()) {
+            if (!refill()) {
+                return pos_type(off_type(-1));
+            }
+        }
+        this->setg(this->eback(), this->eback() + (offset - _bufferOffset), this->egptr());
+        return pos_type(target);
+    }
+    
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+};
@@ -2,6 +2,7 @@
 #include <streambuf>
 #include <istream>
 #include <cstdint>
+#include <mutex>
 
 template <typename ELEM_TYPE, typename TRAITS_TYPE>
 class sub_streambuf :
@@ -17,7 +18,9 @@ class sub_streambuf :
     typedef typename base_type::off_type  off_type;
 
     sub_streambuf()
-      : _inputStream(nullptr)
+      : _internalBuffer(nullptr)
+      , _inputStream(nullptr)
+      , _mutex(nullptr)
       , _startPosition(0)
       , _currentPosition(0)
       , _endPosition(0)
@@ -25,15 +28,20 @@ class sub_streambuf :
 
     }
 
-    sub_streambuf(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset, size_t length)
+    sub_streambuf(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset, size_t length, std::mutex* mutex = nullptr)
       : sub_streambuf()
     {
-      init(input, startOffset, length);
+      init(input, startOffset, length, mutex);
     }
 
-    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset, size_t length)
+    /**
+     * \param mutex  If not null, held while seeking and reading the input stream,
+     *               so substreams of the same stream can be read from different threads.
+     */
+    void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset, size_t length, std::mutex* mutex = nullptr)
     {
       _inputStream = &input;
+      _mutex = mutex;
       _startPosition = startOffset;
       _currentPosition = startOffset;
       _endPosition = startOffset + static_cast<pos_type>(length);
@@ -65,6 +73,13 @@ class sub_streambuf :
       {
         ELEM_TYPE* base = _internalBuffer;
 
+        std::unique_lock<std::mutex> lock;
+        if (_mutex != nullptr)
+        {
+          lock = std::unique_lock<std::mutex>(*_mutex);
+        }
+
+        _inputStream->clear();
         _inputStream->seekg(_currentPosition, std::ios::beg);
         _inputStream->read(_internalBuffer, std::min(static_cast<size_t>(INTERNAL_BUFFER_SIZE), static_cast<size_t>(_endPosition - _currentPosition)));
         size_t n = static_cast<size_t>(_inputStream->gcount());
@@ -92,6 +107,7 @@ class sub_streambuf :
     ELEM_TYPE* _internalBuffer;
 
     std::basic_istream<ELEM_TYPE, TRAITS_TYPE>* _inputStream;
+    std::mutex* _mutex;
     pos_type _startPosition;
     pos_type _currentPosition;
     pos_type _endPosition;
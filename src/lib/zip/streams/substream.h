@@ -33,6 +33,17 @@ class basic_isubstream
 
     }
 
+    /**
+     * \brief Substream whose reads of input are serialized by mutex,
+     *        so several substreams of input can be read from different threads.
+     */
+    basic_isubstream(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset, size_t length, std::mutex& mutex)
+      : std::basic_istream<ELEM_TYPE, TRAITS_TYPE>(&_subStreambuf)
+      , _subStreambuf(input, startOffset, length, &mutex)
+    {
+
+    }
+
     void init(std::basic_istream<ELEM_TYPE, TRAITS_TYPE>& input, pos_type startOffset = 0)
     {
       _subStreambuf.init(input, startOffset, static_cast<size_t>(-1));
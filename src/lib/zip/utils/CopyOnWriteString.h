@@ -0,0 +1,103 @@
+#ifndef SiliconScratch_CopyOnWriteString_H
+#define SiliconScratch_CopyOnWriteString_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * \brief A string that can borrow a view of someone else's characters until it's modified,
+ *        at which point it copies them into its own std::string.
+ *        The borrowed characters must outlive the CopyOnWriteString and all its copies.
+ */
+class CopyOnWriteString {
+
+private:
+    
+    // owned is only allocated once modified, so a borrowing string is just a view and a null pointer
+    std::string_view borrowed;
+    std::unique_ptr<std::string> owned;
+
+public:
+    
+    CopyOnWriteString() = default;
+    
+    CopyOnWriteString(std::string string) : owned(std::make_unique<std::string>(std::move(string))) {}
+    
+    CopyOnWriteString(const CopyOnWriteString& other)
+            : borrowed(other.borrowed),
+              owned(other.owned ? std::make_unique<std::string>(*other.owned) : nullptr) {}
+    
+    CopyOnWriteString(CopyOnWriteString&& other) noexcept = default;
+    
+    CopyOnWriteString& operator=(const CopyOnWriteString& other) {
+        if (this != &other) {
+            *this = CopyOnWriteString(other);
+        }
+        return *this;
+    }
+    
+    CopyOnWriteString& operator=(CopyOnWriteString&& other) noexcept = default;
+    
+    static CopyOnWriteString borrow(std::string_view view) {
+        CopyOnWriteString string;
+        string.borrowed = view;
+        return string;
+    }
+    
+    bool isBorrowing() const noexcept {
+        return !owned;
+    }
+    
+    std::string_view view() const noexcept {
+        return owned ? std::string_view(*owned) : borrowed;
+    }
+    
+    operator std::string_view() const noexcept {
+        return view();
+    }
+    
+    const char* data() const noexcept {
+        return view().data();
+    }
+    
+    size_t length() const noexcept {
+        return view().length();
+    }
+    
+    size_t size() const noexcept {
+        return length();
+    }
+    
+    bool empty() const noexcept {
+        return view().empty();
+    }
+    
+    /**
+     * \brief Gets a mutable string, copying the borrowed characters first if necessary.
+     */
+    std::string& mut() {
+        if (!owned) {
+            owned = std::make_unique<std::string>(borrowed);
+            borrowed = {};
+        }
+        return *owned;
+    }
+    
+    CopyOnWriteString& operator=(std::string_view view) {
+        // view might be of our own string
+        auto string = std::make_unique<std::string>(view);
+        owned = std::move(string);
+        borrowed = {};
+        return *this;
+    }
+    
+    CopyOnWriteString& operator=(std::string&& string) {
+        owned = std::make_unique<std::string>(std::move(string));
+        borrowed = {};
+        return *this;
+    }
+    
+};
+
+#endif // SiliconScratch_CopyOnWriteString_H
@@ -0,0 +1,78 @@
+#include "src/lib/zip/utils/MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    
+    std::runtime_error error(std::string_view action, const fs::path& path) {
+        using namespace std::string_literals;
+        std::string message;
+        message += "cannot ";
+        message += action;
+        message += " ";
+        message += path.string();
+        message += ": ";
+        message += strerror(errno);
+        return std::runtime_error(message);
+    }
+    
+}
+
+MappedFile::MappedFile(const fs::path& path) {
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd == -1) {
+        throw error("open", path);
+    }
+    
+    struct stat stats = {};
+    if (fstat(_fd, &stats) == -1) {
+        const auto e = error("stat", path);
+        close(_fd);
+        throw e;
+    }
+    _size = static_cast<size_t>(stats.st_size);
+    
+    // mmap() rejects empty mappings, but an empty file is still a valid (albeit empty) view
+    if (_size == 0) {
+        return;
+    }
+    
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+        const auto e = error("mmap", path);
+        close(_fd);
+        throw e;
+    }
+    _data = static_cast<std::byte*>(data);
+}
+
+MappedFile::~MappedFile() {
+    if (_data) {
+        munmap(_data, _size);
+    }
+    close(_fd);
+}
+
+size_t MappedFile::size() const noexcept {
+    return _size;
+}
+
+std::span<const std::byte> MappedFile::bytes() const noexcept {
+    return {_data, _size};
+}
+
+std::string_view MappedFile::chars() const noexcept {
+    return {reinterpret_cast<const char*>(_data), _size};
+}
+
+int MappedFile::fd() const noexcept {
+    return _fd;
+}
@@ -0,0 +1,52 @@
+#ifndef SiliconScratch_MappedFile_H
+#define SiliconScratch_MappedFile_H
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+#include "src/lib/fs/fs.h"
+
+/**
+ * \brief A read-only, private memory mapping of an entire file.
+ *        The file descriptor is kept open for the lifetime of the mapping.
+ */
+class MappedFile {
+
+private:
+    
+    int _fd = -1;
+    std::byte* _data = nullptr;
+    size_t _size = 0;
+
+public:
+    
+    /**
+     * \brief Opens and maps the file at path.
+     *
+     * \param path  The file to map.
+     * \throws std::runtime_error if the file can't be opened or mapped.
+     */
+    explicit MappedFile(const fs::path& path);
+    
+    ~MappedFile();
+    
+    MappedFile(MappedFile&& other) = delete;
+    
+    MappedFile(const MappedFile& other) = delete;
+    
+    MappedFile& operator=(MappedFile&& other) = delete;
+    
+    MappedFile& operator=(const MappedFile& other) = delete;
+    
+    size_t size() const noexcept;
+    
+    std::span<const std::byte> bytes() const noexcept;
+    
+    std::string_view chars() const noexcept;
+    
+    int fd() const noexcept;
+    
+};
+
+#endif // SiliconScratch_MappedFile_H
@@ -0,0 +1,71 @@
+#include "src/lib/zip/utils/RandomAccessFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    
+    std::runtime_error error(std::string_view action, std::string_view path) {
+        std::string message;
+        message += "cannot ";
+        message += action;
+        message += " ";
+        message += path;
+        message += ": ";
+        message += strerror(errno);
+        return std::runtime_error(message);
+    }
+    
+}
+
+RandomAccessFile::RandomAccessFile(const fs::path& path) {
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd == -1) {
+        throw error("open", path.string());
+    }
+    
+    struct stat stats = {};
+    if (fstat(_fd, &stats) == -1) {
+        const auto e = error("stat", path.string());
+        close(_fd);
+        throw e;
+    }
+    _size = static_cast<u64>(stats.st_size);
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    close(_fd);
+}
+
+u64 RandomAccessFile::size() const noexcept {
+    return _size;
+}
+
+size_t RandomAccessFile::read(u64 offset, char* buffer, size_t length) const {
+    size_t total = 0;
+    while (total < length) {
+        const auto n = pread(_fd, buffer + total, length - total, static_cast<off_t>(offset + total));
+        if (n == 0) {
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw error("pread", "fd " + std::to_string(_fd));
+        }
+        total += static_cast<size_t>(n);
+    }
+    return total;
+}
+
+int RandomAccessFile::fd() const noexcept {
+    return _fd;
+}
@@ -0,0 +1,57 @@
+#ifndef SiliconScratch_RandomAccessFile_H
+#define SiliconScratch_RandomAccessFile_H
+
+#include <cstddef>
+
+#include "src/main/util/numbers.h"
+#include "src/lib/fs/fs.h"
+
+/**
+ * \brief A read-only file that is only read with positional reads (pread()).
+ *        There is no shared file position, so it can be read from several threads at once.
+ */
+class RandomAccessFile {
+
+private:
+    
+    int _fd = -1;
+    u64 _size = 0;
+
+public:
+    
+    /**
+     * \brief Opens the file at path.
+     *
+     * \param path  The file to open.
+     * \throws std::runtime_error if the file can't be opened.
+     */
+    explicit RandomAccessFile(const fs::path& path);
+    
+    ~RandomAccessFile();
+    
+    RandomAccessFile(RandomAccessFile&& other) = delete;
+    
+    RandomAccessFile(const RandomAccessFile& other) = delete;
+    
+    RandomAccessFile& operator=(RandomAccessFile&& other) = delete;
+    
+    RandomAccessFile& operator=(const RandomAccessFile& other) = delete;
+    
+    /**
+     * \brief The size of the file when it was opened.
+     */
+    u64 size() const noexcept;
+    
+    /**
+     * \brief Reads [offset, offset + length) of the file into buffer.
+     *
+     * \return  The number of bytes read, which is less than length only at the end of the file.
+     * \throws std::runtime_error if the read fails.
+     */
+    size_t read(u64 offset, char* buffer, size_t length) const;
+    
+    int fd() const noexcept;
+    
+};
+
+#endif // SiliconScratch_RandomAccessFile_H
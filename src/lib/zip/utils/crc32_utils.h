@@ -0,0 +1,39 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "../extlibs/zlib/zlib.h"
+
+namespace utils { namespace crc32 {
+
+/**
+ * \brief Continues crc, the CRC-32 of the bytes before, over length more bytes at data.
+ *        Uses zlib's crc32(), which uses the CPU's CRC instructions if it has them.
+ */
+inline uint32_t update(uint32_t crc, const void* data, size_t length)
+{
+  // zlib only takes a uInt of length at a time
+  constexpr size_t maxLength = 1u << 30;
+  auto* bytes = static_cast<const Bytef*>(data);
+  while (length > 0)
+  {
+    const auto n = std::min(length, maxLength);
+    crc = static_cast<uint32_t>(::crc32(crc, bytes, static_cast<uInt>(n)));
+    bytes += n;
+    length -= n;
+  }
+  return crc;
+}
+
+/**
+ * \brief Gets the CRC-32 of two pieces of data one after the other
+ *        from the CRC-32 of the first piece, crc1, and the CRC-32 of the second piece, crc2, which is length2 long.
+ *        length2 has to fit in a z_off_t, which is only 32 bits on some platforms.
+ */
+inline uint32_t combine(uint32_t crc1, uint32_t crc2, size_t length2)
+{
+  return static_cast<uint32_t>(::crc32_combine(crc1, crc2, static_cast<z_off_t>(length2)));
+}
+
+} }
@@ -6,13 +6,18 @@ namespace utils { namespace stream {
 
 static void copy(std::istream& from, std::ostream& to, size_t bufferSize = 1024 * 1024)
 {
-  std::vector<char> buff(bufferSize);
+  // reused by every copy on this thread instead of allocated for each one
+  thread_local std::vector<char> buff;
+  if (buff.size() < bufferSize)
+  {
+    buff.resize(bufferSize);
+  }
 
   do
   {
-    from.read(buff.data(), buff.size());
+    from.read(buff.data(), bufferSize);
     to.write(buff.data(), from.gcount());
-  } while (static_cast<size_t>(from.gcount()) == buff.size());
+  } while (static_cast<size_t>(from.gcount()) == bufferSize);
 }
 
 } }
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace utils::thread {
+    
+    /**
+     * \brief The number of threads to use by default, the hardware concurrency or 1 if that's unknown.
+     */
+    inline size_t defaultNumThreads() noexcept {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    /**
+     * \brief Calls f(i) for every i in [0, count) on a pool of numThreads threads (including this one).
+     *        Indices are handed out in increasing order as threads become free,
+     *        so sort the work beforehand to control what starts first.
+     *        If any call throws, no new calls are started and the first exception is rethrown here.
+     *
+     * \param numThreads  The maximum number of threads to use, or 0 for defaultNumThreads().
+     */
+    template <typename F>
+    void parallelFor(size_t count, size_t numThreads, F&& f) {
+        if (numThreads == 0) {
+            numThreads = defaultNumThreads();
+        }
+        numThreads = std::min(numThreads, count);
+        
+        std::atomic<size_t> next = 0;
+        std::atomic<bool> failed = false;
+        std::exception_ptr exception;
+        std::mutex exceptionMutex;
+        
+        const auto work = [&]() {
+            for (size_t i; !failed && (i = next++) < count;) {
+                try {
+                    f(i);
+                } catch (...) {
+                    std::lock_guard lock(exceptionMutex);
+                    if (!exception) {
+                        exception = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+        
+        if (numThreads > 1) {
+            std::vector<std::thread> threads;
+            threads.reserve(numThreads - 1);
+            for (size_t i = 1; i < numThreads; i++) {
+                try {
+                    threads.emplace_back(work);
+                } catch (const std::system_error&) {
+                    // make do with the threads we have
+                    break;
+                }
+            }
+            work();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        } else {
+            work();
+        }
+        
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+    
+}
@@ -4,6 +4,7 @@
 
 #include "modifiedZipLib.h"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <ios>
@@ -21,10 +22,9 @@ void modifiedZipLib() {
     
     // TODO make decompression const, since it doesn't change the archive
     auto& entry = archive.entry("project.json").get();
-    std::cout << "stream" << std::endl;
-    auto& stream = *entry.decompressionStream();
-    std::cout << stream.fail() << std::endl;
-    std::cout << stream.tellg() << std::endl;
+    std::cout << "readAll" << std::endl;
+    const auto json = entry.readAll();
+    std::cout << json.has_value() << std::endl;
     std::cout << entry.fullName() << std::endl;
 //    char chars[1000] = {};
 //    stream.read(chars, sizeof(chars) - 1);
@@ -33,9 +33,9 @@ void modifiedZipLib() {
     
     std::ofstream out("/mnt/c/Users/Khyber/Downloads/project.silicon.json");
     out << "Hello" << std::endl;
-    std::copy_n(std::istreambuf_iterator(stream),
-                1000,
-                std::ostreambuf_iterator(out));
+    if (json) {
+        out.write(reinterpret_cast<const char*>(json->data()), std::min<std::streamsize>(json->size(), 1000));
+    }
 //    stream >> std::cout;
 
 //    std::cout << "json" << std::endl;
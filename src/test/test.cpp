@@ -8,6 +8,7 @@
 
 #include "Test.h"
 #include "Tests.h"
+#include "zipTests.h"
 
 bool alwaysTrue() {
     return true;
@@ -17,6 +18,15 @@ bool alwaysTrue() {
 
 static Test tests[] = {
         test(alwaysTrue),
+        test(parallelDeflateRoundTrips),
+        test(parallelBzip2RoundTrips),
+        test(parallelBzip2WithFakeBlockMagicRoundTrips),
+        test(xzRoundTrips),
+        test(deduplicatedArchivePassesTest),
+        test(zip64ArchiveRoundTrips),
+        test(updateAddsEntry),
+        test(updateRemovesEntryAndCompactShrinks),
+        test(updateWithoutChangesKeepsEntriesInPlace),
 };
 
 #undef test
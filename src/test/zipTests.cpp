@@ -0,0 +1,360 @@
+#include "zipTests.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../lib/zip/compression/bzip2/bzip2_decoder.h"
+#include "../lib/zip/compression/bzip2/bzip2_encoder.h"
+#include "../lib/zip/compression/bzip2/detail/bzip2_bits.h"
+#include "../lib/zip/compression/deflate/deflate_decoder.h"
+#include "../lib/zip/compression/deflate/deflate_encoder.h"
+#include "../lib/zip/compression/xz/xz_decoder.h"
+#include "../lib/zip/compression/xz/xz_encoder.h"
+#include "../lib/zip/ZipArchive.h"
+#include "../lib/zip/ZipFile.h"
+
+namespace {
+    
+    constexpr size_t numThreads = 4;
+    
+    /**
+     * \brief Makes text that compresses about as well as a project.json, but isn't just repeated.
+     */
+    std::string makeText(size_t size) {
+        std::mt19937 random(size);
+        std::string text;
+        text.reserve(size + 16);
+        while (text.size() < size) {
+            text += std::to_string(random() % 100003);
+            text += random() % 5 == 0 ? '\n' : ' ';
+        }
+        text.resize(size);
+        return text;
+    }
+    
+    template <typename Encoder, typename Properties>
+    std::string compress(const std::string& data, Properties& properties) {
+        Encoder encoder;
+        std::ostringstream out;
+        encoder.init(out, properties);
+        size_t position = 0;
+        while (true) {
+            const auto capacity = static_cast<size_t>(encoder.get_buffer_end() - encoder.get_buffer_begin());
+            const auto length = std::min(capacity, data.size() - position);
+            std::copy_n(data.data() + position, length, encoder.get_buffer_begin());
+            position += length;
+            encoder.encode_next(length);
+            if (length < capacity) {
+                break;
+            }
+        }
+        encoder.sync();
+        return out.str();
+    }
+    
+    /**
+     * \brief Decompresses from memory if the decoder supports it and fromMemory, or else from a stream.
+     *        It reads 1 byte past size so that too much output is caught, too.
+     */
+    template <typename Decoder, typename Properties>
+    std::string decompress(const std::string& compressed, size_t size, Properties& properties, bool fromMemory) {
+        Decoder decoder;
+        std::istringstream in(compressed);
+        if (!fromMemory || !decoder.init(compressed.data(), compressed.size(), properties)) {
+            decoder.init(in, properties);
+        }
+        std::string data(size + 1, '\0');
+        size_t length = 0;
+        while (length < data.size()) {
+            const auto read = decoder.decode_into(data.data() + length, data.size() - length);
+            if (read == 0) {
+                break;
+            }
+            length += read;
+        }
+        data.resize(length);
+        return data;
+    }
+    
+    template <typename Encoder, typename Decoder, typename EncoderProperties, typename DecoderProperties>
+    bool roundTrips(const std::string& data, EncoderProperties& encoderProperties,
+                    DecoderProperties& decoderProperties) {
+        const auto compressed = compress<Encoder>(data, encoderProperties);
+        for (const bool fromMemory : {true, false}) {
+            if (decompress<Decoder>(compressed, data.size(), decoderProperties, fromMemory) != data) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    bool bzip2RoundTrips(const std::string& data) {
+        for (const size_t encoderThreads : {static_cast<size_t>(1), numThreads}) {
+            bzip2_encoder_properties encoderProperties;
+            encoderProperties.BlockSize = 1; // 100 KB, so there are many blocks
+            encoderProperties.NumThreads = encoderThreads;
+            bzip2_decoder_properties decoderProperties;
+            decoderProperties.NumThreads = numThreads;
+            if (!roundTrips<bzip2_encoder, bzip2_decoder>(data, encoderProperties, decoderProperties)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    /**
+     * \brief Opens a new archive to add entries to and write somewhere, i.e. with writeTo().
+     */
+    std::unique_ptr<ZipArchive> createArchive() {
+        // just an end of central directory record
+        auto emptyArchive = std::string("PK\x05\x06", 4) + std::string(18, '\0');
+        return std::make_unique<ZipArchive>(std::make_unique<std::istringstream>(std::move(emptyArchive)));
+    }
+    
+    fs::path temporaryArchivePath(std::string_view name) {
+        return fs::temp_directory_path() / ("SiliconScratch.test." + std::string(name) + ".zip");
+    }
+    
+    void addEntry(ZipArchive& archive, const std::string& name, const std::string& contents,
+                  ICompressionMethod::Ptr method = AutoMethod::Create()) {
+        auto& entry = archive.entry(name).create(ZipArchive::MaybeEntry::CreateMode::OVERWRITE).get();
+        std::istringstream in(contents);
+        entry.setCompressionStream(in, std::move(method), ZipArchiveEntry::CompressionMode::Immediate);
+    }
+    
+    std::string readFile(const fs::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+    
+    /**
+     * \brief Writes an archive of a few deflated and stored entries to update, and returns what's in it.
+     */
+    std::map<std::string, std::string> writeArchiveToUpdate(const fs::path& path) {
+        std::map<std::string, std::string> entries = {
+                {"project.json", makeText(100000)},
+                {"assets/0.svg", makeText(5000)},
+                {"assets/1.png", std::string("\x89PNG\r\n\x1A\n", 8) + makeText(3000)},
+                {"empty.txt", ""},
+        };
+        const auto archive = createArchive();
+        for (const auto& [name, contents] : entries) {
+            addEntry(*archive, name, contents);
+        }
+        archive->writeTo(path);
+        return entries;
+    }
+    
+    bool hasContents(ZipArchive& archive, const std::string& name, const std::string& contents) {
+        auto entry = archive.entry(name);
+        if (!entry) {
+            return false;
+        }
+        const auto data = entry.get().readAll(true);
+        return data && std::equal(data->begin(), data->end(), contents.begin(), contents.end(),
+                                  [](std::byte a, char b) { return a == static_cast<std::byte>(b); });
+    }
+    
+    bool hasEntries(ZipArchive& archive, const std::map<std::string, std::string>& entries) {
+        bool passed = archive.size() == entries.size();
+        for (const auto& [name, contents] : entries) {
+            passed &= hasContents(archive, name, contents);
+        }
+        return passed;
+    }
+    
+}
+
+bool parallelDeflateRoundTrips() {
+    deflate_encoder_properties encoderProperties;
+    encoderProperties.NumThreads = numThreads;
+    deflate_decoder_properties decoderProperties;
+    for (const size_t size : {0, 1000, 1 << 20}) {
+        const auto data = makeText(size);
+        for (const size_t chunkSize : {1 << 12, 1 << 17}) {
+            encoderProperties.ChunkSize = chunkSize;
+            if (!roundTrips<deflate_encoder, deflate_decoder>(data, encoderProperties, decoderProperties)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool parallelBzip2RoundTrips() {
+    for (const size_t size : {0, 1000, 1 << 20}) {
+        if (!bzip2RoundTrips(makeText(size))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parallelBzip2WithFakeBlockMagicRoundTrips() {
+    // the symbol map at the start of each block has a bit for each byte in it, 16 bytes at a time,
+    // so if only the 48 bytes from '@' are used, the map spells out the bits of the block magic,
+    // which splits each block when scanning for them, and each has to be decompressed again with the next piece
+    std::string alphabet;
+    for (size_t i = 0; i < detail::bzip2_bits::MagicBits; i++) {
+        if ((detail::bzip2_bits::BlockMagic >> (detail::bzip2_bits::MagicBits - 1 - i)) & 1) {
+            alphabet += static_cast<char>('@' + i);
+        }
+    }
+    std::mt19937 random(0);
+    std::string data(1 << 19, '\0');
+    for (auto& c : data) {
+        c = alphabet[random() % alphabet.size()];
+    }
+    return bzip2RoundTrips(data);
+}
+
+bool xzRoundTrips() {
+    xz_encoder_properties encoderProperties;
+    encoderProperties.CompressionLevel = 1;
+    encoderProperties.NumThreads = numThreads;
+    encoderProperties.BlockSize = 1 << 20;
+    xz_decoder_properties decoderProperties;
+    decoderProperties.NumThreads = numThreads;
+    for (const size_t size : {0, 1000, 3 << 20}) {
+        if (!roundTrips<xz_encoder, xz_decoder>(makeText(size), encoderProperties, decoderProperties)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool deduplicatedArchivePassesTest() {
+    // random, so it's stored and the archive's size shows if it's written more than once
+    constexpr size_t size = 1 << 16;
+    std::mt19937 random(0);
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(random());
+    }
+    const auto path = temporaryArchivePath("deduplicated");
+    
+    std::vector<std::unique_ptr<std::istringstream>> inputs;
+    const auto add = [&](ZipArchive& archive, const std::string& name, const std::string& contents) {
+        auto& entry = archive.entry(name).create(ZipArchive::MaybeEntry::CreateMode::OVERWRITE).get();
+        inputs.push_back(std::make_unique<std::istringstream>(contents));
+        entry.setCompressionStream(*inputs.back());
+    };
+    {
+        const auto archive = createArchive();
+        archive->setDeduplicating(true);
+        for (const auto* name : {"a.bin", "b.bin", "c.bin"}) {
+            add(*archive, name, data);
+        }
+        archive->writeTo(path);
+    }
+    
+    bool passed = fs::file_size(path) < 2 * size && ZipFile::Test(path.string()).ok();
+    {
+        // the entries sharing a local file header stay in place, instead of being written out again
+        ZipArchive archive(path);
+        add(archive, "d.txt", "not a duplicate");
+        archive.update();
+    }
+    passed &= fs::file_size(path) < 2 * size && ZipFile::Test(path.string()).ok();
+    
+    fs::remove(path);
+    return passed;
+}
+
+bool zip64ArchiveRoundTrips() {
+    // more entries than fit in the end of central directory record's 16 bits, so it needs the Zip64 one
+    constexpr size_t numEntries = 70000;
+    const auto path = temporaryArchivePath("zip64");
+    const auto name = [](size_t i) {
+        return "entries/" + std::to_string(i) + ".txt";
+    };
+    {
+        const auto archive = createArchive();
+        for (size_t i = 0; i < numEntries; i++) {
+            addEntry(*archive, name(i), std::to_string(i), StoreMethod::Create());
+        }
+        archive->writeTo(path);
+    }
+    
+    bool passed = true;
+    for (const auto backend : {ZipArchive::Backend::Stream, ZipArchive::Backend::MemoryMapped,
+                               ZipArchive::Backend::PositionalRead}) {
+        ZipArchive archive(path, backend);
+        passed &= archive.size() == numEntries;
+        for (const size_t i : {static_cast<size_t>(0), static_cast<size_t>(0xFFFF), numEntries - 1}) {
+            const auto entry = archive.entry(name(i));
+            passed &= entry && &entry.get() == &archive[i] && hasContents(archive, name(i), std::to_string(i));
+        }
+        passed &= !archive.entry(name(numEntries));
+        passed &= ZipFile::Test(archive).ok();
+    }
+    
+    fs::remove(path);
+    return passed;
+}
+
+bool updateAddsEntry() {
+    const auto path = temporaryArchivePath("update.add");
+    auto entries = writeArchiveToUpdate(path);
+    {
+        ZipArchive archive(path);
+        entries["added.json"] = makeText(20000);
+        addEntry(archive, "added.json", entries["added.json"]);
+        archive.update();
+    }
+    
+    ZipArchive archive(path);
+    const bool passed = hasEntries(archive, entries) && ZipFile::Test(archive).ok();
+    fs::remove(path);
+    return passed;
+}
+
+bool updateRemovesEntryAndCompactShrinks() {
+    const auto path = temporaryArchivePath("update.remove");
+    auto entries = writeArchiveToUpdate(path);
+    {
+        ZipArchive archive(path);
+        archive.entry("project.json").remove(ZipArchive::MaybeEntry::RemoveMode::FAIL_IF_NOT_EXISTS);
+        entries.erase("project.json");
+        archive.update();
+    }
+    
+    // the removed entry's data is only left behind by update(), and compact() gets rid of it
+    const auto updatedSize = fs::file_size(path);
+    bool passed = true;
+    {
+        ZipArchive archive(path);
+        passed &= hasEntries(archive, entries) && ZipFile::Test(archive).ok();
+        archive.compact();
+    }
+    passed &= fs::file_size(path) < updatedSize;
+    
+    ZipArchive archive(path);
+    passed &= hasEntries(archive, entries) && ZipFile::Test(archive).ok();
+    fs::remove(path);
+    return passed;
+}
+
+bool updateWithoutChangesKeepsEntriesInPlace() {
+    const auto path = temporaryArchivePath("update.unchanged");
+    const auto entries = writeArchiveToUpdate(path);
+    const auto original = readFile(path);
+    {
+        ZipArchive archive(path);
+        archive.update();
+    }
+    
+    // every local file header and its data stays where it was, and the central directory is written the same
+    ZipArchive archive(path);
+    const bool passed = readFile(path) == original && hasEntries(archive, entries) && ZipFile::Test(archive).ok();
+    fs::remove(path);
+    return passed;
+}
@@ -0,0 +1,22 @@
+#ifndef ScratchWasmRenderer_zipTests_H
+#define ScratchWasmRenderer_zipTests_H
+
+bool parallelDeflateRoundTrips();
+
+bool parallelBzip2RoundTrips();
+
+bool parallelBzip2WithFakeBlockMagicRoundTrips();
+
+bool xzRoundTrips();
+
+bool deduplicatedArchivePassesTest();
+
+bool zip64ArchiveRoundTrips();
+
+bool updateAddsEntry();
+
+bool updateRemovesEntryAndCompactShrinks();
+
+bool updateWithoutChangesKeepsEntriesInPlace();
+
+#endif // ScratchWasmRenderer_zipTests_H